@@ -0,0 +1,94 @@
+#include "../include/mexFuzzyFinder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures the open file palette: how long each keystroke of a few queries takes to rank the paths below a
+// directory, on one thread and on every hardware thread. The palette should keep up with typing (16 ms).
+// Usage: fuzzyBench [directory] [files]. The directory is filled with empty files in nested directories when
+// it does not exist (default 500000 files).
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static void generate(const fs::path& root, size_t files)
+{
+    static const char* words[] = {
+        "src", "include", "core", "util", "network", "render", "parser", "editor", "buffer", "search",
+        "config", "test", "module", "driver", "platform", "widget", "index", "cache", "stream", "event",
+    };
+    static const char* extensions[] = {".cpp", ".h", ".txt", ".md", ".json", ".py"};
+
+    std::mt19937 rng(42);
+    auto word = [&] { return std::string(words[rng() % std::size(words)]); };
+    for (size_t i = 0; i < files; ++i)
+    {
+        fs::path directory = root;
+        for (size_t depth = 1 + rng() % 4; depth > 0; --depth)
+        {
+            directory /= word() + std::to_string(rng() % 8);
+        }
+        fs::create_directories(directory);
+        std::ofstream(directory / (word() + "_" + word() + std::to_string(i) + extensions[rng() % std::size(extensions)]));
+    }
+}
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    fs::path root = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "mexedit_bench_tree";
+    size_t files = argc > 2 ? std::stoul(argv[2]) : 500000;
+
+    if (!fs::exists(root))
+    {
+        std::printf("generating %zu files below %s\n", files, root.c_str());
+        generate(root, files);
+    }
+
+    const char* queries[] = {"edbufcpp", "srcparser", "netstream", "zzq"};
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads : {size_t{1}, hardware})
+    {
+        MexFuzzyFinder finder;
+        finder.setThreadCount(threads);
+        auto start = Clock::now();
+        finder.start(root);
+        while (finder.isIndexing())
+        {
+            finder.collectPaths();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        finder.collectPaths();
+        std::printf("%zu threads: %zu paths walked in %.0f ms\n", threads, finder.pathCount(), milliseconds(start));
+
+        for (const char* query : queries)
+        {
+            std::string typed;
+            std::printf("  %-10s", query);
+            double slowest = 0;
+            for (const char* letter = query; *letter; ++letter)
+            {
+                typed.push_back(*letter);
+                auto keystroke = Clock::now();
+                finder.setQuery(typed);
+                double elapsed = milliseconds(keystroke);
+                slowest = std::max(slowest, elapsed);
+                std::printf(" %6.2f", elapsed);
+            }
+            std::printf("  ms per letter, slowest %.2f ms, %zu matches\n", slowest, finder.matchCount());
+            finder.setQuery({});
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "../include/mexProjectSearch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+// Measures project search latency with and without the trigram index: building the index from scratch, refreshing
+// it when nothing and when a few files changed, and then queries from common to absent words. Both ways must find
+// the same matches. The index is written to a temporary cache directory. The files are generated unless a directory
+// is given; either way the page cache is warm, so the unindexed times are the best a full scan can do.
+// Usage: indexBench [directory|-] [files] [kibPerFile]. The defaults generate 20000 files of 8 KiB.
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void generate(const fs::path& root, size_t files, size_t kibPerFile)
+{
+    uint64_t state = 12345;
+    auto random = [&]()
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<size_t>(state >> 33);
+    };
+
+    for (size_t i = 0; i < files; ++i)
+    {
+        fs::path directory = root / ("d" + std::to_string(i % 100)) / ("e" + std::to_string(i / 100 % 10));
+        fs::create_directories(directory);
+        std::string text;
+        while (text.size() < kibPerFile * 1024)
+        {
+            // Words from a vocabulary of 5000, with one of them in every 1000 files only.
+            for (int word = 0; word < 8; ++word)
+            {
+                text.append("w" + std::to_string(random() % 5000) + "x ");
+            }
+            text.push_back('\n');
+        }
+        if (i % 1000 == 0)
+        {
+            text.append("rareIdentifier\n");
+        }
+        std::ofstream(directory / ("f" + std::to_string(i) + ".txt")) << text;
+    }
+}
+
+using Match = std::tuple<std::string, size_t, size_t>;
+
+static std::vector<Match> search(MexProjectSearch& engine, const fs::path& root, const std::string& pattern, double& elapsed)
+{
+    auto start = Clock::now();
+    engine.start(root, pattern);
+    while (engine.isSearching())
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    engine.collectResults();
+    elapsed = milliseconds(start);
+
+    std::vector<Match> matches;
+    for (const auto& result : engine.getResults())
+    {
+        matches.emplace_back(result.file.string(), result.line, result.column);
+    }
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+int main(int argc, char* argv[])
+{
+    fs::path scratch = fs::temp_directory_path() / ("indexBench." + std::to_string(getpid()));
+    fs::create_directories(scratch / "cache");
+    setenv("XDG_CACHE_HOME", (scratch / "cache").c_str(), 1);
+
+    fs::path root;
+    if (argc > 1 and std::string(argv[1]) != "-")
+    {
+        root = fs::absolute(argv[1]);
+    }
+    else
+    {
+        size_t files = argc > 2 ? std::stoul(argv[2]) : 20000;
+        size_t kibPerFile = argc > 3 ? std::stoul(argv[3]) : 8;
+        root = scratch / "tree";
+        auto start = Clock::now();
+        generate(root, files, kibPerFile);
+        std::printf("generated %zu files of %zu KiB in %.0f ms\n", files, kibPerFile, milliseconds(start));
+    }
+    root = root.lexically_normal();
+
+    MexProjectSearch engine;
+    auto start = Clock::now();
+    engine.updateIndex(root);
+    while (engine.isIndexing())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto index = MexTrigramIndex::load(root);
+    if (!index)
+    {
+        std::fprintf(stderr, "the index was not built\n");
+        return 1;
+    }
+    std::printf("built the index of %zu files in %.0f ms, %.1f MiB\n", index->fileCount(), milliseconds(start),
+                static_cast<double>(fs::file_size(MexTrigramIndex::cachePath(root))) / (1 << 20));
+
+    start = Clock::now();
+    index = MexTrigramIndex::build(root, index.get(), 0, std::stop_token());
+    std::printf("refreshed it with nothing changed in %.0f ms\n", milliseconds(start));
+
+    bool same = true;
+    std::printf("%-20s %10s %12s %12s %10s %8s\n", "query", "matches", "scan ms", "indexed ms", "candidates", "speedup");
+    for (const char* pattern : {"w1x", "w4242x", "rareIdentifier", "absentIdentifier", "w1"})
+    {
+        double scan = 0;
+        double indexed = 0;
+        engine.setIndexed(false);
+        std::vector<Match> expected = search(engine, root, pattern, scan);
+        engine.setIndexed(true);
+        std::vector<Match> found = search(engine, root, pattern, indexed);
+
+        auto candidates = index->candidates(pattern);
+        std::string narrowed = candidates ? std::to_string(candidates->size()) : "all";
+        std::printf("%-20s %10zu %12.1f %12.1f %10s %7.1fx\n", pattern, expected.size(), scan, indexed, narrowed.c_str(),
+                    scan / indexed);
+        if (found != expected)
+        {
+            std::fprintf(stderr, "the indexed search for %s found different matches\n", pattern);
+            same = false;
+        }
+    }
+
+    // Change a few files, so the refresh reads those and takes the rest from the previous index.
+    if (root.native().starts_with(scratch.native()))
+    {
+        std::vector<fs::path> changed;
+        for (const auto& entry : fs::recursive_directory_iterator(root))
+        {
+            if (entry.is_regular_file() and changed.size() < 10)
+            {
+                changed.push_back(entry.path());
+                std::ofstream(entry.path(), std::ios::app) << "changedIdentifier\n";
+            }
+        }
+
+        start = Clock::now();
+        index = MexTrigramIndex::build(root, index.get(), 0, std::stop_token());
+        double refresh = milliseconds(start);
+        auto candidates = index->candidates("changedIdentifier");
+        std::printf("refreshed it with %zu files changed in %.0f ms\n", changed.size(), refresh);
+        if (!candidates or candidates->size() != changed.size())
+        {
+            std::fprintf(stderr, "the refreshed index does not name the changed files\n");
+            same = false;
+        }
+    }
+
+    std::error_code ec;
+    fs::remove_all(scratch, ec);
+    return same ? 0 : 1;
+}
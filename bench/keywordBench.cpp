@@ -0,0 +1,199 @@
+#include "../include/mexKeywords.h"
+#include "../include/mexLexer.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Compares keyword classification paths on a C++ file: one std::regex per keyword (the previous
+// highlighter), a std::unordered_set lookup per identifier, and the compile-time perfect-hash table.
+// Usage: keywordBench [file] [sizeInMiB]. Without a file, C++-like text is generated (default 64 MiB).
+// The regex path only runs over the first MiB, it is several orders of magnitude slower.
+
+using Clock = std::chrono::steady_clock;
+
+static std::string generate(size_t bytes)
+{
+    static const char* templates[] = {
+        "    for (int index = 0; index < count; ++index)",
+        "    {",
+        "        const auto& value = values[index]; // keep a reference",
+        "        if (value.isValid() and !value.empty()) return compute(value, 42);",
+        "        else continue;",
+        "    }",
+        "template<typename T> class Container : public Base<T>",
+        "    virtual void update(double delta) override final;",
+        "    switch (state) { case State::Idle: break; default: goto done; }",
+        "    std::string message = \"while the struct is constant\";",
+        "struct Point { float x; float y; bool visible; };",
+        "namespace detail { static char buffer[256]; }",
+    };
+
+    std::mt19937 rng(42);
+    std::string text;
+    text.reserve(bytes + 256);
+    while (text.size() < bytes)
+    {
+        text.append(templates[rng() % std::size(templates)]);
+        text.push_back('\n');
+    }
+    return text;
+}
+
+static std::vector<std::string_view> splitLines(const std::string& text, size_t limit)
+{
+    std::vector<std::string_view> lines;
+    size_t pos = 0;
+    while (pos < text.size() and pos < limit)
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        lines.emplace_back(text.data() + pos, end - pos);
+        pos = end + 1;
+    }
+    return lines;
+}
+
+static double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static size_t regexPath(const std::vector<std::string_view>& lines)
+{
+    std::vector<std::regex> patterns;
+    for (const MexKeyword& keyword : cppKeywords)
+    {
+        patterns.emplace_back(R"(\b)" + std::string(keyword.word) + R"(\b)");
+    }
+
+    size_t hits = 0;
+    for (std::string_view line : lines)
+    {
+        for (const auto& pattern : patterns)
+        {
+            hits += std::distance(std::cregex_iterator(line.data(), line.data() + line.size(), pattern),
+                                  std::cregex_iterator());
+        }
+    }
+    return hits;
+}
+
+static size_t hashSetPath(const std::vector<std::string_view>& lines)
+{
+    std::unordered_set<std::string_view> keywords;
+    for (const MexKeyword& keyword : cppKeywords)
+    {
+        keywords.insert(keyword.word);
+    }
+
+    auto isWord = [](char c)
+    {
+        return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_';
+    };
+
+    size_t hits = 0;
+    for (std::string_view line : lines)
+    {
+        size_t pos = 0;
+        while (pos < line.size())
+        {
+            if (!isWord(line[pos]))
+            {
+                pos++;
+                continue;
+            }
+            size_t end = pos;
+            while (end < line.size() and isWord(line[end]))
+            {
+                end++;
+            }
+            hits += keywords.contains(line.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+    return hits;
+}
+
+static size_t perfectHashPath(const std::vector<std::string_view>& lines)
+{
+    MexLexer lexer({}, cppKeywordTable.view());
+    std::vector<MexLexer::Token> tokens;
+
+    size_t hits = 0;
+    for (std::string_view line : lines)
+    {
+        lexer.tokenize(line, 0, tokens);
+        hits += tokens.size();
+    }
+    return hits;
+}
+
+template<typename Fn>
+static void measure(const char* name, const std::vector<std::string_view>& lines, size_t bytes, Fn&& fn, size_t& hits)
+{
+    double best = 1e9;
+    for (int run = 0; run < 3; ++run)
+    {
+        auto start = Clock::now();
+        hits = fn(lines);
+        best = std::min(best, seconds(start));
+    }
+    std::printf("%-14s %10zu keywords %10.2f MB/s\n", name, hits, static_cast<double>(bytes) / best / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t sizeMiB = argc > 2 ? std::stoul(argv[2]) : 64;
+
+    std::string text;
+    if (argc > 1)
+    {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file.is_open())
+        {
+            std::fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        text = std::move(content).str();
+    }
+    else
+    {
+        text = generate(sizeMiB << 20);
+    }
+
+    constexpr size_t sampleBytes = 1 << 20;
+    auto sample = splitLines(text, sampleBytes);
+    auto all = splitLines(text, text.size());
+    size_t sampleSize = std::min(sampleBytes, text.size());
+
+    std::printf("%.1f MiB of C++, %zu keywords, %zu table slots\n", static_cast<double>(text.size()) / (1 << 20),
+                cppKeywords.size(), cppKeywordTable.slots.size());
+
+    size_t regexHits = 0, setHits = 0, tableHits = 0;
+    std::printf("first %.1f MiB:\n", static_cast<double>(sampleSize) / (1 << 20));
+    measure("regex", sample, sampleSize, regexPath, regexHits);
+    measure("unordered_set", sample, sampleSize, hashSetPath, setHits);
+    measure("perfect hash", sample, sampleSize, perfectHashPath, tableHits);
+    if (regexHits != tableHits or setHits != tableHits)
+    {
+        std::fprintf(stderr, "keyword counts differ\n");
+        return 1;
+    }
+
+    std::printf("whole file:\n");
+    measure("unordered_set", all, text.size(), hashSetPath, setHits);
+    measure("perfect hash", all, text.size(), perfectHashPath, tableHits);
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "../include/mexLineScan.h"
+#include "../include/mexMappedFile.h"
+#include "../include/mexTextBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+// Measures newline indexing throughput on a synthetic file, and on one of the same size holding a single line.
+// Usage: lineIndexBench [file] [sizeInMiB]. The files are generated when they do not exist (default 1 GiB).
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static void generate(const fs::path& path, size_t bytes)
+{
+    std::ofstream out(path, std::ios::binary);
+    std::mt19937 rng(42);
+    std::string block;
+    block.reserve(1 << 20);
+
+    size_t written = 0;
+    while (written < bytes)
+    {
+        block.clear();
+        while (block.size() < (1 << 20))
+        {
+            size_t length = rng() % 120;
+            for (size_t i = 0; i < length; ++i)
+            {
+                block.push_back(static_cast<char>(' ' + rng() % 94));
+            }
+            block.push_back('\n');
+        }
+        out.write(block.data(), static_cast<std::streamsize>(block.size()));
+        written += block.size();
+    }
+}
+
+static void generateLine(const fs::path& path, size_t bytes)
+{
+    // A minified file: one line, no newline at the end.
+    std::ofstream out(path, std::ios::binary);
+    std::mt19937 rng(42);
+    std::string block(1 << 20, ' ');
+
+    for (size_t written = 0; written < bytes; written += block.size())
+    {
+        for (char& c : block)
+        {
+            c = static_cast<char>(' ' + rng() % 94);
+        }
+        out.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), bytes - written)));
+    }
+}
+
+static double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    fs::path path = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "mexedit_bench_lines.txt";
+    size_t sizeMiB = argc > 2 ? std::stoul(argv[2]) : 1024;
+
+    if (!fs::exists(path))
+    {
+        std::printf("generating %zu MiB at %s\n", sizeMiB, path.c_str());
+        generate(path, sizeMiB << 20);
+    }
+
+    auto file = std::make_shared<MexMappedFile>();
+    if (!file->open(path))
+    {
+        std::fprintf(stderr, "cannot map %s\n", path.c_str());
+        return 1;
+    }
+
+    double gigabytes = static_cast<double>(file->size()) / 1e9;
+    size_t expected = MexLineScan::countNewlines(file->data(), file->size(), MexLineScan::Isa::Scalar);
+    std::printf("%s: %.2f GB, %zu newlines\n", path.c_str(), gigabytes, expected);
+
+    for (auto isa : {MexLineScan::Isa::Scalar, MexLineScan::Isa::SSE2, MexLineScan::Isa::AVX2})
+    {
+        if (static_cast<int>(isa) > static_cast<int>(MexLineScan::bestIsa()))
+        {
+            continue;
+        }
+
+        double best = 1e9;
+        for (int run = 0; run < 3; ++run)
+        {
+            auto start = Clock::now();
+            size_t count = MexLineScan::countNewlines(file->data(), file->size(), isa);
+            best = std::min(best, seconds(start));
+            if (count != expected)
+            {
+                std::fprintf(stderr, "%s miscounted: %zu\n", MexLineScan::isaName(isa), count);
+                return 1;
+            }
+        }
+        std::printf("countNewlines %-7s %8.2f GB/s\n", MexLineScan::isaName(isa), gigabytes / best);
+    }
+
+    for (int run = 0; run < 3; ++run)
+    {
+        auto mapped = std::make_shared<MexMappedFile>();
+        mapped->open(path);
+
+        auto start = Clock::now();
+        MexTextBuffer buffer;
+        buffer.assign(mapped);
+        buffer.line(0);
+        double firstLine = seconds(start);
+        size_t lines = buffer.lineCount();
+        double total = seconds(start);
+
+        std::printf("parallel index: first line %.3f ms, %zu lines in %.3f s (%.2f GB/s)\n",
+                    firstLine * 1e3, lines, total, gigabytes / total);
+    }
+
+    fs::path linePath = path;
+    linePath += ".line";
+    if (!fs::exists(linePath))
+    {
+        std::printf("generating %zu MiB on one line at %s\n", sizeMiB, linePath.c_str());
+        generateLine(linePath, sizeMiB << 20);
+    }
+
+    for (int run = 0; run < 3; ++run)
+    {
+        auto mapped = std::make_shared<MexMappedFile>();
+        if (!mapped->open(linePath))
+        {
+            std::fprintf(stderr, "cannot map %s\n", linePath.c_str());
+            return 1;
+        }
+        double lineGigabytes = static_cast<double>(mapped->size()) / 1e9;
+
+        auto start = Clock::now();
+        MexTextBuffer buffer;
+        buffer.assign(mapped);
+        size_t lines = buffer.lineCount();
+        double total = seconds(start);
+        if (lines != 1)
+        {
+            std::fprintf(stderr, "single line indexed as %zu lines\n", lines);
+            return 1;
+        }
+
+        std::printf("single line index: %.3f s (%.2f GB/s)\n", total, lineGigabytes / total);
+    }
+
+    return 0;
+}
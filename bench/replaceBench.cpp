@@ -0,0 +1,145 @@
+#include "../include/mexHistory.h"
+#include "../include/mexSearch.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures MexSearch::replaceAll on generated documents with millions of replacements: CSV-like short lines
+// and minified code with very long lines. The edits are recorded in one history group, as the editor does,
+// and undoing that step must restore the document. Every thread count must produce the same text, and on the
+// short lines so must the previous approach, which rebuilt each line with one std::string::replace per match.
+// Usage: replaceBench [millionsOfMatches] [maxThreads]. The defaults are 10 million and the number of hardware
+// threads.
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::string generate(size_t matches, size_t matchesPerLine)
+{
+    std::string text;
+    for (size_t i = 0; i < matches; ++i)
+    {
+        text.append("value,");
+        text.append(std::to_string(i % 1000));
+        text.push_back(i % matchesPerLine == matchesPerLine - 1 ? '\n' : ',');
+    }
+    return text;
+}
+
+static std::string contents(const MexTextBuffer& document)
+{
+    std::string text;
+    document.forEachSpan([&](std::string_view span) { text.append(span); });
+    return text;
+}
+
+// The replaceAll this benchmark replaces: one std::string::replace per match, from the back of each line.
+static void replacePerMatch(const std::string& pattern, const std::string& replacement, MexTextBuffer& document)
+{
+    MexSearch search;
+    search.setCaseSensitive(true);
+    search.find(pattern, document);
+    const auto& matches = search.getMatches();
+    for (auto it = matches.rbegin(); it != matches.rend();)
+    {
+        size_t lineNum = it->first;
+        std::string line(document.line(lineNum));
+        for (; it != matches.rend() and it->first == lineNum; ++it)
+        {
+            line.replace(it->second.first, it->second.second - it->second.first, replacement);
+        }
+        document.replaceLine(lineNum, line);
+    }
+}
+
+static bool measure(const char* name, const std::string& text, bool compareToPerMatch, const std::vector<size_t>& threadCounts)
+{
+    const std::string pattern = "value";
+    const std::string replacement = "v";
+    std::printf("%s: %.0f MiB\n", name, static_cast<double>(text.size()) / (1 << 20));
+
+    std::string reference;
+    double serial = 0;
+    if (compareToPerMatch)
+    {
+        MexTextBuffer document;
+        document.assign(text);
+        MexHistory history;
+        document.addListener(&history);
+
+        auto start = Clock::now();
+        history.beginGroup();
+        replacePerMatch(pattern, replacement, document);
+        history.endGroup();
+        serial = seconds(start);
+        reference = contents(document);
+        std::printf("  per match   %10s %10.2f s\n", "", serial);
+    }
+
+    for (size_t threads : threadCounts)
+    {
+        MexTextBuffer document;
+        document.assign(text);
+        MexHistory history;
+        document.addListener(&history);
+        MexSearch search;
+        search.setCaseSensitive(true);
+        search.setThreadCount(threads);
+
+        auto start = Clock::now();
+        history.beginGroup();
+        size_t replaced = search.replaceAll(pattern, replacement, document);
+        history.endGroup();
+        double elapsed = seconds(start);
+
+        std::string result = contents(document);
+        if (reference.empty())
+        {
+            reference = std::move(result);
+            serial = serial > 0 ? serial : elapsed;
+        }
+        else if (result != reference)
+        {
+            std::fprintf(stderr, "%zu threads produced a different document\n", threads);
+            return false;
+        }
+
+        start = Clock::now();
+        MexHistory::Position cursor;
+        history.undo(document, cursor);
+        double undo = seconds(start);
+        if (contents(document) != text)
+        {
+            std::fprintf(stderr, "undoing the replacement with %zu threads did not restore the document\n", threads);
+            return false;
+        }
+
+        std::printf("  %3zu threads %10zu replacements %8.2f s %6.2fx, undo %.2f s\n", threads, replaced, elapsed,
+                    serial / elapsed, undo);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t matches = (argc > 1 ? std::stoul(argv[1]) : 10) * 1000000;
+    size_t maxThreads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    // The previous approach is quadratic in the matches per line, so it is only run on the short lines.
+    bool same = measure("csv, 8 matches per line", generate(matches, 8), true, threadCounts) and
+                measure("minified, 100000 matches per line", generate(matches, 100000), false, threadCounts);
+    return same ? 0 : 1;
+}
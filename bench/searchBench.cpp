@@ -0,0 +1,138 @@
+#include "../include/mexSearch.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures how MexSearch::find scales with the number of search threads, for a plain-text pattern over the
+// whole document and a regex over its first MiBs. Every thread count must find the same matches.
+// Usage: searchBench [file] [sizeInMiB] [maxThreads]. Without a file, or with -, C++-like text is generated
+// (default 512 MiB); maxThreads defaults to the number of hardware threads.
+
+using Clock = std::chrono::steady_clock;
+
+static std::string generate(size_t bytes)
+{
+    static const char* templates[] = {
+        "    for (int index = 0; index < count; ++index)",
+        "    {",
+        "        const auto& value = values[index]; // keep a reference",
+        "        if (value.isValid() and !value.empty()) return compute(value, 42);",
+        "        else continue;",
+        "    }",
+        "template<typename T> class Container : public Base<T>",
+        "    virtual void update(double delta) override final;",
+        "    std::string message = \"while the struct is constant\";",
+        "namespace detail { static char buffer[256]; }",
+    };
+
+    std::mt19937 rng(42);
+    std::string text;
+    text.reserve(bytes + 256);
+    while (text.size() < bytes)
+    {
+        text.append(templates[rng() % std::size(templates)]);
+        text.push_back('\n');
+    }
+    return text;
+}
+
+static double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Case
+{
+    const char* name;
+    std::string pattern;
+    bool regex;
+    const MexTextBuffer* document;
+    size_t bytes;
+};
+
+static bool measure(const Case& test, const std::vector<size_t>& threadCounts)
+{
+    std::printf("%s: \"%s\" over %.0f MiB\n", test.name, test.pattern.c_str(), static_cast<double>(test.bytes) / (1 << 20));
+
+    std::vector<std::pair<size_t, std::pair<size_t, size_t>>> reference;
+    double serial = 0;
+    for (size_t threads : threadCounts)
+    {
+        MexSearch search;
+        search.setRegexMode(test.regex);
+        search.setThreadCount(threads);
+
+        double best = 1e9;
+        for (int run = 0; run < 3; ++run)
+        {
+            auto start = Clock::now();
+            search.find(test.pattern, *test.document);
+            best = std::min(best, seconds(start));
+        }
+
+        if (threads == threadCounts.front())
+        {
+            reference = search.getMatches();
+            serial = best;
+        }
+        else if (search.getMatches() != reference)
+        {
+            std::fprintf(stderr, "%zu threads found different matches\n", threads);
+            return false;
+        }
+
+        std::printf("  %3zu threads %10zu matches %10.1f MB/s %6.2fx\n", threads, search.getMatches().size(),
+                    static_cast<double>(test.bytes) / best / 1e6, serial / best);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t sizeMiB = argc > 2 ? std::stoul(argv[2]) : 512;
+    size_t maxThreads = argc > 3 ? std::stoul(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::string text;
+    if (argc > 1 and std::string(argv[1]) != "-")
+    {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file.is_open())
+        {
+            std::fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        text = std::move(content).str();
+    }
+    else
+    {
+        text = generate(sizeMiB << 20);
+    }
+
+    constexpr size_t regexBytes = 32 << 20;
+    size_t cut = text.size() > regexBytes ? text.find('\n', regexBytes) : text.size();
+    MexTextBuffer document;
+    MexTextBuffer regexDocument;
+    regexDocument.assign(text.substr(0, cut == std::string::npos ? text.size() : cut));
+    size_t regexSize = regexDocument.byteCount();
+    document.assign(std::move(text));
+    size_t size = document.byteCount();
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    bool same = measure({"absent literal", "Container<int>", false, &document, size}, threadCounts) and
+                measure({"common literal", "value", false, &document, size}, threadCounts) and
+                measure({"regex", "[a-z]+\\(\\)", true, &regexDocument, regexSize}, threadCounts);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#ifndef MEXEDIT_MEXBUFFERLIST_H
+#define MEXEDIT_MEXBUFFERLIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include "mexFileWriter.h"
+#include "mexHistory.h"
+#include "mexJournal.h"
+#include "mexTextBuffer.h"
+
+/// @brief MexBufferList keeps the files that are open in the editor besides the one being edited. \class MexBufferList
+///
+/// The editor's own document, history and cursor are the active buffer; switching files moves them into the
+/// list and takes another one out. The text of the inactive buffers is held to a byte budget: when it is
+/// exceeded, the least recently used buffers give up their text. Unmodified ones just drop it and read the
+/// file again when they are switched to; modified ones write it to a swap file in the cache directory first.
+/// Undo histories always stay in memory, within their own limit.
+class MexBufferList
+{
+public:
+
+    /// @brief Where the text of an inactive buffer is. \enum Residence
+    enum class Residence
+    {
+        Memory,  // In text.
+        Evicted, // Only in the file, as it was saved.
+        Swapped  // Only in swapFile.
+    };
+
+    /// @brief An open file that is not being edited, with everything needed to edit it again. \struct Buffer
+    struct Buffer
+    {
+        std::filesystem::path file; // Empty for a document that was never saved.
+        MexTextBuffer text;
+        MexHistory history;
+        MexJournal journal;
+        bool modified = false;
+        uint64_t savedVersion = 0;
+        std::filesystem::file_time_type savedWriteTime;
+        uintmax_t savedFileSize = 0;
+
+        int cursorX = 0;
+        int cursorY = 0;
+        int editorScroll = 0;
+
+        std::string searchPattern; // The last search, empty if there is no current match.
+        size_t matchLine = 0;
+        size_t matchColumn = 0;
+
+        Residence residence = Residence::Memory;
+        std::filesystem::path swapFile;
+        size_t bytes = 0; // The size of the text while it is in memory.
+    };
+
+    /**
+     * @brief Constructs an empty MexBufferList, removing swap files left behind by editors that are gone.
+     */
+    MexBufferList();
+
+    /**
+     * @brief Removes the swap files of the buffers.
+     */
+    ~MexBufferList();
+
+    MexBufferList(const MexBufferList&) = delete;
+    MexBufferList& operator=(const MexBufferList&) = delete;
+
+    /**
+     * @brief Adds a buffer as the most recently used one, then brings the others within the budget.
+     * @param buffer The buffer, with its text in memory.
+     */
+    void add(Buffer buffer);
+
+    /**
+     * @brief Removes a buffer from the list, reading its text back if it was evicted or swapped out. An evicted
+     *        buffer whose file changed meanwhile gets the new content and loses its history.
+     * @param index The position of the buffer in getBuffers().
+     * @return The buffer, or nothing if its text could not be read; an unmodified buffer is removed then.
+     */
+    std::optional<Buffer> take(size_t index);
+
+    /**
+     * @brief Finds the buffer of a file.
+     * @param file The file.
+     * @return The position of the buffer in getBuffers(), or getBuffers().size() if the file is not open.
+     */
+    size_t find(const std::filesystem::path& file) const;
+
+    /**
+     * @brief Writes a modified buffer to its file.
+     * @param index The position of the buffer in getBuffers().
+     * @param policy How much is flushed to stable storage.
+     * @return A boolean indicating whether the file now holds the text of the buffer.
+     */
+    bool save(size_t index, MexFileWriter::SyncPolicy policy);
+
+    /**
+     * @brief Removes the journals of the buffers, whose unsaved edits are being given up.
+     */
+    void discardJournals();
+
+    /**
+     * @brief Gets the inactive buffers, the most recently used first.
+     */
+    const std::vector<Buffer>& getBuffers() const { return buffers; }
+
+    /**
+     * @brief Gets the number of bytes of text the inactive buffers hold in memory.
+     */
+    size_t residentBytes() const;
+
+    /**
+     * @brief Sets how many bytes of text the inactive buffers may hold in memory, and applies it.
+     * @param bytes The budget. 0 keeps only the text of modified buffers that cannot be swapped out.
+     */
+    void setByteBudget(size_t bytes);
+
+    /**
+     * @brief Gets how many bytes of text the inactive buffers may hold in memory.
+     */
+    size_t getByteBudget() const { return byteBudget; }
+
+    /**
+     * @brief Reads a file into a text buffer, mapping it if it is not empty.
+     * @param file The file to read.
+     * @param text Receives the content.
+     * @return A boolean indicating whether the file could be read.
+     */
+    static bool read(const std::filesystem::path& file, MexTextBuffer& text);
+
+    /**
+     * @brief Checks whether two paths name the same file, resolving relative paths and symbolic links.
+     */
+    static bool sameFile(const std::filesystem::path& a, const std::filesystem::path& b);
+
+private:
+    std::vector<Buffer> buffers;
+    size_t byteBudget = 256 * 1024 * 1024;
+    std::filesystem::path swapDirectory;
+    size_t swapFiles = 0; // How many swap files were named so far, to give each a new name.
+
+    /**
+     * @brief Drops or swaps out the text of the least recently used buffers until the rest fit the budget.
+     */
+    void enforceBudget();
+
+    /**
+     * @brief Writes the text of a buffer to a new swap file and drops it.
+     * @param buffer The buffer, with its text in memory.
+     * @return A boolean indicating whether the text was written.
+     */
+    bool swapOut(Buffer& buffer);
+
+    /**
+     * @brief Writes a text to a file, replacing it.
+     * @param file The file.
+     * @param text The text.
+     * @param policy How much is flushed to stable storage.
+     * @return A boolean indicating whether the file now holds the text.
+     */
+    static bool write(const std::filesystem::path& file, const MexTextBuffer& text, MexFileWriter::SyncPolicy policy);
+};
+
+#endif //MEXEDIT_MEXBUFFERLIST_H
@@ -0,0 +1,114 @@
+#ifndef MEXEDIT_MEXDIRECTORYLISTING_H
+#define MEXEDIT_MEXDIRECTORYLISTING_H
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/// @brief MexDirectoryListing lists a directory on a background thread for the file explorer. \class MexDirectoryListing
+///
+/// The type of each entry is taken from the directory listing, or found with one stat() when the listing does
+/// not say or the entry is a symbolic link, and kept with its name. Entries are handed over in sorted batches of
+/// growing size and merged into the sorted list, so a huge directory fills in progressively.
+class MexDirectoryListing
+{
+public:
+
+    /// @brief An entry of the directory. \struct Entry
+    struct Entry
+    {
+        std::string name;
+        bool directory;
+    };
+
+    /**
+     * @brief Constructs an empty MexDirectoryListing.
+     */
+    MexDirectoryListing() = default;
+
+    /**
+     * @brief Stops the listing still running.
+     */
+    ~MexDirectoryListing() = default;
+
+    /**
+     * @brief Starts listing a directory, dropping the entries of the previous one.
+     * @param directory The directory to list.
+     */
+    void start(const std::filesystem::path& directory);
+
+    /**
+     * @brief Merges the entries listed since the last call into the sorted entries.
+     * @return A boolean indicating whether there were new entries.
+     */
+    bool collectEntries();
+
+    /**
+     * @brief Adds an entry that appeared in the directory, or updates its type.
+     * @param name The name of the entry.
+     * @return A boolean indicating whether the entries changed.
+     */
+    bool addEntry(const std::string& name);
+
+    /**
+     * @brief Removes an entry that left the directory.
+     * @param name The name of the entry.
+     * @return A boolean indicating whether the entries changed.
+     */
+    bool removeEntry(const std::string& name);
+
+    /**
+     * @brief Checks whether the directory is still being listed.
+     * @return A boolean indicating whether more entries may arrive.
+     */
+    bool isListing() const;
+
+    /**
+     * @brief Gets the entries adopted by collectEntries(): directories first, then by name.
+     */
+    const std::vector<Entry>& getEntries() const { return entries; }
+
+    /**
+     * @brief Gets the directory being listed.
+     */
+    const std::filesystem::path& getDirectory() const { return directory; }
+
+    /**
+     * @brief Orders entries: directories before files, then by name.
+     * @param a The first entry.
+     * @param b The second entry.
+     * @return A boolean indicating whether a comes before b.
+     */
+    static bool before(const Entry& a, const Entry& b);
+
+private:
+    std::filesystem::path directory;
+    std::vector<Entry> entries;
+    std::atomic<bool> listing{false};
+    std::unordered_set<std::string> removedWhileListing; // Kept out of the batches still to come.
+
+    std::mutex pendingMutex;
+    std::vector<std::vector<Entry>> pending; // Sorted batches.
+
+    std::jthread worker; // Declared last, so it is stopped before the state it uses is destroyed.
+
+    /**
+     * @brief Finds an entry by name, whatever its type.
+     * @param name The name of the entry.
+     * @return The position of the entry, or the end of the entries.
+     */
+    std::vector<Entry>::iterator find(const std::string& name);
+
+    /**
+     * @brief Reads the directory and hands its entries over in batches.
+     * @param path The directory.
+     * @param stop Stops the listing early.
+     */
+    void list(const std::string& path, const std::stop_token& stop);
+};
+
+#endif //MEXEDIT_MEXDIRECTORYLISTING_H
@@ -6,10 +6,19 @@
 #include <string_view>
 #include <filesystem>
 #include <memory>
+#include <functional>
 #include <ncurses.h>
 #include "mexMenu.h"
 #include "mexSyntax.h"
 #include "mexSearch.h"
+#include "mexProjectSearch.h"
+#include "mexFuzzyFinder.h"
+#include "mexDirectoryListing.h"
+#include "mexWatcher.h"
+#include "mexBufferList.h"
+#include "mexTextBuffer.h"
+#include "mexHistory.h"
+#include "mexFileWriter.h"
 
 namespace fs = std::filesystem;
 
@@ -48,12 +57,18 @@ public:
     void run();
 
 private:
-    std::vector<std::string> document;
+    MexTextBuffer document;
     std::vector<std::string> buffer;
     fs::path currentFile;
+    MexFileWriter::SyncPolicy syncPolicy = MexFileWriter::SyncPolicy::File;
+    uint64_t savedVersion = 0;
+    fs::file_time_type savedWriteTime;
+    uintmax_t savedFileSize = 0;
     bool showLineNumbers = true;
 
-    std::vector<fs::directory_entry> fileList;
+    MexDirectoryListing fileList;
+    MexWatcher watcher;
+    std::string diskNotice; // Shown in the status bar when the open file changed on disk.
     fs::path currentDirectory;
     int fileExplorerWidth = 30;
     int selectedFileIdx = 0;
@@ -63,8 +78,15 @@ private:
     int cursorY = 0;
     int editorScroll = 0;
 
-    std::vector<std::vector<std::string>> documentHistory;
-    size_t historyIndex = 0;
+    bool screenValid = false;
+    int screenRows = 0;
+    int screenColumns = 0;
+    std::vector<size_t> explorerRowKeys;
+    std::vector<size_t> editorRowKeys;
+    size_t statusKey = 0;
+
+    MexHistory history;
+    MexJournal journal;
 
     /**
      * @brief Converts a key code to a control character.
@@ -80,15 +102,118 @@ private:
     void expandDocument(size_t newSize);
 
     /**
-     * @brief Updates the file explorer with the current directory contents.
+     * @brief Starts listing the current directory in the file explorer. Entries appear as they are listed.
      */
     void updateFileExplorer();
 
     /**
-     * @brief Draws the user interface of the editor.
+     * @brief Changes the entries of the file explorer, keeping the selected entry selected.
+     * @param change Applies the change and returns whether the entries changed.
+     */
+    void updateExplorerEntries(const std::function<bool()>& change);
+
+    /**
+     * @brief Waits for a key, handling the changes the watcher reports while waiting.
+     * @param timeoutMs How long to wait in milliseconds, or -1 to wait until a key or a change arrives.
+     * @return The key, or ERR if none arrived.
+     */
+    int waitForKey(int timeoutMs);
+
+    /**
+     * @brief Applies the changes the watcher reports: entries are added to or removed from the explorer, and the
+     *        open file is reloaded if it changed on disk and has no unsaved edits, or flagged otherwise.
+     */
+    void handleWatchEvents();
+
+    /**
+     * @brief Reloads the open file if it changed on disk and has no unsaved edits, or flags it in the status bar.
+     */
+    void reloadIfChanged();
+
+    /**
+     * @brief Copies the document into memory of its own if the file it maps was rewritten in place, so it stops
+     *        changing under the editor. The history and highlighting, which knew the old text, start over.
+     */
+    void detachFromChangedFile();
+
+    /**
+     * @brief Asks whether to replay the edits a journal recovered, and applies them as one undo step.
+     * @param recovery The journal left next to the file that was just loaded.
+     */
+    void offerRecovery(const MexJournal::Recovery& recovery);
+
+    /**
+     * @brief Moves the document being edited, with its history, cursor and search, into the buffer list. An empty
+     *        document without a file is dropped instead.
+     */
+    void parkBuffer();
+
+    /**
+     * @brief Starts an empty document without a file, keeping the current one in the buffer list.
+     */
+    void newDocument();
+
+    /**
+     * @brief Makes a buffer of the list the one being edited, moving the current one into the list.
+     * @param index The position of the buffer in the list.
+     * @return A boolean indicating whether the buffer could be read back.
+     */
+    bool switchToBuffer(size_t index);
+
+    /**
+     * @brief Checks whether the open file on disk still has the size and modification time it was loaded or saved with.
+     * @return A boolean indicating whether the file on disk is unchanged.
+     */
+    bool diskUnchanged() const;
+
+    /**
+     * @brief Opens the entry selected in the file explorer: a directory is listed, a file is loaded.
+     */
+    void openSelectedEntry();
+
+    /**
+     * @brief Draws the user interface of the editor. Only rows whose content changed since the last frame are repainted.
      */
     void drawInterface();
 
+    /**
+     * @brief Draws the lines of the document in view, with line numbers, syntax highlighting and search matches.
+     * @param editorStart The first column of the editor area.
+     * @param editorWidth The width of the editor area.
+     * @param maxY The height of the screen.
+     * @return The number of document lines drawn.
+     */
+    int drawDocument(int editorStart, int editorWidth, int maxY);
+
+    /**
+     * @brief Draws the project search results in the editor area, one match per row.
+     * @param editorStart The first column of the editor area.
+     * @param editorWidth The width of the editor area.
+     * @param rows The number of rows above the status bar.
+     */
+    void drawResults(int editorStart, int editorWidth, int rows);
+
+    /**
+     * @brief Draws the open file palette in the editor area: the query, then the best matching paths.
+     * @param editorStart The first column of the editor area.
+     * @param editorWidth The width of the editor area.
+     * @param rows The number of rows above the status bar.
+     */
+    void drawFinder(int editorStart, int editorWidth, int rows);
+
+    /**
+     * @brief Draws the list of the other open files in the editor area, the most recently used first.
+     * @param editorStart The first column of the editor area.
+     * @param editorWidth The width of the editor area.
+     * @param rows The number of rows above the status bar.
+     */
+    void drawBuffers(int editorStart, int editorWidth, int rows);
+
+    /**
+     * @brief Forces the next drawInterface() to repaint the whole screen, e.g. after a menu or prompt drew over it.
+     */
+    void invalidateScreen();
+
     /**
      * @brief Handles user input and updates the editor state accordingly.
      * @param ch The character input from the user.
@@ -124,9 +249,10 @@ private:
     void deleteLine();
 
     /**
-     * @brief Saves the current state of the document to the history for undo/redo functionality.
+     * @brief Starts a new undo step. The edits that follow are undone together.
+     * @param kind The kind of edit that follows. Consecutive typing or deleting shares one step.
      */
-    void saveState();
+    void saveState(MexHistory::StepKind kind = MexHistory::StepKind::Other);
 
     /**
      * @brief Undoes the last action in the document.
@@ -148,7 +274,12 @@ private:
      * @brief Diplays the current search status in the editor.
      * @param message The message to display in the search status bar.
      */
-    static void showSearchStatus(const std::string& message);
+    void showSearchStatus(const std::string& message);
+
+    /**
+     * @brief Moves the cursor to the first match at or after where the search started, or back there if nothing matched.
+     */
+    void showIncrementalMatch();
 
     /**
      * @brief Performs a replace operation in the document.
@@ -157,17 +288,82 @@ private:
      */
     void performReplace(const std::string& replacement, bool all);
 
+    /**
+     * @brief Starts searching the files below the explorer's directory and shows the results panel.
+     * @param pattern The search pattern, with the settings of the buffer search.
+     */
+    void startProjectSearch(const std::string& pattern);
+
+    /**
+     * @brief Handles a key while the results panel is shown: arrows and page keys select, Enter opens, ESC closes.
+     * @param ch The character input from the user.
+     */
+    void handleResultsInput(int ch);
+
+    /**
+     * @brief Opens the file of the selected result with the cursor on its match, and closes the results panel.
+     */
+    void openSelectedResult();
+
+    /**
+     * @brief Opens the open file palette and starts collecting the files below the explorer's directory.
+     */
+    void startFinder();
+
+    /**
+     * @brief Handles a key while the open file palette is shown: typing narrows the paths, arrows select,
+     *        Enter opens, ESC closes.
+     * @param ch The character input from the user.
+     */
+    void handleFinderInput(int ch);
+
+    /**
+     * @brief Handles a key while the buffer list is shown: arrows select, Enter switches to the file, ESC closes.
+     * @param ch The character input from the user.
+     */
+    void handleBuffersInput(int ch);
+
     /**
      * @brief Starts the command mode for executing commands.
      */
     void startCommandMode();
 
+    /**
+     * @brief Remembers that the document now matches currentFile on disk, so unchanged saves can be skipped.
+     */
+    void markSaved();
+
+    /**
+     * @brief Checks whether saving the document to currentFile would leave the file unchanged.
+     * @return A boolean indicating whether the document and the file on disk are known to match.
+     */
+    bool matchesDisk() const;
+
     MexMenu menu;
     MexSyntax syntaxHighlighter;
 
     MexSearch searchEngine;
     bool searchMode = false;
     std::string searchString;
+    int searchOriginX = 0;
+    int searchOriginY = 0;
+    int searchOriginScroll = 0;
+
+    MexProjectSearch projectSearch;
+    bool resultsMode = false;
+    int selectedResult = 0;
+    int resultsScroll = 0;
+
+    MexFuzzyFinder fileFinder;
+    bool finderMode = false;
+    std::string finderQuery;
+    int selectedMatch = 0;
+    int matchesScroll = 0;
+
+    MexBufferList buffers;
+    bool buffersMode = false;
+    int selectedBuffer = 0;
+    int buffersScroll = 0;
 };
 
 #endif //MEXEDIT_MEXEDIT_H
@@ -0,0 +1,95 @@
+#ifndef MEXEDIT_MEXFILEWRITER_H
+#define MEXEDIT_MEXFILEWRITER_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+
+/// @brief MexFileWriter replaces a file atomically: output goes to a temporary file that is renamed over the target on commit. \class MexFileWriter
+///
+/// Small writes are copied into a staging buffer, large ones are referenced directly, and both are handed
+/// to the kernel with writev in large batches.
+class MexFileWriter
+{
+public:
+
+    /**
+     * @brief Enum describing how much is flushed to stable storage before commit() returns. \enum SyncPolicy
+     */
+    enum class SyncPolicy
+    {
+        None,
+        File,
+        FileAndDirectory
+    };
+
+    /**
+     * @brief Constructs a MexFileWriter.
+     * @param policy The flushing policy applied by commit().
+     */
+    explicit MexFileWriter(SyncPolicy policy = SyncPolicy::File);
+
+    /**
+     * @brief Destructor for MexFileWriter, discards the temporary file if commit() did not succeed.
+     */
+    ~MexFileWriter();
+
+    MexFileWriter(const MexFileWriter&) = delete;
+    MexFileWriter& operator=(const MexFileWriter&) = delete;
+
+    /**
+     * @brief Creates the temporary file next to the target. Symlinks are followed so the link itself is kept.
+     * @param target The file to replace.
+     * @return A boolean indicating whether the temporary file was created.
+     */
+    bool open(const std::filesystem::path& target);
+
+    /**
+     * @brief Queues bytes for writing.
+     * @param bytes The bytes to write. Spans larger than the staging threshold must stay valid until commit().
+     * @return A boolean indicating whether all writes so far succeeded.
+     */
+    bool write(std::string_view bytes);
+
+    /**
+     * @brief Writes everything queued, applies the sync policy and renames the temporary file over the target.
+     * @return A boolean indicating whether the target now holds the written content.
+     */
+    bool commit();
+
+    /**
+     * @brief Discards the temporary file.
+     */
+    void abort();
+
+private:
+    static constexpr size_t stagingSize = 1024 * 1024;
+    static constexpr size_t directThreshold = 64 * 1024;
+
+    SyncPolicy policy;
+    int fd = -1;
+    bool failed = false;
+    std::filesystem::path target;
+    std::filesystem::path tempPath;
+
+    std::unique_ptr<char[]> staging;
+    size_t stagedBegin = 0;
+    size_t stagedEnd = 0;
+    std::vector<iovec> pending;
+
+    /**
+     * @brief Adds the staged bytes that are not yet queued as an iovec.
+     */
+    void queueStaged();
+
+    /**
+     * @brief Writes every queued iovec and resets the staging buffer.
+     * @return A boolean indicating whether the write succeeded.
+     */
+    bool flush();
+};
+
+#endif //MEXEDIT_MEXFILEWRITER_H
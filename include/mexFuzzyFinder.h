@@ -0,0 +1,171 @@
+#ifndef MEXEDIT_MEXFUZZYFINDER_H
+#define MEXEDIT_MEXFUZZYFINDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "mexProjectSearch.h"
+
+/// @brief MexFuzzyFinder finds files below a directory by a fuzzy query, for the open file palette. \class MexFuzzyFinder
+///
+/// Background threads walk the tree together, with the same rules as the project search, and hand the paths
+/// over as they find them. A path matches when it contains the letters of the query in order, ignoring case.
+/// Each path keeps a 64-bit mask of the bytes it contains, so most paths are rejected with one AND; the others
+/// are searched for the letters 16 or 32 bytes at a time where the CPU allows, and scored, favouring matches
+/// that are consecutive, start a word or lie in the file name, and shorter paths. Only the best maxResults
+/// matches are kept, in a heap, and sorted. A query that extends the previous one only looks at the paths that
+/// matched before, from where their match ended. With enough candidates, the scoring is split between threads.
+class MexFuzzyFinder
+{
+public:
+
+    /// @brief A path that matches the query. \struct Match
+    struct Match
+    {
+        uint32_t path;
+        int score;
+    };
+
+    /**
+     * @brief Constructs an empty MexFuzzyFinder.
+     */
+    MexFuzzyFinder() = default;
+
+    /**
+     * @brief Stops the walk still running.
+     */
+    ~MexFuzzyFinder() = default;
+
+    /**
+     * @brief Starts collecting the files below a directory, dropping the paths of the previous one.
+     * @param root The directory.
+     */
+    void start(const std::filesystem::path& root);
+
+    /**
+     * @brief Adopts the paths found since the last call and matches them against the query.
+     * @return A boolean indicating whether there were new paths.
+     */
+    bool collectPaths();
+
+    /**
+     * @brief Checks whether the tree is still being walked.
+     * @return A boolean indicating whether more paths may arrive.
+     */
+    bool isIndexing() const;
+
+    /**
+     * @brief Sets the query and finds the best matches.
+     * @param query The letters to look for, in order.
+     */
+    void setQuery(const std::string& query);
+
+    /**
+     * @brief Gets the best matches of the query, best first. An empty query matches every path.
+     */
+    const std::vector<Match>& getResults() const { return results; }
+
+    /**
+     * @brief Gets the number of paths that match the query, including those beyond maxResults.
+     */
+    size_t matchCount() const { return matched.size(); }
+
+    /**
+     * @brief Gets the number of paths collected.
+     */
+    size_t pathCount() const { return offsets.size(); }
+
+    /**
+     * @brief Gets a path, relative to the root.
+     * @param index The number of the path.
+     */
+    std::string_view path(uint32_t index) const;
+
+    /**
+     * @brief Finds which bytes of a path the query matched, for highlighting.
+     * @param index The number of the path.
+     * @return The positions of the matched bytes, in ascending order.
+     */
+    std::vector<size_t> matchPositions(uint32_t index) const;
+
+    /**
+     * @brief Gets the directory being searched.
+     */
+    const std::filesystem::path& getRoot() const { return root; }
+
+    /**
+     * @brief Sets how many threads walk the tree and score paths.
+     * @param threads The number of threads, or 0 to use one per hardware thread.
+     */
+    void setThreadCount(size_t threads) { threadCount = threads; }
+
+    static constexpr size_t maxResults = 256;
+
+private:
+    std::filesystem::path root;
+    std::string prefix; // The root, ending in '/'.
+    size_t threadCount = 0;
+
+    // The paths, one after the other, as found and folded to lower case, with where each starts, the bytes it
+    // contains and where its file name starts.
+    std::string names;
+    std::string folded;
+    std::vector<uint32_t> offsets;
+    std::vector<uint64_t> masks;
+    std::vector<uint32_t> nameStarts;
+
+    std::string query;
+    std::string matchedQuery; // The query matched holds the paths that match, up to scanned.
+    std::vector<uint32_t> matched;
+    std::vector<uint32_t> matchEnds; // Where the first match of each in matched ends.
+    size_t scanned = 0;
+    std::vector<Match> results;
+
+    std::mutex taskMutex;
+    std::condition_variable_any taskReady;
+    std::vector<MexProjectSearch::Entry> tasks;
+    size_t busy = 0;
+    std::atomic<size_t> running{0};
+
+    std::mutex pendingMutex;
+    std::vector<std::string> pending;
+
+    std::vector<std::jthread> workers; // Declared last, so they are stopped before the state they use is destroyed.
+
+    /**
+     * @brief Lists directories until none are left and no other thread can add more, or the walk is stopped.
+     * @param stop Stops the thread early.
+     */
+    void walk(const std::stop_token& stop);
+
+    /**
+     * @brief Finds letters in a path, in order, ignoring case.
+     * @param index The number of the path.
+     * @param from Where to start looking.
+     * @param letters The folded letters.
+     * @return The position after the last letter found, or std::string::npos if one is missing.
+     */
+    size_t matchFrom(uint32_t index, size_t from, std::string_view letters) const;
+
+    /**
+     * @brief Scores a path that matches the query.
+     * @param index The number of the path.
+     * @param end Where the first match of the query ends, as found by matchFrom().
+     * @param positions If not null, receives the positions of the matched bytes.
+     * @return The score.
+     */
+    int score(uint32_t index, size_t end, std::vector<size_t>* positions) const;
+
+    /**
+     * @brief Brings the matches up to date with the query and the paths collected, and picks the best.
+     */
+    void update();
+};
+
+#endif //MEXEDIT_MEXFUZZYFINDER_H
@@ -0,0 +1,170 @@
+#ifndef MEXEDIT_MEXHISTORY_H
+#define MEXEDIT_MEXHISTORY_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mexTextBuffer.h"
+
+/// @brief MexHistory is the undo/redo log of the editor. It records every buffer edit as the text it removed and inserted. \class MexHistory
+///
+/// Edits are grouped into steps that are undone as a unit. Bursts of typing or deleting share a step, and
+/// explicit groups (paste, replace all) collect everything recorded inside them. The log is limited by the
+/// bytes it holds; the oldest steps are evicted first.
+class MexHistory : public MexTextBuffer::Listener
+{
+public:
+
+    /**
+     * @brief Enum describing the kind of edit a step starts with, used to merge bursts of similar edits. \enum StepKind
+     */
+    enum class StepKind
+    {
+        Other,
+        Typing,
+        Deleting
+    };
+
+    /**
+     * @brief Struct representing a position in the document that undo/redo moves the cursor to. \struct Position
+     */
+    struct Position
+    {
+        size_t line = 0;
+        size_t column = 0;
+    };
+
+    /**
+     * @brief Constructs an empty MexHistory.
+     */
+    MexHistory();
+
+    /**
+     * @brief Marks the start of a new undo step. Edits recorded until the next checkpoint are undone together.
+     * @param kind The kind of edit that follows. A Typing or Deleting checkpoint continues the open step of the same kind if it is recent.
+     */
+    void checkpoint(StepKind kind = StepKind::Other);
+
+    /**
+     * @brief Opens a group. Until the matching endGroup(), checkpoints are ignored so every edit lands in one step. Groups nest.
+     */
+    void beginGroup();
+
+    /**
+     * @brief Closes a group opened by beginGroup(). The next edit starts a new step.
+     */
+    void endGroup();
+
+    /**
+     * @brief Sets the number of bytes of edit text the history may hold before the oldest steps are evicted.
+     * @param bytes The byte budget. The most recent step is always kept.
+     */
+    void setByteLimit(size_t bytes);
+
+    /**
+     * @brief Gets the number of bytes currently held by the history.
+     * @return The byte count.
+     */
+    size_t byteSize() const { return totalBytes; }
+
+    /**
+     * @brief Undoes the most recent step.
+     * @param document The document to apply the inverse edits to.
+     * @param cursor Receives the position of the undone change.
+     * @return A boolean indicating whether there was a step to undo.
+     */
+    bool undo(MexTextBuffer& document, Position& cursor);
+
+    /**
+     * @brief Redoes the most recently undone step.
+     * @param document The document to apply the edits to.
+     * @param cursor Receives the end position of the redone change.
+     * @return A boolean indicating whether there was a step to redo.
+     */
+    bool redo(MexTextBuffer& document, Position& cursor);
+
+    /**
+     * @brief Drops all recorded steps.
+     */
+    void clear();
+
+    /**
+     * @brief Exchanges the recorded steps with another history, e.g. when the editor switches documents. Open
+     *        groups and the byte limit stay with each history, and the next edit of either starts a new step.
+     * @param other The history to exchange steps with.
+     */
+    void swap(MexHistory& other);
+
+    /**
+     * @brief Records an edit reported by the document.
+     */
+    void onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted) override;
+
+private:
+    /**
+     * @brief Struct representing a single edit: at a position, removed was replaced by inserted. \struct Operation
+     */
+    struct Operation
+    {
+        Position start;
+        std::string removed;
+        std::string inserted;
+    };
+
+    /**
+     * @brief Struct representing an undo step: the operations undone together and the bytes they hold. \struct Step
+     */
+    struct Step
+    {
+        std::vector<Operation> operations;
+        size_t bytes = 0;
+    };
+
+    static constexpr std::chrono::milliseconds groupTimeout{1000};
+
+    std::deque<Step> steps;
+    size_t stepIndex = 0;
+    bool stepPending = true;
+    bool replaying = false;
+    int groupDepth = 0;
+    StepKind stepKind = StepKind::Other;
+    std::chrono::steady_clock::time_point lastEdit;
+    size_t totalBytes = 0;
+    size_t byteLimit = 64 * 1024 * 1024;
+
+    /**
+     * @brief Tries to fold an edit into the last operation of the open step, e.g. a typed character following the previous one.
+     * @param start The position of the edit.
+     * @param removed The text the edit removed.
+     * @param inserted The text the edit inserted.
+     * @return A boolean indicating whether the edit was merged.
+     */
+    bool coalesce(const Position& start, std::string_view removed, std::string_view inserted);
+
+    /**
+     * @brief Evicts the oldest steps until the history fits its byte budget.
+     */
+    void enforceLimit();
+
+    /**
+     * @brief Computes the position reached after writing text starting at a position.
+     * @param start The position the text starts at.
+     * @param text The text.
+     * @return The position just after the text.
+     */
+    static Position endOf(const Position& start, std::string_view text);
+
+    /**
+     * @brief Replaces one side of an operation with the other in the document.
+     * @param document The document to edit.
+     * @param start The position of the operation.
+     * @param current The text currently in the document at start.
+     * @param replacement The text to put in its place.
+     */
+    void apply(MexTextBuffer& document, const Position& start, std::string_view current, std::string_view replacement);
+};
+
+#endif //MEXEDIT_MEXHISTORY_H
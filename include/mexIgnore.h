@@ -0,0 +1,76 @@
+#ifndef MEXEDIT_MEXIGNORE_H
+#define MEXEDIT_MEXIGNORE_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief MexIgnoreRules holds the patterns of one .gitignore file on top of the rules of the directories above it. \class MexIgnoreRules
+///
+/// Patterns follow gitignore: '*', '?' and '[...]' match within a path component, "**" across components,
+/// a trailing '/' only matches directories, a '/' elsewhere anchors the pattern to the directory of the
+/// file, and '!' re-includes what an earlier pattern excluded. Deeper files take precedence over the ones
+/// above them, and later patterns over earlier ones.
+class MexIgnoreRules
+{
+public:
+
+    /**
+     * @brief Parses the text of an ignore file.
+     * @param directory The directory the patterns are relative to.
+     * @param text The contents of the file.
+     * @param parent The rules of the directories above, or null.
+     */
+    MexIgnoreRules(const std::filesystem::path& directory, std::string_view text, std::shared_ptr<const MexIgnoreRules> parent);
+
+    /**
+     * @brief Adds the .gitignore of a directory, if it has one, to the rules that apply above it.
+     * @param directory The directory.
+     * @param parent The rules that apply to the directory itself, or null.
+     * @return The rules that apply inside the directory; parent when it has no .gitignore.
+     */
+    static std::shared_ptr<const MexIgnoreRules> load(const std::filesystem::path& directory,
+                                                      std::shared_ptr<const MexIgnoreRules> parent);
+
+    /**
+     * @brief Loads the rules that apply to a directory from above it: .git/info/exclude and every .gitignore from
+     *        the top of its git work tree down to its parent.
+     * @param directory The directory, as an absolute and normalized path.
+     * @return The rules, or null if the directory is not inside a work tree or nothing above it is ignored.
+     */
+    static std::shared_ptr<const MexIgnoreRules> forParentsOf(const std::filesystem::path& directory);
+
+    /**
+     * @brief Checks whether a path is ignored. Its parent directories are assumed not to be.
+     * @param path The full path, starting with the directory of the outermost rules.
+     * @param directory A boolean indicating whether the path is a directory.
+     * @return A boolean indicating whether the path is ignored.
+     */
+    bool isIgnored(std::string_view path, bool directory) const;
+
+private:
+    /// @brief A single pattern line. \struct Rule
+    struct Rule
+    {
+        std::string pattern;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false; // Matched against the path from the directory instead of the file name.
+    };
+
+    std::string base; // The directory, ending in '/'.
+    std::vector<Rule> rules;
+    std::shared_ptr<const MexIgnoreRules> parent;
+
+    /**
+     * @brief Matches a gitignore glob against a path.
+     * @param pattern The glob.
+     * @param text The path or file name.
+     * @return A boolean indicating whether the whole text matches.
+     */
+    static bool matchGlob(std::string_view pattern, std::string_view text);
+};
+
+#endif //MEXEDIT_MEXIGNORE_H
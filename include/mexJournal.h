@@ -0,0 +1,141 @@
+#ifndef MEXEDIT_MEXJOURNAL_H
+#define MEXEDIT_MEXJOURNAL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mexTextBuffer.h"
+
+/// @brief MexJournal appends the edits made to a document to a file next to it, so they survive a crash. \class MexJournal
+///
+/// Each edit is recorded as its position, the shape of the text it removed and the text it inserted, which
+/// costs a few bytes per keystroke. Records are collected in memory and appended as one checksummed frame
+/// when a second has passed since the first of them, or when enough have piled up; a torn frame at the end
+/// is ignored on recovery. The journal starts over whenever the document matches the file on disk, and is
+/// only created by the first edit after that. Its header names the version of the file the edits apply to.
+class MexJournal : public MexTextBuffer::Listener
+{
+public:
+
+    /// @brief An edit read back from a journal: the range it replaced and the text it inserted. \struct Edit
+    struct Edit
+    {
+        size_t line = 0;
+        size_t column = 0;
+        size_t endLine = 0;
+        size_t endColumn = 0;
+        std::string text;
+    };
+
+    /// @brief What a journal left behind holds. \struct Recovery
+    struct Recovery
+    {
+        bool found = false;       // A journal exists for the file.
+        bool matchesFile = false; // It was written for the file as it is on disk now.
+        std::vector<Edit> edits;  // The edits of every complete frame, in order.
+    };
+
+    /**
+     * @brief Constructs a MexJournal that records nothing until start() is called.
+     */
+    MexJournal() = default;
+
+    /**
+     * @brief Appends the pending records. The journal file is kept, since it holds unsaved edits.
+     */
+    ~MexJournal() override;
+
+    MexJournal(const MexJournal&) = delete;
+    MexJournal& operator=(const MexJournal&) = delete;
+    MexJournal(MexJournal&& other) noexcept;
+    MexJournal& operator=(MexJournal&& other) noexcept;
+
+    /**
+     * @brief Starts over for a document that matches a file on disk: the previous journal file, and any journal
+     *        already next to the file, are removed.
+     * @param file The file, or an empty path to record nothing.
+     */
+    void start(const std::filesystem::path& file);
+
+    /**
+     * @brief Removes the journal file and records nothing more, e.g. when edits are discarded on purpose.
+     */
+    void discard();
+
+    /**
+     * @brief Appends the pending records and records nothing more, keeping the journal file.
+     */
+    void detach();
+
+    /**
+     * @brief Appends the pending records to the journal file, creating it if needed.
+     */
+    void flush();
+
+    /**
+     * @brief Appends the pending records if the oldest has waited long enough.
+     */
+    void flushIfDue();
+
+    /**
+     * @brief Gets how long until the pending records are due to be appended.
+     * @return The time in milliseconds, or -1 if nothing is pending.
+     */
+    int flushDelay() const;
+
+    /**
+     * @brief Exchanges the journals of two documents, e.g. when the editor switches files.
+     * @param other The journal to exchange with.
+     */
+    void swap(MexJournal& other) noexcept;
+
+    /**
+     * @brief Records an edit reported by the document.
+     */
+    void onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted) override;
+
+    /**
+     * @brief Reads the journal a previous session left next to a file.
+     * @param file The file.
+     * @return The edits found, and whether they apply to the file as it is on disk.
+     */
+    static Recovery recover(const std::filesystem::path& file);
+
+    /**
+     * @brief Applies recovered edits to a document, stopping at the first that does not fit it.
+     * @param edits The edits, in order.
+     * @param document The document, holding the file the edits were made to.
+     * @return The number of edits applied.
+     */
+    static size_t replay(const std::vector<Edit>& edits, MexTextBuffer& document);
+
+    /**
+     * @brief Gets where the journal of a file is kept: a hidden file next to it.
+     * @param file The file.
+     * @return The path of the journal.
+     */
+    static std::filesystem::path journalPath(const std::filesystem::path& file);
+
+private:
+    static constexpr std::chrono::milliseconds flushInterval{1000};
+    static constexpr size_t flushBytes = 64 * 1024;
+
+    std::filesystem::path file;
+    std::filesystem::path path;
+    int64_t baseWriteTime = 0; // The version of the file the edits apply to, as of start().
+    uint64_t baseSize = 0;
+    int fd = -1;
+    std::string pending;
+    std::chrono::steady_clock::time_point firstPending;
+
+    /**
+     * @brief Closes the journal file, if it is open.
+     */
+    void close();
+};
+
+#endif //MEXEDIT_MEXJOURNAL_H
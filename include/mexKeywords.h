@@ -0,0 +1,199 @@
+#ifndef MEXEDIT_MEXKEYWORDS_H
+#define MEXEDIT_MEXKEYWORDS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// @brief MexKeyword pairs a keyword with the color pair it is highlighted with. \struct MexKeyword
+struct MexKeyword
+{
+    std::string_view word;
+    int colorPair = -1;
+};
+
+/// @brief MexKeywordSet is a non-owning view of a perfect-hash keyword table built at compile time. \class MexKeywordSet
+///
+/// Every keyword hashes to its own slot, so a lookup is one hash of the identifier and one comparison.
+class MexKeywordSet
+{
+public:
+
+    /**
+     * @brief Constructs an empty set that contains no keyword.
+     */
+    constexpr MexKeywordSet() = default;
+
+    /**
+     * @brief Constructs a view of a table.
+     * @param slots The table slots, a power of two of them.
+     * @param mask The number of slots minus one.
+     * @param seed The seed that makes the hash collision free for the table.
+     */
+    constexpr MexKeywordSet(const MexKeyword* slots, uint32_t mask, uint32_t seed)
+        : slots(slots), mask(mask), seed(seed)
+    {
+
+    }
+
+    /**
+     * @brief Hashes a word (FNV-1a with a seed).
+     * @param word The word to hash.
+     * @param seed The seed of the table.
+     * @return The hash.
+     */
+    static constexpr uint32_t hash(std::string_view word, uint32_t seed)
+    {
+        uint32_t value = 2166136261u ^ seed;
+        for (char c : word)
+        {
+            value = (value ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return value ^ (value >> 15);
+    }
+
+    /**
+     * @brief Looks up a word.
+     * @param word The identifier to classify.
+     * @return The color pair of the keyword, or -1 if the word is not a keyword.
+     */
+    constexpr int find(std::string_view word) const
+    {
+        if (slots == nullptr)
+        {
+            return -1;
+        }
+
+        const MexKeyword& slot = slots[hash(word, seed) & mask];
+        return slot.word == word ? slot.colorPair : -1;
+    }
+
+private:
+    const MexKeyword* slots = nullptr;
+    uint32_t mask = 0;
+    uint32_t seed = 0;
+};
+
+/// @brief MexKeywordTable holds the slots of a perfect-hash keyword table. \struct MexKeywordTable
+template<size_t Size>
+struct MexKeywordTable
+{
+    std::array<MexKeyword, Size> slots{};
+    uint32_t seed = 0;
+
+    /**
+     * @brief Gets a view of the table. The table must outlive it.
+     * @return The view.
+     */
+    constexpr MexKeywordSet view() const
+    {
+        return {slots.data(), static_cast<uint32_t>(Size - 1), seed};
+    }
+};
+
+/**
+ * @brief Gets the number of slots used for a number of keywords: the next power of two of four times the count.
+ * @param count The number of keywords.
+ * @return The number of slots.
+ */
+constexpr size_t keywordTableSize(size_t count)
+{
+    size_t size = 1;
+    while (size < count * 4)
+    {
+        size *= 2;
+    }
+    return size;
+}
+
+/**
+ * @brief Builds a perfect-hash table by trying seeds until every keyword lands in its own slot.
+ * @param keywords The keywords, without duplicates.
+ * @return The table.
+ */
+template<size_t Count>
+consteval MexKeywordTable<keywordTableSize(Count)> makeKeywordTable(const std::array<MexKeyword, Count>& keywords)
+{
+    constexpr size_t size = keywordTableSize(Count);
+    for (uint32_t seed = 0; seed < 65536; ++seed)
+    {
+        MexKeywordTable<size> table;
+        table.seed = seed;
+
+        bool collision = false;
+        for (const MexKeyword& keyword : keywords)
+        {
+            MexKeyword& slot = table.slots[MexKeywordSet::hash(keyword.word, seed) & (size - 1)];
+            if (!slot.word.empty())
+            {
+                collision = true;
+                break;
+            }
+            slot = keyword;
+        }
+
+        if (!collision)
+        {
+            return table;
+        }
+    }
+
+    throw "no collision free seed for the keyword table";
+}
+
+inline constexpr std::array cppKeywords{
+    MexKeyword{"int", 10}, MexKeyword{"float", 10}, MexKeyword{"double", 10}, MexKeyword{"char", 10},
+    MexKeyword{"void", 10}, MexKeyword{"bool", 10}, MexKeyword{"auto", 10}, MexKeyword{"const", 10},
+
+    MexKeyword{"if", 11}, MexKeyword{"else", 11}, MexKeyword{"for", 11}, MexKeyword{"while", 11},
+    MexKeyword{"do", 11}, MexKeyword{"switch", 11}, MexKeyword{"case", 11}, MexKeyword{"default", 11},
+    MexKeyword{"break", 11}, MexKeyword{"continue", 11}, MexKeyword{"return", 11}, MexKeyword{"goto", 11},
+
+    MexKeyword{"class", 12}, MexKeyword{"struct", 12}, MexKeyword{"namespace", 12}, MexKeyword{"template", 12},
+    MexKeyword{"typename", 12},
+    MexKeyword{"public", 13}, MexKeyword{"private", 13}, MexKeyword{"protected", 13}, MexKeyword{"virtual", 13},
+    MexKeyword{"override", 13}, MexKeyword{"final", 13}
+};
+
+inline constexpr std::array cKeywords{
+    MexKeyword{"int", 10}, MexKeyword{"float", 10}, MexKeyword{"double", 10}, MexKeyword{"char", 10},
+    MexKeyword{"void", 10}, MexKeyword{"short", 10}, MexKeyword{"long", 10}, MexKeyword{"signed", 10},
+    MexKeyword{"unsigned", 10}, MexKeyword{"const", 10}, MexKeyword{"volatile", 10},
+
+    MexKeyword{"if", 11}, MexKeyword{"else", 11}, MexKeyword{"for", 11}, MexKeyword{"while", 11},
+    MexKeyword{"do", 11}, MexKeyword{"switch", 11}, MexKeyword{"case", 11}, MexKeyword{"default", 11},
+    MexKeyword{"break", 11}, MexKeyword{"continue", 11}, MexKeyword{"return", 11}, MexKeyword{"goto", 11},
+
+    MexKeyword{"struct", 12}, MexKeyword{"union", 12}, MexKeyword{"enum", 12}, MexKeyword{"typedef", 12}
+};
+
+inline constexpr std::array pythonKeywords{
+    MexKeyword{"def", 10}, MexKeyword{"class", 10}, MexKeyword{"lambda", 10},
+
+    MexKeyword{"if", 11}, MexKeyword{"elif", 11}, MexKeyword{"else", 11}, MexKeyword{"for", 11},
+    MexKeyword{"while", 11}, MexKeyword{"try", 11}, MexKeyword{"except", 11}, MexKeyword{"finally", 11},
+    MexKeyword{"with", 11}, MexKeyword{"return", 11}, MexKeyword{"yield", 11}, MexKeyword{"import", 11},
+    MexKeyword{"from", 11}, MexKeyword{"as", 11}, MexKeyword{"pass", 11}, MexKeyword{"break", 11},
+    MexKeyword{"continue", 11}, MexKeyword{"raise", 11}, MexKeyword{"and", 11}, MexKeyword{"or", 11},
+    MexKeyword{"not", 11}, MexKeyword{"is", 11}, MexKeyword{"in", 11},
+
+    MexKeyword{"None", 12}, MexKeyword{"True", 12}, MexKeyword{"False", 12}
+};
+
+inline constexpr std::array shellKeywords{
+    MexKeyword{"if", 10}, MexKeyword{"then", 10}, MexKeyword{"else", 10}, MexKeyword{"elif", 10},
+    MexKeyword{"fi", 10},
+
+    MexKeyword{"for", 11}, MexKeyword{"while", 11}, MexKeyword{"do", 11}, MexKeyword{"done", 11},
+    MexKeyword{"case", 11}, MexKeyword{"esac", 11},
+
+    MexKeyword{"function", 12}, MexKeyword{"return", 12}
+};
+
+inline constexpr auto cppKeywordTable = makeKeywordTable(cppKeywords);
+inline constexpr auto cKeywordTable = makeKeywordTable(cKeywords);
+inline constexpr auto pythonKeywordTable = makeKeywordTable(pythonKeywords);
+inline constexpr auto shellKeywordTable = makeKeywordTable(shellKeywords);
+
+#endif //MEXEDIT_MEXKEYWORDS_H
@@ -0,0 +1,147 @@
+#ifndef MEXEDIT_MEXLEXER_H
+#define MEXEDIT_MEXLEXER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mexKeywords.h"
+
+/// @brief MexLexer is a table-driven single-pass lexer that splits a line into highlighted token spans. \class MexLexer
+///
+/// Every rule is indexed by the first byte of its opening delimiter, so each position of a line only
+/// tries the few rules that can start there. The cost of a line is linear in its length, whatever the
+/// number of rules.
+///
+/// Comments and strings that may span lines leave the lexer in a non-zero state at the end of a line,
+/// which is passed in again when the next line is scanned.
+class MexLexer
+{
+public:
+
+    /**
+     * @brief Struct representing a highlighted span of a line. \struct Token
+     */
+    struct Token
+    {
+        int start;
+        int length;
+        int colorPair;
+    };
+
+    /**
+     * @brief The state between two lines: 0 outside any span, otherwise one more than the index of the rule left open.
+     */
+    using State = uint16_t;
+
+    /**
+     * @brief Enum describing how a rule matches. \enum Kind
+     */
+    enum class Kind
+    {
+        Identifier,     ///< Any identifier that is not a keyword.
+        Number,         ///< Decimal, hexadecimal and floating point literals.
+        LineComment,    ///< open up to the end of the line.
+        BlockComment,   ///< open up to close, possibly on a later line.
+        String,         ///< open up to close, skipping backslash escapes.
+        BlockString,    ///< Like String, but possibly closed on a later line.
+        PrefixedWord,   ///< open followed by word characters, e.g. $var or @decorator.
+        Directive,      ///< open at the start of the line followed by a word, e.g. #include.
+        Delimited,      ///< open, non-empty text and close on the same line.
+        Link,           ///< A Markdown link: open, text, "](", target and close.
+        Literal,        ///< Exactly open.
+        LinePrefix,     ///< The whole line when it starts with open.
+        NumberedPrefix  ///< The whole line when it starts with digits followed by open.
+    };
+
+    /**
+     * @brief Struct representing a highlighting rule. \struct Rule
+     */
+    struct Rule
+    {
+        Kind kind;
+        std::string open;
+        std::string close;
+        int colorPair;
+    };
+
+    /**
+     * @brief Constructs a MexLexer that highlights nothing.
+     */
+    MexLexer() = default;
+
+    /**
+     * @brief Constructs a MexLexer and builds its dispatch tables.
+     * @param rules The rules of the language. Among rules that match at the same position the longest opening wins.
+     * @param keywords The keyword table identifiers are classified with.
+     */
+    explicit MexLexer(std::vector<Rule> rules, MexKeywordSet keywords = {});
+
+    /**
+     * @brief Splits a line into highlighted spans.
+     * @param line The line to scan.
+     * @param state The state at the end of the previous line.
+     * @param tokens Receives the spans in order. Existing content is replaced.
+     * @return The state at the end of the line.
+     */
+    State tokenize(std::string_view line, State state, std::vector<Token>& tokens) const;
+
+private:
+    std::vector<Rule> rules;
+    std::array<std::vector<uint16_t>, 256> openers;
+    std::vector<uint16_t> linePrefixes;
+    MexKeywordSet keywords;
+    int numberColor = -1;
+    int identifierColor = -1;
+
+    /**
+     * @brief Struct remembering the last search for a closing within one line: the first occurrence at or after from is at. \struct Search
+     */
+    struct Search
+    {
+        size_t from = std::string_view::npos;
+        size_t at = std::string_view::npos;
+    };
+
+    /**
+     * @brief The first Search slot of each rule: Delimited rules use one, Link rules one for "](" and one for close.
+     */
+    std::vector<uint16_t> searchSlots;
+    size_t searchCount = 0;
+
+    /**
+     * @brief Tries a rule at a position of a line.
+     * @param rule The rule to try. Its opening is known to start at pos.
+     * @param line The line being scanned.
+     * @param pos The position of the opening.
+     * @param searches The searches of the rule made earlier on the same line.
+     * @return The end of the match, or std::string_view::npos if the rule does not match.
+     */
+    static size_t match(const Rule& rule, std::string_view line, size_t pos, Search* searches);
+
+    /**
+     * @brief Finds a needle, answering from the previous search when it already covers pos.
+     *
+     * Openings without a closing would otherwise search the rest of the line again each, which is
+     * quadratic for a line of unmatched '['. Positions only grow within a line, so every byte is
+     * searched at most once per needle.
+     * @param line The line being scanned.
+     * @param needle The text to find.
+     * @param pos The position to search from.
+     * @param search The previous search for the needle, updated when the line is searched again.
+     * @return The position of the needle, or std::string_view::npos if it does not occur after pos.
+     */
+    static size_t find(std::string_view line, std::string_view needle, size_t pos, Search& search);
+
+    /**
+     * @brief Finds the end of a span whose body starts at a position.
+     * @param rule The rule of the span.
+     * @param line The line being scanned.
+     * @param pos The position after the opening.
+     * @return The position after the closing, or std::string_view::npos if the span continues past the line.
+     */
+    static size_t findClose(const Rule& rule, std::string_view line, size_t pos);
+};
+
+#endif //MEXEDIT_MEXLEXER_H
@@ -0,0 +1,62 @@
+#ifndef MEXEDIT_MEXLINESCAN_H
+#define MEXEDIT_MEXLINESCAN_H
+
+#include <cstddef>
+
+/// @brief MexLineScan provides vectorized newline scanning used to index documents. \class MexLineScan
+///
+/// The widest instruction set the CPU supports (AVX2, SSE2 or plain scalar code) is chosen once at runtime.
+class MexLineScan
+{
+public:
+
+    /**
+     * @brief Enum describing the instruction sets a scan can run with. \enum Isa
+     */
+    enum class Isa
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * @brief Gets the widest instruction set supported by the running CPU.
+     * @return The instruction set used by the default scan functions.
+     */
+    static Isa bestIsa();
+
+    /**
+     * @brief Gets a printable name for an instruction set.
+     * @param isa The instruction set.
+     * @return The name of the instruction set.
+     */
+    static const char* isaName(Isa isa);
+
+    /**
+     * @brief Counts the '\n' bytes in a range.
+     * @param data The start of the range.
+     * @param size The number of bytes in the range.
+     * @return The number of newlines.
+     */
+    static size_t countNewlines(const char* data, size_t size);
+
+    /**
+     * @brief Counts the '\n' bytes in a range with a specific instruction set. The CPU must support it.
+     * @param data The start of the range.
+     * @param size The number of bytes in the range.
+     * @param isa The instruction set to use.
+     * @return The number of newlines.
+     */
+    static size_t countNewlines(const char* data, size_t size, Isa isa);
+
+    /**
+     * @brief Finds the first '\n' in a range.
+     * @param begin The start of the range.
+     * @param end The end of the range.
+     * @return A pointer to the newline, or end if there is none.
+     */
+    static const char* findNewline(const char* begin, const char* end);
+};
+
+#endif //MEXEDIT_MEXLINESCAN_H
@@ -0,0 +1,131 @@
+#ifndef MEXEDIT_MEXLITERALMATCHER_H
+#define MEXEDIT_MEXLITERALMATCHER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// @brief MexLiteralMatcher finds a fixed string in text without going through std::regex. \class MexLiteralMatcher
+///
+/// On x86_64 candidates are found by comparing the first and last byte of the needle against 16 or 32
+/// positions at once and then verified; other targets use Boyer-Moore-Horspool. Case-insensitive matching
+/// folds ASCII letters only, and whole-word matching follows the semantics of \b in ECMAScript regexes.
+class MexLiteralMatcher
+{
+public:
+
+    /**
+     * @brief Constructs a MexLiteralMatcher.
+     * @param needle The text to find. Must not be empty.
+     * @param caseSensitive Whether ASCII letters must match in case.
+     * @param wholeWord Whether a match must start and end on a word boundary.
+     */
+    MexLiteralMatcher(std::string_view needle, bool caseSensitive, bool wholeWord);
+
+    /**
+     * @brief Gets the length of a match.
+     * @return The length of the needle.
+     */
+    size_t size() const { return needle.size(); }
+
+    /**
+     * @brief Finds the first match at or after a position.
+     * @param text The text to search. Its start and end count as word boundaries.
+     * @param from The position to start at.
+     * @return The offset of the match, or std::string_view::npos if there is none.
+     */
+    size_t find(std::string_view text, size_t from = 0) const;
+
+    /**
+     * @brief Checks whether the needle occurs at a position.
+     * @param text The text to check.
+     * @param offset The position of the candidate match.
+     * @return A boolean indicating whether a match starts at offset.
+     */
+    bool matchesAt(std::string_view text, size_t offset) const;
+
+    /**
+     * @brief Checks whether the needle occurs at a position, ignoring word boundaries.
+     * @param text The text to check.
+     * @param offset The position of the candidate occurrence.
+     * @return A boolean indicating whether the needle starts at offset.
+     */
+    bool occursAt(std::string_view text, size_t offset) const
+    {
+        return offset + needle.size() <= text.size() and equals(text.data() + offset);
+    }
+
+    /**
+     * @brief Calls fn(offset) for every non-overlapping match from left to right.
+     * @param text The text to search.
+     * @param fn The callback to invoke for each match.
+     */
+    template<typename Fn>
+    void forEach(std::string_view text, Fn&& fn) const
+    {
+        size_t pos = 0;
+        while ((pos = find(text, pos)) != std::string_view::npos)
+        {
+            fn(pos);
+            pos += needle.size();
+        }
+    }
+
+    /**
+     * @brief Calls fn(offset) for every occurrence of the needle from left to right, including overlapping
+     *        ones and ones that fail the word boundary check.
+     * @param text The text to search.
+     * @param fn The callback to invoke for each occurrence.
+     */
+    template<typename Fn>
+    void forEachOccurrence(std::string_view text, Fn&& fn) const
+    {
+        size_t pos = 0;
+        while ((pos = findCandidate(text, pos)) != std::string_view::npos)
+        {
+            fn(pos);
+            pos++;
+        }
+    }
+
+private:
+    std::string needle;
+    bool caseSensitive;
+    bool wholeWord;
+    std::array<uint8_t, 256> shift{};
+
+    /**
+     * @brief Finds the next position where the needle occurs, ignoring word boundaries.
+     * @param text The text to search.
+     * @param from The position to start at.
+     * @return The offset of the candidate, or std::string_view::npos if there is none.
+     */
+    size_t findCandidate(std::string_view text, size_t from) const;
+
+    /**
+     * @brief Finds the next candidate with Boyer-Moore-Horspool.
+     * @param text The text to search.
+     * @param from The position to start at.
+     * @return The offset of the candidate, or std::string_view::npos if there is none.
+     */
+    size_t findHorspool(std::string_view text, size_t from) const;
+
+    /**
+     * @brief Compares the needle with the text at a position, folding case if needed.
+     * @param data The text at the candidate position, at least size() bytes.
+     * @return A boolean indicating whether the bytes match.
+     */
+    bool equals(const char* data) const;
+
+    /**
+     * @brief Checks the word boundaries around a candidate.
+     * @param text The text being searched.
+     * @param offset The position of the candidate.
+     * @return A boolean indicating whether both ends of the candidate are word boundaries.
+     */
+    bool onWordBoundaries(std::string_view text, size_t offset) const;
+};
+
+#endif //MEXEDIT_MEXLITERALMATCHER_H
@@ -0,0 +1,74 @@
+#ifndef MEXEDIT_MEXMAPPEDFILE_H
+#define MEXEDIT_MEXMAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/// @brief MexMappedFile is a read-only memory mapping of a file on disk. \class MexMappedFile
+///
+/// A private mapping is not a snapshot. If another program rewrites the file in place instead of replacing
+/// it, the pages not read yet show the new bytes, and reading past a new, shorter end raises SIGBUS. A handler
+/// for SIGBUS maps zeroed pages over the rest of a mapping that lost its end, so such reads return zeros
+/// instead of killing the editor. Holders of the bytes are expected to check changedOnDisk() when the file
+/// is reported changed, and to copy out the first readableSize() bytes they still use.
+class MexMappedFile
+{
+public:
+
+    /**
+     * @brief Constructs an unmapped MexMappedFile.
+     */
+    MexMappedFile() = default;
+
+    /**
+     * @brief Destructor for MexMappedFile, unmaps the file.
+     */
+    ~MexMappedFile();
+
+    MexMappedFile(const MexMappedFile&) = delete;
+    MexMappedFile& operator=(const MexMappedFile&) = delete;
+
+    /**
+     * @brief Maps a file into memory. Pages are only read from disk when touched.
+     * @param path The path of the file to map.
+     * @return A boolean indicating whether the file was successfully mapped. Empty files are never mapped.
+     */
+    bool open(const std::filesystem::path& path);
+
+    /**
+     * @brief Tells the kernel that a range of the mapping is no longer needed, so it stops counting as resident.
+     * @param offset The start of the range.
+     * @param count The length of the range.
+     */
+    void release(size_t offset, size_t count) const;
+
+    /**
+     * @brief Checks whether the mapped file was written to in place since it was mapped. A file replaced by
+     *        another one under the same name does not count: the mapping keeps the old one.
+     */
+    bool changedOnDisk() const;
+
+    /**
+     * @brief Gets how many of the mapped bytes are still backed by the file, which may have been truncated.
+     */
+    size_t readableSize() const;
+
+    /**
+     * @brief Gets the start of the mapped bytes.
+     */
+    const char* data() const { return bytes; }
+
+    /**
+     * @brief Gets the number of mapped bytes.
+     */
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    int fd = -1; // Kept open to check the mapped file itself, whatever its name now points to.
+    int64_t mappedWriteTime = 0;
+};
+
+#endif //MEXEDIT_MEXMAPPEDFILE_H
@@ -0,0 +1,237 @@
+#ifndef MEXEDIT_MEXPROJECTSEARCH_H
+#define MEXEDIT_MEXPROJECTSEARCH_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mexIgnore.h"
+#include "mexLiteralMatcher.h"
+#include "mexMappedFile.h"
+#include "mexTrigramIndex.h"
+
+/// @brief MexProjectSearch searches every file below a directory on background threads. \class MexProjectSearch
+///
+/// The threads walk the tree together, skipping what .gitignore excludes, the .git directory and symbolic
+/// links. Files of 1 MiB or more are mapped into memory, smaller ones are read, and each is searched with
+/// the same literal and regex engines as MexSearch; files with a NUL byte near the start are taken to be
+/// binary and skipped. Results are handed over while the search runs.
+///
+/// With the index turned on, a literal pattern of three bytes or more is looked up in the trigram index of the
+/// root, and only the files it names are searched. The index is refreshed in the background when a search starts,
+/// so a search may miss changes made since the previous refresh.
+class MexProjectSearch
+{
+public:
+
+    /// @brief A match in a file. \struct Result
+    struct Result
+    {
+        std::filesystem::path file;
+        size_t line;
+        size_t column;
+        size_t length;
+        std::string preview; // The line of the match, cut to previewBytes.
+    };
+
+    /// @brief A directory or file below the root that is not ignored. \struct Entry
+    struct Entry
+    {
+        std::string path;
+        std::shared_ptr<const MexIgnoreRules> ignore; // For a directory, the rules that apply to it from above.
+        bool directory;
+    };
+
+    /**
+     * @brief Lists the entries of a directory that are searched: regular files and directories that are not ignored,
+     *        leaving out .git and symbolic links.
+     * @param directory The directory to list.
+     * @param entries The vector the entries are appended to.
+     */
+    static void listDirectory(const Entry& directory, std::vector<Entry>& entries);
+
+    /**
+     * @brief Reads a file, mapping it into memory if it is large.
+     * @param path The file.
+     * @param buffer The buffer small files are read into.
+     * @param file The mapping large files are mapped with.
+     * @return The contents of the file, or nothing if it is empty or cannot be read.
+     */
+    static std::string_view readFile(const std::string& path, std::string& buffer, MexMappedFile& file);
+
+    /**
+     * @brief Checks whether the start of a file marks it as binary, in which case it is not searched.
+     * @param text The contents of the file.
+     * @return A boolean indicating whether the file is binary.
+     */
+    static bool isBinary(std::string_view text);
+
+    /**
+     * @brief Constructs an idle MexProjectSearch.
+     */
+    MexProjectSearch() = default;
+
+    /**
+     * @brief Stops the search still running.
+     */
+    ~MexProjectSearch();
+
+    /**
+     * @brief Starts searching the files below a directory for a pattern, cancelling the search still running.
+     * @param root The directory to search.
+     * @param pattern The search pattern. Can be a simple string or a regex pattern.
+     * @return A boolean indicating whether the search started; false if the pattern is empty or an invalid regex.
+     */
+    bool start(const std::filesystem::path& root, const std::string& pattern);
+
+    /**
+     * @brief Stops the search. The results collected so far are kept.
+     */
+    void cancel();
+
+    /**
+     * @brief Adopts the results found since the last call.
+     * @return A boolean indicating whether there were new results.
+     */
+    bool collectResults();
+
+    /**
+     * @brief Checks whether the search is still running.
+     * @return A boolean indicating whether files are still being searched.
+     */
+    bool isSearching() const;
+
+    /**
+     * @brief Gets the results adopted by collectResults(), in the order they were found.
+     */
+    const std::vector<Result>& getResults() const { return results; }
+
+    /**
+     * @brief Gets the number of matches found, including those beyond maxResults that are not kept.
+     */
+    size_t matchCount() const { return matches.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Gets the number of files searched so far.
+     */
+    size_t fileCount() const { return files.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Gets the pattern of the last search.
+     */
+    const std::string& getPattern() const { return pattern; }
+
+    /**
+     * @brief Gets the directory of the last search.
+     */
+    const std::filesystem::path& getRoot() const { return root; }
+
+    /**
+     * @brief Sets whether the search should be case sensitive.
+     * @param sensitive A boolean indicating whether the search should be case sensitive.
+     */
+    void setCaseSensitive(bool sensitive) { caseSensitive = sensitive; }
+
+    /**
+     * @brief Sets whether the search should match whole words only.
+     * @param wholeWord A boolean indicating whether to match whole words only.
+     */
+    void setWholeWord(bool wholeWord) { this->wholeWord = wholeWord; }
+
+    /**
+     * @brief Sets whether the search should use regex patterns.
+     * @param regex A boolean indicating whether to use regex for searching.
+     */
+    void setRegexMode(bool regex) { regexMode = regex; }
+
+    /**
+     * @brief Sets whether searches use the trigram index of the directory they search.
+     * @param indexed A boolean indicating whether to use the index.
+     */
+    void setIndexed(bool indexed) { this->indexed = indexed; }
+
+    /**
+     * @brief Checks whether the last search only searched the files named by the index.
+     */
+    bool usedIndex() const { return indexUsed; }
+
+    /**
+     * @brief Starts building or refreshing the index of a directory in the background, unless that is already
+     *        underway or the index was refreshed moments ago.
+     * @param root The directory.
+     */
+    void updateIndex(const std::filesystem::path& root);
+
+    /**
+     * @brief Checks whether the index is being built.
+     * @return A boolean indicating whether a build runs in the background.
+     */
+    bool isIndexing() const { return indexing.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Sets how many threads walk and search the tree.
+     * @param threads The number of threads, or 0 to use one per hardware thread.
+     */
+    void setThreadCount(size_t threads) { threadCount = threads; }
+
+    // Matches beyond this count are counted but not kept.
+    static constexpr size_t maxResults = 100000;
+    static constexpr size_t previewBytes = 240;
+    // A search refreshes the index only if the last refresh is older than this.
+    static constexpr std::chrono::seconds indexRefreshInterval{10};
+
+private:
+    std::filesystem::path root;
+    std::string pattern;
+    bool caseSensitive = false;
+    bool wholeWord = false;
+    bool regexMode = false;
+    size_t threadCount = 0;
+
+    std::vector<Result> results;
+    std::atomic<size_t> matches{0};
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> running{0};
+
+    std::shared_ptr<const MexLiteralMatcher> literal;
+    std::shared_ptr<const std::regex> regex;
+
+    std::mutex taskMutex;
+    std::condition_variable_any taskReady;
+    std::vector<Entry> tasks; // Directories to list and files to search.
+    size_t busy = 0; // Threads working on a task, which may add more.
+
+    std::mutex resultMutex;
+    std::vector<Result> pending;
+
+    bool indexed = false;
+    bool indexUsed = false;
+    std::atomic<bool> indexing{false};
+    std::mutex indexMutex;
+    std::shared_ptr<const MexTrigramIndex> index;
+    std::chrono::steady_clock::time_point indexTime;
+    std::jthread indexer;
+
+    std::vector<std::jthread> workers; // Declared last, so they are stopped before the state they use is destroyed.
+
+    /**
+     * @brief Takes tasks until none are left and no other thread can add more, or the search is stopped.
+     * @param stop Stops the thread early.
+     */
+    void work(const std::stop_token& stop);
+
+    /**
+     * @brief Searches a file and hands its matches over.
+     * @param path The file.
+     * @param stop Stops the search early.
+     */
+    void searchFile(const std::string& path, const std::stop_token& stop);
+};
+
+#endif //MEXEDIT_MEXPROJECTSEARCH_H
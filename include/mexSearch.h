@@ -1,13 +1,27 @@
 #ifndef MEXEDIT_MEXSEARCH_H
 #define MEXEDIT_MEXSEARCH_H
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 #include <utility>
 #include <regex>
+#include "mexLiteralMatcher.h"
+#include "mexTextBuffer.h"
 
 /// @brief MexSearch is a class that provides search and replace functionality in the MexEdit text editor. \class MexSearch
-class MexSearch
+///
+/// By default every match is collected. In lazy mode only the current match and the matches on the lines in
+/// view are kept, and matches are counted on a background thread up to a cap, so memory stays bounded no
+/// matter how often the pattern occurs. As a listener of the document, it keeps the matches of the last search
+/// current across edits by matching the edited lines again.
+class MexSearch : public MexTextBuffer::Listener
 {
 public:
 
@@ -19,46 +33,135 @@ public:
     /**
      * @brief Finds all occurrences of a pattern in the document.
      * @param pattern The search pattern to find. Can be a simple string or a regex pattern.
-     * @param document The document to search in, represented as a vector of strings (lines).
+     * @param document The document to search in, represented as a line-indexed text buffer.
      * @return A boolean indicating whether any matches were found.
      */
-    bool find(const std::string& pattern, const std::vector<std::string>& document);
+    bool find(const std::string& pattern, const MexTextBuffer& document);
+
+    /**
+     * @brief Finds a pattern and makes the first match at or after a position the current match.
+     * @param pattern The search pattern to find.
+     * @param document The document to search in, represented as a line-indexed text buffer.
+     * @param line The line to search from.
+     * @param column The column to search from.
+     * @return A boolean indicating whether any matches were found.
+     */
+    bool find(const std::string& pattern, const MexTextBuffer& document, size_t line, size_t column);
+
+    /**
+     * @brief Starts searching for a pattern on a background thread, cancelling the search still running.
+     *        When a literal pattern extends the previous one, only the previous occurrences are re-checked.
+     * @param pattern The search pattern to find.
+     * @param document The document to search in. The search reads a snapshot of it.
+     * @param line The line of the position whose next match becomes the current match.
+     * @param column The column of that position.
+     */
+    void findIncremental(const std::string& pattern, const MexTextBuffer& document, size_t line = 0, size_t column = 0);
+
+    /**
+     * @brief Adopts the results of the background search if it has finished.
+     * @return A boolean indicating whether new matches were adopted.
+     */
+    bool collectResults();
+
+    /**
+     * @brief Waits for the background search to finish and adopts its results.
+     */
+    void finishSearch();
+
+    /**
+     * @brief Stops the background search and discards its results.
+     */
+    void cancelSearch();
+
+    /**
+     * @brief Checks whether a background search was started and its results were not adopted yet.
+     * @return A boolean indicating whether a search is pending.
+     */
+    bool isSearching() const { return searching; }
+
+    /**
+     * @brief Checks whether the lazy match count is still running.
+     * @return A boolean indicating whether matches are being counted.
+     */
+    bool isCounting() const;
+
+    /**
+     * @brief Checks whether there is a current match.
+     * @return A boolean indicating whether getCurrentMatch() refers to a match.
+     */
+    bool hasCurrentMatch() const;
+
+    /**
+     * @brief Describes how many matches the last search found.
+     * @return The count, such as "12", or "1000+" once the lazy count reached its cap.
+     */
+    std::string matchCountText() const;
+
+    /**
+     * @brief Brings getMatches() up to date for highlighting: matches the lines edited since the search again and,
+     *        in lazy mode, collects the matches on the lines in view.
+     * @param document The document that was searched.
+     * @param first The first line in view.
+     * @param last The line after the last line in view.
+     */
+    void refreshMatches(const MexTextBuffer& document, size_t first, size_t last);
+
+    /**
+     * @brief Drops the matches on the edited lines, shifts the later ones and marks the edited lines for matching again.
+     * @param line The line of the start position.
+     * @param column The column of the start position.
+     * @param removed The text that was removed.
+     * @param inserted The text that was inserted in its place.
+     */
+    void onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted) override;
 
     /**
      * @brief Finds the next occurrence of the last searched pattern in the document.
-     * @param document The document to search in, represented as a vector of strings (lines).
+     * @param document The document to search in, represented as a line-indexed text buffer.
      * @return A boolean indicating whether a next match was found.
      */
-    bool findNext(const std::vector<std::string>& document);
+    bool findNext(const MexTextBuffer& document);
 
     /**
      * @brief Finds the previous occurrence of the last searched pattern in the document.
-     * @param document The document to search in, represented as a vector of strings (lines).
+     * @param document The document to search in, represented as a line-indexed text buffer.
      * @return A boolean indicating whether a previous match was found.
      */
-    bool findPrevious(const std::vector<std::string>& document);
+    bool findPrevious(const MexTextBuffer& document);
 
     /**
      * @brief Replaces the current match with a replacement string.
      * @param replacement The string to replace the current match with.
-     * @param document The document to modify, represented as a vector of strings (lines).
+     * @param document The document to modify, represented as a line-indexed text buffer.
      */
-    void replaceCurrent(const std::string& replacement, std::vector<std::string>& document);
+    void replaceCurrent(const std::string& replacement, MexTextBuffer& document);
 
     /**
-     * @brief Replaces all occurrences of the last searched pattern with a replacement string.
+     * @brief Replaces all occurrences of a pattern with a replacement string. The lines holding matches are rebuilt
+     *        once each, on several threads for a large document, and put back with a few large edits, so a caller
+     *        grouping the history undoes them in one step.
      * @param pattern The search pattern to replace.
      * @param replacement The string to replace the pattern with.
-     * @param document The document to modify, represented as a vector of strings (lines).
+     * @param document The document to modify, represented as a line-indexed text buffer.
+     * @return The number of replacements made.
      */
-    void replaceAll(const std::string& pattern, const std::string& replacement,
-                    std::vector<std::string>& document);
+    size_t replaceAll(const std::string& pattern, const std::string& replacement,
+                    MexTextBuffer& document);
 
     /**
-     * @brief Gets the matches found by the last search operation.
+     * @brief Gets the matches found by the last search operation. In lazy mode, only those on the lines in view.
      */
     const std::vector<std::pair<size_t, std::pair<size_t, size_t>>>& getMatches() const;
 
+    /**
+     * @brief Gets the matches on a range of lines. Matches are sorted, so the range is found by binary search.
+     * @param first The first line.
+     * @param last The line after the last line.
+     * @return The matches on those lines, in order.
+     */
+    std::span<const std::pair<size_t, std::pair<size_t, size_t>>> matchesInLines(size_t first, size_t last) const;
+
     /**
      * @brief Clears the current matches and resets the search state.
      */
@@ -82,38 +185,206 @@ public:
      */
     void setCaseSensitive(bool sensitive);
 
+    /**
+     * @brief Checks whether the search is case sensitive.
+     * @return A boolean indicating whether the search is case sensitive.
+     */
+    bool isCaseSensitive() const { return caseSensitive; }
+
     /**
      * @brief Sets whether the search should match whole words only.
      * @param wholeWord A boolean indicating whether to match whole words only.
      */
     void setWholeWord(bool wholeWord);
 
+    /**
+     * @brief Checks whether the search matches whole words only.
+     * @return A boolean indicating whether only whole words match.
+     */
+    bool isWholeWord() const { return wholeWord; }
+
     /**
      * @brief Sets whether the search should use regex patterns.
      * @param regex A boolean indicating whether to use regex for searching.
      */
     void setRegexMode(bool regex);
 
+    /**
+     * @brief Checks whether the search uses regex patterns.
+     * @return A boolean indicating whether patterns are regular expressions.
+     */
+    bool isRegexMode() const { return regexMode; }
+
+    /**
+     * @brief Sets how many threads a search over a large document may use.
+     * @param threads The number of threads, or 0 to use one per hardware thread.
+     */
+    void setThreadCount(size_t threads);
+
+    /**
+     * @brief Gets the configured number of search threads.
+     * @return The number of threads, or 0 if one per hardware thread is used.
+     */
+    size_t getThreadCount() const { return threadCount; }
+
+    /**
+     * @brief Sets whether matches are enumerated lazily instead of all being collected.
+     * @param lazy A boolean indicating whether to use lazy mode.
+     */
+    void setLazyMode(bool lazy);
+
+    /**
+     * @brief Sets how many matches lazy mode counts before it reports the count as capped.
+     * @param cap The maximum number of matches to count.
+     */
+    void setCountCap(size_t cap);
+
+    /**
+     * @brief Gets the lazy count cap.
+     * @return The maximum number of matches lazy mode counts.
+     */
+    size_t getCountCap() const { return countCap; }
+
 private:
+    using Match = std::pair<size_t, std::pair<size_t, size_t>>;
+    using Position = std::pair<size_t, size_t>;
+
+    /// @brief Every occurrence of a literal pattern, overlapping or not, kept to refine the next incremental search. \struct Occurrences
+    struct Occurrences
+    {
+        std::string pattern;
+        uint64_t version = 0;
+        bool caseSensitive = false;
+        std::shared_ptr<const std::vector<Position>> positions; // line, column
+    };
+
+    /// @brief Matches found by the background search. \struct Result
+    struct Result
+    {
+        std::vector<Match> matches;
+        Occurrences occurrences;
+        std::optional<Match> current; // Lazy mode only.
+    };
+
+    /// @brief A pattern compiled for matching one line at a time, as lazy mode does. \struct LinePattern
+    struct LinePattern
+    {
+        std::optional<MexLiteralMatcher> literal;
+        std::optional<std::regex> regex;
+
+        /**
+         * @brief Appends the matches on a line, chosen left to right without overlapping.
+         * @param lineNum The index of the line.
+         * @param line The text of the line.
+         * @param out The vector to append the matches to.
+         */
+        void matchLine(size_t lineNum, std::string_view line, std::vector<Match>& out) const;
+    };
+
+    // Occurrences are not kept beyond this count; the next search then scans the document again.
+    static constexpr size_t maxOccurrences = 1 << 20;
+
     std::string lastPattern;
-    std::vector<std::pair<size_t, std::pair<size_t, size_t>>> matches; // line, (start, end)
+    std::vector<Match> matches; // line, (start, end)
     size_t currentMatch;
     bool caseSensitive;
     bool wholeWord;
     bool regexMode;
+    size_t threadCount = 0;
+
+    bool lazyMode = false;
+    size_t countCap = 1000;
+    std::shared_ptr<const LinePattern> linePattern;
+    std::optional<Match> current; // Lazy mode replaces currentMatch with the match itself.
+    std::map<size_t, size_t> dirtyLines; // Lines edited since the search, as begin and end; eager mode only.
+    size_t windowFirst = 0;
+    size_t windowLast = 0;
+    uint64_t windowVersion = 0;
+    bool windowValid = false;
+    Position incrementalOrigin;
+    std::atomic<size_t> counted{0};
+    std::atomic<bool> countFinished{true};
+    std::jthread counter;
+
+    Occurrences occurrences;
+    bool searching = false;
+    std::mutex resultMutex;
+    std::optional<Result> finishedResult;
+    std::jthread worker; // Declared last, so it is stopped before the state it writes to is destroyed.
 
     /**
      * @brief Finds matches in the document based on the current search settings.
      * @param pattern The search pattern to find.
-     * @param document The document to search in, represented as a vector of strings (lines).
+     * @param document The document to search in, represented as a line-indexed text buffer.
+     */
+    void findMatches(const std::string& pattern, const MexTextBuffer& document);
+
+    /**
+     * @brief Marks a range of lines to be matched again, merging it with overlapping ranges.
+     * @param begin The first edited line.
+     * @param end One past the last edited line.
+     */
+    void markDirty(size_t begin, size_t end);
+
+    /**
+     * @brief Matches the dirty lines again and splices their matches into the sorted matches.
+     * @param document The edited document.
+     */
+    void matchDirtyLines(const MexTextBuffer& document);
+
+    /**
+     * @brief Replaces a range of matches, keeping currentMatch on the same match or, if it was removed, on the one before.
+     * @param begin The index of the first match to replace.
+     * @param end The index past the last match to replace.
+     * @param replacement The matches to put in their place.
+     */
+    void spliceMatches(size_t begin, size_t end, const std::vector<Match>& replacement);
+
+    /**
+     * @brief Makes the first match at or after a position the current match, wrapping around to the first match.
+     * @param line The line of the position.
+     * @param column The column of the position.
+     */
+    void selectMatchFrom(size_t line, size_t column);
+
+    /**
+     * @brief Compiles a pattern with the current settings for lazy matching.
+     * @param pattern The search pattern.
+     * @return The compiled pattern.
+     * @throws std::regex_error If the pattern is an invalid regex.
+     */
+    std::shared_ptr<const LinePattern> compile(const std::string& pattern) const;
+
+    /**
+     * @brief Starts counting the matches of linePattern in a snapshot of the document, up to countCap + 1.
+     * @param document The document to count in.
+     */
+    void startCounting(const MexTextBuffer& document);
+
+    /**
+     * @brief Stops the background count.
+     */
+    void stopCounting();
+
+    /**
+     * @brief Finds the first match at or after a position, wrapping around to the start of the document.
+     * @param pattern The compiled pattern.
+     * @param document The document to search.
+     * @param from The line and column to search from.
+     * @param stop Stops the search early.
+     * @return The match, or nothing if there is none or the search was stopped.
      */
-    void findMatches(const std::string& pattern, const std::vector<std::string>& document);
+    static std::optional<Match> searchForward(const LinePattern& pattern, const MexTextBuffer& document,
+                                              Position from, const std::stop_token& stop);
 
     /**
-     * @brief Converts a search pattern to a regex pattern if regex mode is enabled.
-     * @param pattern The search pattern to convert.
-     * @return A string containing the regex pattern.
+     * @brief Finds the last match before a position, wrapping around to the end of the document.
+     * @param pattern The compiled pattern.
+     * @param document The document to search.
+     * @param before The line and column the match must start before.
+     * @return The match, or nothing if there is none.
      */
-    std::string getRegexPattern(const std::string& pattern) const;
+    static std::optional<Match> searchBackward(const LinePattern& pattern, const MexTextBuffer& document,
+                                               Position before);
 };
 #endif // MEXEDIT_MEXSEARCH_H
\ No newline at end of file
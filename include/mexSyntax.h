@@ -2,15 +2,20 @@
 #define MEXEDIT_MEXSYNTAX_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <map>
 #include <unordered_map>
-#include <unordered_set>
 #include <ncurses.h>
-#include <regex>
+#include "mexLexer.h"
+#include "mexTextBuffer.h"
 #include <memory>
 
 /// MexSyntax is a class that provides syntax highlighting for various programming languages in the MexEdit text editor. \class MexSyntax
-class MexSyntax
+///
+/// The lexer state at the start of every line is stored. Edits only mark the touched lines dirty, and
+/// updateLineStates() re-lexes forward from them until the recomputed states meet the stored ones again.
+class MexSyntax : public MexTextBuffer::Listener
 {
 public:
 
@@ -28,33 +33,105 @@ public:
     /**
      * @brief Highlights a line of code based on the current language's syntax rules.
      * @param line The line of code to highlight.
+     * @param lineIndex The index of the line in the document. Its start state must be up to date.
      * @param yPos The vertical position (line number) in the editor where the line is displayed.
      * @param startCol The starting column position in the editor where the line begins.
      */
-    void highlightLine(const std::string& line, int yPos, int startCol);
+    void highlightLine(std::string_view line, size_t lineIndex, int yPos, int startCol);
 
     /**
-     * @brief Clears the cached syntax highlighting rules and keywords for the current language.
+     * @brief Brings the stored lexer states of the first lines of a document up to date.
+     * @param document The document being highlighted.
+     * @param lineEnd One past the last line whose start state is needed.
+     */
+    void updateLineStates(const MexTextBuffer& document, size_t lineEnd);
+
+    /**
+     * @brief Gets the stored lexer state at the start of a line.
+     * @param index The line index.
+     * @return The state, or 0 if it was never computed.
+     */
+    MexLexer::State lineState(size_t index) const;
+
+    /**
+     * @brief Forgets all stored lexer states, e.g. after the whole document was replaced.
+     */
+    void resetLineStates();
+
+    /**
+     * @brief Marks the lines touched by an edit dirty and shifts the stored states of the lines after it.
+     * @param line The line of the start position.
+     * @param column The column of the start position.
+     * @param removed The text that was removed.
+     * @param inserted The text that was inserted in its place.
+     */
+    void onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted) override;
+
+    /**
+     * @brief Clears the cached syntax highlighting rules and line tokens for the current language.
      */
     void clearCache();
 
+    using Token = MexLexer::Token;
+
     /**
-     * @brief Struct representing a syntax highlighting rule. \struct HighlightRule
+     * @brief Struct counting how often tokenize() was answered from the line cache. \struct CacheStats
      */
-    struct HighlightRule
+    struct CacheStats
     {
-        std::regex pattern;
-        int colorPair;
-        bool wholeWord;
+        size_t hits = 0;
+        size_t misses = 0;
     };
 
+    /**
+     * @brief Computes the highlighted spans of a line, reusing the result for lines with identical content and start state.
+     * @param line The line of code to tokenize.
+     * @param state The lexer state at the start of the line.
+     * @return The spans in painting order, valid until the next call.
+     */
+    const std::vector<Token>& tokenize(std::string_view line, MexLexer::State state = 0);
+
+    /**
+     * @brief Gets the hit and miss counters of the line token cache.
+     * @return The counters since the editor started.
+     */
+    CacheStats getCacheStats() const;
+
+    using HighlightRule = MexLexer::Rule;
+
 private:
     std::string currentLanguage;
     std::unordered_map<std::string, std::vector<HighlightRule>> languageRules;
+    std::unordered_map<std::string, MexKeywordSet> languageKeywords;
     std::unordered_map<std::string, std::string> fileExtensions;
 
-    std::vector<HighlightRule> currentRules;
-    std::unordered_set<std::string> currentKeywords;
+    std::unordered_map<std::string, MexLexer> lexers;
+    const MexLexer* currentLexer = nullptr;
+
+    /**
+     * @brief Struct holding the spans of a cached line with the line they belong to, since hashes of different lines may collide. \struct CachedLine
+     */
+    struct CachedLine
+    {
+        std::string line;
+        MexLexer::State state;
+        std::vector<Token> tokens;
+    };
+
+    static constexpr size_t tokenCacheCapacity = 8192;
+    std::unordered_map<size_t, CachedLine> tokenCache;
+    CacheStats cacheStats;
+
+    std::vector<MexLexer::State> lineStates{0};
+    std::map<size_t, size_t> dirtyLines;
+    std::vector<Token> scratchTokens;
+
+    /**
+     * @brief Marks a range of lines whose following start states may be stale, merging it with overlapping ranges.
+     * @param begin The first dirty line.
+     * @param end One past the last dirty line.
+     */
+    void markDirty(size_t begin, size_t end);
 
     /**
      * @brief Initializes the syntax highlighting rules for various programming languages.
@@ -89,28 +166,13 @@ private:
     /**
      * @brief Adds a syntax highlighting rule for a specific language.
      * @param lang The language to which the rule applies.
-     * @param pattern The regex pattern for the rule.
+     * @param kind How the rule matches.
+     * @param open The text that starts a match.
      * @param colorPair The color pair to use for highlighting.
-     * @param wholeWord Whether the rule should match whole words only.
-     */
-    void addRule(const std::string& lang, const std::string& pattern,
-                 int colorPair, bool wholeWord = false);
-
-    /**
-     * @brief Adds a keyword for syntax highlighting in a specific language.
-     * @param lang The language to which the keyword applies.
-     * @param keyword The keyword to add.
-     * @param colorPair The color pair to use for highlighting the keyword.
-     */
-    void addKeyword(const std::string& lang, const std::string& keyword,
-                    int colorPair);
-
-    /**
-     * @brief Checks if a character is a word boundary.
-     * @param c The character to check.
-     * @return A boolean indicating whether the character is a word boundary.
+     * @param close The text that ends a match, for rules that have one.
      */
-    static bool isWordBoundary(char c);
+    void addRule(const std::string& lang, MexLexer::Kind kind, const std::string& open,
+                 int colorPair, const std::string& close = {});
 
     /**
      * @brief Applies syntax highlighting to a specific position in the editor.
@@ -0,0 +1,474 @@
+#ifndef MEXEDIT_MEXTEXTBUFFER_H
+#define MEXEDIT_MEXTEXTBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "mexMappedFile.h"
+
+/// @brief MexTextBuffer is the line-indexed document storage shared by the editor, search and syntax engines. \class MexTextBuffer
+///
+/// The text is kept as a piece table: every piece references a run of complete lines inside an immutable
+/// storage block (a memory mapped file or the text of an edit). Pieces are ordered in a persistent treap
+/// that is augmented with line and byte counts, so line lookup, insertion and erasure are O(log n) and
+/// copying a buffer only copies the root pointer.
+///
+/// A mapped file is indexed by a background thread. Lines are folded into the tree as they are first
+/// asked for, so only lineCount() and whole-document walks have to wait for the index to complete.
+class MexTextBuffer
+{
+public:
+
+    /**
+     * @brief Interface for observers of buffer edits, such as the undo history. \struct Listener
+     */
+    struct Listener
+    {
+        virtual ~Listener() = default;
+
+        /**
+         * @brief Called after the text starting at a position was replaced. Every edit is reported in this form.
+         * @param line The line of the start position.
+         * @param column The column of the start position.
+         * @param removed The text that was removed.
+         * @param inserted The text that was inserted in its place.
+         */
+        virtual void onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted) = 0;
+    };
+
+    /**
+     * @brief Constructs an empty buffer holding a single empty line.
+     */
+    MexTextBuffer();
+
+    /**
+     * @brief Replaces the whole buffer with the given text, split on '\n'. A trailing newline terminates the last line.
+     * @param text The new content of the buffer.
+     */
+    void assign(std::string text);
+
+    /**
+     * @brief Replaces the whole buffer with the content of a mapped file. Unmodified lines keep referencing the mapping.
+     * @param file The mapped file. It must not be empty.
+     */
+    void assign(std::shared_ptr<const MexMappedFile> file);
+
+    /**
+     * @brief Resets the buffer to a single empty line.
+     */
+    void clear();
+
+    /**
+     * @brief Takes over the content and version of another buffer, e.g. a snapshot, without telling the listeners.
+     *        Only the tree root is copied.
+     * @param other The buffer to take the content from.
+     */
+    void adopt(const MexTextBuffer& other);
+
+    /**
+     * @brief Copies the whole content into memory of its own if a file it maps was written to in place, without
+     *        telling the listeners. Bytes past a new, shorter end of the file are lost and left out.
+     * @return A boolean indicating whether the content was copied, and may differ from what the listeners know.
+     */
+    bool detachChangedFiles();
+
+    /**
+     * @brief Copies the buffer without its listeners, for reading on another thread. Only the tree root is copied.
+     * @return The copy.
+     */
+    MexTextBuffer snapshot() const;
+
+    /**
+     * @brief Gets the number of lines in the buffer. A buffer always holds at least one line.
+     * @return The number of lines.
+     */
+    size_t lineCount() const;
+
+    /**
+     * @brief Checks whether a line exists, indexing only as far as needed to answer.
+     * @param index The zero based line index.
+     * @return A boolean indicating whether the buffer has a line with that index.
+     */
+    bool hasLine(size_t index) const;
+
+    /**
+     * @brief Checks whether a mapped file is still being indexed in the background.
+     * @return A boolean indicating whether the line count is not yet known.
+     */
+    bool isLoading() const;
+
+    /**
+     * @brief Gets the text of a line without its line terminator.
+     * @param index The zero based line index.
+     * @return A view of the line, valid until the buffer is next modified.
+     */
+    std::string_view line(size_t index) const;
+
+    /**
+     * @brief Gets the length of a line without its line terminator.
+     * @param index The zero based line index.
+     * @return The number of bytes in the line.
+     */
+    size_t lineLength(size_t index) const;
+
+    /**
+     * @brief Checks whether the buffer consists of a single empty line.
+     * @return A boolean indicating whether the buffer is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Inserts text at a position. Newlines in the text split the line.
+     * @param line The line to insert into.
+     * @param column The column to insert at, clamped to the line length.
+     * @param text The text to insert.
+     */
+    void insert(size_t line, size_t column, std::string_view text);
+
+    /**
+     * @brief Erases the text between two positions. Erasing across a line end joins the lines.
+     * @param line The line of the first erased character.
+     * @param column The column of the first erased character.
+     * @param endLine The line of the end position (exclusive).
+     * @param endColumn The column of the end position (exclusive).
+     */
+    void erase(size_t line, size_t column, size_t endLine, size_t endColumn);
+
+    /**
+     * @brief Replaces the text between two positions with new text in a single edit.
+     * @param line The line of the start position.
+     * @param column The column of the start position.
+     * @param endLine The line of the end position (exclusive).
+     * @param endColumn The column of the end position (exclusive).
+     * @param text The text to insert in place of the range.
+     */
+    void replace(size_t line, size_t column, size_t endLine, size_t endColumn, std::string_view text);
+
+    /**
+     * @brief Gets the text between two positions, joining lines with '\n'.
+     * @param line The line of the start position.
+     * @param column The column of the start position.
+     * @param endLine The line of the end position (exclusive).
+     * @param endColumn The column of the end position (exclusive).
+     * @return The text in the range.
+     */
+    std::string text(size_t line, size_t column, size_t endLine, size_t endColumn) const;
+
+    /**
+     * @brief Inserts a new line before the given index.
+     * @param index The index the new line will have. May equal lineCount() to append.
+     * @param text The content of the new line.
+     */
+    void insertLine(size_t index, std::string_view text);
+
+    /**
+     * @brief Removes a line. Removing the only line leaves a single empty line.
+     * @param index The index of the line to remove.
+     */
+    void eraseLine(size_t index);
+
+    /**
+     * @brief Replaces the content of a line.
+     * @param index The index of the line to replace.
+     * @param text The new content of the line. Must not contain '\n'.
+     */
+    void replaceLine(size_t index, std::string_view text);
+
+    /**
+     * @brief Adds a listener that is told about every edit. Copies of the buffer share the listeners.
+     * @param listener The listener. It is called after the listeners added before it.
+     */
+    void addListener(Listener* listener);
+
+    /**
+     * @brief Stops reporting edits to a listener.
+     * @param listener The listener to remove.
+     */
+    void removeListener(Listener* listener);
+
+    /**
+     * @brief Gets the edit version of the buffer. It changes with every modification and is shared by unmodified copies.
+     *        Versions are unique across buffers.
+     * @return The current version.
+     */
+    uint64_t version() const { return editVersion; }
+
+    /**
+     * @brief Gets the number of bytes the document occupies on disk, with every line terminated by '\n'. Waits for indexing.
+     * @return The byte count.
+     */
+    size_t byteCount() const;
+
+    /**
+     * @brief Calls fn(bytes) with consecutive spans that together form the document as written to disk. Waits for indexing.
+     * @param fn The callback to invoke for each span. The spans stay valid until the buffer is next modified.
+     */
+    template<typename Fn>
+    void forEachSpan(Fn&& fn) const;
+
+    /**
+     * @brief Calls fn(lineIndex, lineText) for every line in [first, last). If fn returns bool, returning false stops the walk.
+     * @param first The first line to visit.
+     * @param last One past the last line to visit, clamped to lineCount(). Only lines up to last are indexed.
+     * @param fn The callback to invoke for each line.
+     */
+    template<typename Fn>
+    void forEachLine(size_t first, size_t last, Fn&& fn) const;
+
+    /**
+     * @brief Calls fn(firstLine, text) for every stored chunk of the document in order.
+     * @param fn The callback to invoke for each chunk. text holds whole lines separated by '\n', the last one
+     *           possibly without its '\n', and stays valid until the buffer is next modified. If fn returns
+     *           a bool, returning false stops the walk.
+     */
+    template<typename Fn>
+    void forEachChunk(Fn&& fn) const;
+
+private:
+    struct LoadState;
+
+    struct LineIndex
+    {
+        std::once_flag once;
+        std::vector<uint32_t> starts;
+    };
+
+    struct Piece
+    {
+        std::shared_ptr<const void> storage;
+        const MexMappedFile* mapping = nullptr; // The file data points into, if it is mapped.
+        const char* data = nullptr;
+        size_t length = 0;
+        size_t lines = 1;
+        bool terminated = false;
+        std::shared_ptr<LineIndex> index;
+    };
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node
+    {
+        Piece piece;
+        NodePtr left;
+        NodePtr right;
+        uint32_t priority = 0;
+        size_t subtreeLines = 0;
+        size_t subtreeBytes = 0;
+    };
+
+    static constexpr size_t pieceTargetSize = 64 * 1024;
+
+    mutable NodePtr root;
+    mutable std::shared_ptr<LoadState> loading;
+    mutable size_t loadedChunks = 0;
+    mutable uint32_t seed = 0x9e3779b9u;
+    std::vector<Listener*> listeners;
+    uint64_t editVersion = 0;
+
+    static uint64_t nextVersion();
+
+    uint32_t nextPriority() const;
+
+    /**
+     * @brief Folds lines indexed by the background loader into the tree until at least count lines are known.
+     * @param count The number of lines needed.
+     */
+    void ensureLines(size_t count) const;
+
+    /**
+     * @brief Appends every chunk the background loader has published so far to the tree.
+     */
+    void absorbChunks() const;
+
+    /**
+     * @brief Finds where the piece starting at offset should end: the first newline after the target size.
+     * @param data The start of the text.
+     * @param size The number of bytes of text.
+     * @param offset The start of the piece.
+     * @return The end offset of the piece.
+     */
+    static size_t pieceEnd(const char* data, size_t size, size_t offset);
+
+    static size_t linesOf(const NodePtr& node) { return node ? node->subtreeLines : 0; }
+    static size_t bytesOf(const NodePtr& node) { return node ? node->subtreeBytes : 0; }
+
+    static NodePtr makeNode(Piece piece, NodePtr left, NodePtr right, uint32_t priority);
+    static NodePtr merge(const NodePtr& a, const NodePtr& b);
+    static std::pair<NodePtr, NodePtr> split(const NodePtr& node, size_t lines);
+    static std::pair<Piece, Piece> splitPiece(const Piece& piece, size_t lines);
+
+    static const std::vector<uint32_t>& lineStarts(const Piece& piece);
+    static std::string_view pieceLine(const Piece& piece, size_t local);
+
+    /**
+     * @brief Chunks a storage block into pieces and appends them to a tree.
+     * @param tree The tree to append to.
+     * @param storage The block that keeps the data alive.
+     * @param data The start of the text.
+     * @param size The number of bytes of text.
+     * @param terminated Whether a trailing '\n' ends the last line instead of starting a new one.
+     * @return The tree with the pieces appended.
+     */
+    NodePtr appendText(NodePtr tree, const std::shared_ptr<const void>& storage,
+                       const char* data, size_t size, bool terminated) const;
+
+    /**
+     * @brief Replaces a run of lines by the lines of a text. The text always yields newlines + 1 lines.
+     * @param first The first line to replace.
+     * @param count The number of lines to replace.
+     * @param text The replacement text.
+     */
+    void replaceLines(size_t first, size_t count, std::string text);
+
+    template<typename Fn>
+    static void visitPieces(const NodePtr& node, Fn& fn);
+
+    template<typename Fn>
+    static void visitSpans(const NodePtr& node, Fn& fn);
+
+    template<typename Fn>
+    static bool visitChunks(const NodePtr& node, size_t base, Fn& fn);
+
+    template<typename Fn>
+    static bool visitLines(const NodePtr& node, size_t base, size_t first, size_t last, Fn& fn);
+};
+
+template<typename Fn>
+void MexTextBuffer::forEachLine(size_t first, size_t last, Fn&& fn) const
+{
+    ensureLines(last);
+    if (last > linesOf(root))
+    {
+        last = linesOf(root);
+    }
+
+    if (first < last)
+    {
+        visitLines(root, 0, first, last, fn);
+    }
+}
+
+template<typename Fn>
+bool MexTextBuffer::visitLines(const NodePtr& node, size_t base, size_t first, size_t last, Fn& fn)
+{
+    if (!node or base >= last or base + node->subtreeLines <= first)
+    {
+        return true;
+    }
+
+    if (!visitLines(node->left, base, first, last, fn))
+    {
+        return false;
+    }
+
+    const Piece& piece = node->piece;
+    size_t pieceBase = base + linesOf(node->left);
+    const char* cursor = piece.data;
+    const char* end = piece.data + piece.length;
+
+    for (size_t local = 0; local < piece.lines; ++local)
+    {
+        const void* newline = cursor < end ? std::memchr(cursor, '\n', end - cursor) : nullptr;
+        const char* lineEnd = newline ? static_cast<const char*>(newline) : end;
+        size_t lineIndex = pieceBase + local;
+
+        if (lineIndex >= last)
+        {
+            return false;
+        }
+
+        if (lineIndex >= first)
+        {
+            std::string_view text(cursor, lineEnd - cursor);
+            if constexpr (std::is_same_v<std::invoke_result_t<Fn&, size_t, std::string_view>, bool>)
+            {
+                if (!fn(lineIndex, text))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                fn(lineIndex, text);
+            }
+        }
+
+        cursor = newline ? lineEnd + 1 : end;
+    }
+
+    return visitLines(node->right, pieceBase + piece.lines, first, last, fn);
+}
+
+template<typename Fn>
+void MexTextBuffer::forEachSpan(Fn&& fn) const
+{
+    lineCount();
+    visitSpans(root, fn);
+}
+
+template<typename Fn>
+void MexTextBuffer::visitSpans(const NodePtr& node, Fn& fn)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    visitSpans(node->left, fn);
+    if (node->piece.length > 0)
+    {
+        fn(std::string_view(node->piece.data, node->piece.length));
+    }
+    if (!node->piece.terminated)
+    {
+        fn(std::string_view("\n", 1));
+    }
+    visitSpans(node->right, fn);
+}
+
+template<typename Fn>
+void MexTextBuffer::forEachChunk(Fn&& fn) const
+{
+    lineCount();
+    visitChunks(root, 0, fn);
+}
+
+template<typename Fn>
+bool MexTextBuffer::visitChunks(const NodePtr& node, size_t base, Fn& fn)
+{
+    if (!node)
+    {
+        return true;
+    }
+
+    if (!visitChunks(node->left, base, fn))
+    {
+        return false;
+    }
+
+    base += linesOf(node->left);
+    std::string_view text(node->piece.data, node->piece.length);
+    if constexpr (std::is_same_v<std::invoke_result_t<Fn&, size_t, std::string_view>, bool>)
+    {
+        if (!fn(base, text))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        fn(base, text);
+    }
+
+    return visitChunks(node->right, base + node->piece.lines, fn);
+}
+
+#endif //MEXEDIT_MEXTEXTBUFFER_H
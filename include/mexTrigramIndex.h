@@ -0,0 +1,106 @@
+#ifndef MEXEDIT_MEXTRIGRAMINDEX_H
+#define MEXEDIT_MEXTRIGRAMINDEX_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mexMappedFile.h"
+
+/// @brief MexTrigramIndex maps every three-byte sequence to the files below a directory that contain it. \class MexTrigramIndex
+///
+/// The index covers the files a project search would read, with letters folded to lower case, and lives in one
+/// file under the user's cache directory that is mapped into memory when loaded. A query intersects the posting
+/// lists of the trigrams of a literal, which leaves the files that may contain it; they still have to be searched.
+/// An index is never changed once built: rebuilding reads only the files whose size or modification time changed
+/// and takes the trigrams of the others from the previous index.
+class MexTrigramIndex
+{
+public:
+
+    /// @brief A file in the index. \struct File
+    struct File
+    {
+        int64_t modified; // Modification time in nanoseconds.
+        uint64_t size;
+        uint32_t pathOffset; // Offset of the path, relative to the root, in the path table.
+        uint32_t pathLength;
+    };
+
+    /**
+     * @brief Loads the index of a directory from the cache, if it was built before.
+     * @param root The directory, as an absolute and normalized path.
+     * @return The index, or null if there is none or it cannot be read.
+     */
+    static std::shared_ptr<const MexTrigramIndex> load(const std::filesystem::path& root);
+
+    /**
+     * @brief Builds the index of a directory, writes it to the cache and loads it.
+     * @param root The directory, as an absolute and normalized path.
+     * @param previous An older index of the same directory whose unchanged files are not read again, or null.
+     * @param threads The number of threads that read files, or 0 to use one per hardware thread.
+     * @param stop Abandons the build.
+     * @return The new index, or null if the build was stopped or the index could not be written.
+     */
+    static std::shared_ptr<const MexTrigramIndex> build(const std::filesystem::path& root, const MexTrigramIndex* previous,
+                                                        size_t threads, const std::stop_token& stop);
+
+    /**
+     * @brief Gets the path of the cache file that holds the index of a directory.
+     * @param root The directory, as an absolute and normalized path.
+     */
+    static std::filesystem::path cachePath(const std::filesystem::path& root);
+
+    /**
+     * @brief Finds the files that may contain a literal, ignoring case.
+     * @param literal The text to look for.
+     * @return The absolute paths of the files, or nothing if the literal is too short to narrow the search down.
+     */
+    std::optional<std::vector<std::string>> candidates(std::string_view literal) const;
+
+    /**
+     * @brief Gets the directory the index covers.
+     */
+    const std::string& getRoot() const { return root; }
+
+    /**
+     * @brief Gets the number of files in the index.
+     */
+    size_t fileCount() const { return files.size(); }
+
+private:
+    std::string root;
+    MexMappedFile mapping;
+    std::span<const File> files;
+    std::string_view paths;
+    std::span<const uint32_t> trigrams; // Sorted.
+    std::span<const uint64_t> postingOffsets; // One more than trigrams; the postings of trigram i end where i + 1 start.
+    std::string_view postings; // File numbers of each trigram, as variable-length deltas.
+
+    /**
+     * @brief Maps an index file and checks that it belongs to a directory.
+     * @param path The index file.
+     * @param root The directory.
+     * @return A boolean indicating whether the file is a valid index of the directory.
+     */
+    bool open(const std::filesystem::path& path, const std::string& root);
+
+    /**
+     * @brief Decodes the posting list of a trigram.
+     * @param index The position of the trigram in the trigram table.
+     * @param out The vector the numbers of the files that contain it are written to, in ascending order.
+     */
+    void decode(size_t index, std::vector<uint32_t>& out) const;
+
+    /**
+     * @brief Gets the path of a file in the index, relative to the root.
+     */
+    std::string_view path(const File& file) const { return paths.substr(file.pathOffset, file.pathLength); }
+};
+
+#endif //MEXEDIT_MEXTRIGRAMINDEX_H
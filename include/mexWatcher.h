@@ -0,0 +1,85 @@
+#ifndef MEXEDIT_MEXWATCHER_H
+#define MEXEDIT_MEXWATCHER_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// @brief MexWatcher reports changes to the explorer's directory and to the open file, using inotify. \class MexWatcher
+///
+/// The file is watched through its directory, so it is still followed when an editor replaces it by renaming
+/// a new file over it. The watcher only has a descriptor to wait on; nothing runs until the kernel reports an
+/// event. On systems without inotify it never reports anything.
+class MexWatcher
+{
+public:
+
+    /// @brief What changed. \enum Change
+    enum class Change
+    {
+        EntryAdded,   // An entry appeared in the directory.
+        EntryRemoved, // An entry left the directory.
+        FileChanged,  // The file was written or replaced.
+        FileRemoved,  // The file was deleted or renamed away.
+        Overflow      // Events were lost; everything has to be read again.
+    };
+
+    /// @brief A change reported by the kernel. \struct Event
+    struct Event
+    {
+        Change change;
+        std::string name; // The entry, for EntryAdded and EntryRemoved.
+    };
+
+    /**
+     * @brief Creates the inotify instance.
+     */
+    MexWatcher();
+
+    /**
+     * @brief Closes the inotify instance, which removes its watches.
+     */
+    ~MexWatcher();
+
+    MexWatcher(const MexWatcher&) = delete;
+    MexWatcher& operator=(const MexWatcher&) = delete;
+
+    /**
+     * @brief Watches a directory for entries being added and removed, instead of the previous one.
+     * @param directory The directory, or an empty path to stop watching.
+     */
+    void watchDirectory(const std::filesystem::path& directory);
+
+    /**
+     * @brief Watches a file for being written, replaced or removed, instead of the previous one.
+     * @param file The file, or an empty path to stop watching.
+     */
+    void watchFile(const std::filesystem::path& file);
+
+    /**
+     * @brief Gets the descriptor that becomes readable when there are events.
+     * @return The descriptor, or -1 without inotify.
+     */
+    int descriptor() const { return fd; }
+
+    /**
+     * @brief Reads the events that are ready, without blocking.
+     * @return The changes, in the order they happened.
+     */
+    std::vector<Event> readEvents();
+
+private:
+    int fd = -1;
+    std::string directory;
+    std::string fileDirectory;
+    std::string fileName;
+    int directoryWatch = -1;
+    int fileWatch = -1; // The same as directoryWatch when the file is in the watched directory.
+
+    /**
+     * @brief Replaces the watches with the ones the directory and the file need.
+     */
+    void updateWatches();
+};
+
+#endif //MEXEDIT_MEXWATCHER_H
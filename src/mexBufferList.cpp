@@ -0,0 +1,295 @@
+#include "../include/mexBufferList.h"
+#include "../include/mexMappedFile.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Swap files are named swap-<pid>-<number>, so the ones of editors that died can be told apart.
+    constexpr std::string_view swapPrefix = "swap-";
+
+    fs::path cacheDirectory()
+    {
+        fs::path directory;
+        if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache and *cache)
+        {
+            directory = cache;
+        }
+        else if (const char* home = std::getenv("HOME"); home and *home)
+        {
+            directory = fs::path(home) / ".cache";
+        }
+        else
+        {
+            std::error_code ec;
+            directory = fs::temp_directory_path(ec);
+        }
+        return directory / "mexEdit";
+    }
+}
+
+MexBufferList::MexBufferList() : swapDirectory(cacheDirectory())
+{
+    std::error_code ec;
+    for (fs::directory_iterator it(swapDirectory, ec), end; !ec and it != end; it.increment(ec))
+    {
+        std::string name = it->path().filename().string();
+        if (!name.starts_with(swapPrefix))
+        {
+            continue;
+        }
+
+        pid_t pid = static_cast<pid_t>(std::strtol(name.c_str() + swapPrefix.size(), nullptr, 10));
+        if (pid > 0 and kill(pid, 0) != 0 and errno == ESRCH)
+        {
+            std::error_code removeError;
+            fs::remove(it->path(), removeError);
+        }
+    }
+}
+
+MexBufferList::~MexBufferList()
+{
+    for (const Buffer& buffer : buffers)
+    {
+        if (buffer.residence == Residence::Swapped)
+        {
+            std::error_code ec;
+            fs::remove(buffer.swapFile, ec);
+        }
+    }
+}
+
+void MexBufferList::add(Buffer buffer)
+{
+    // A file still being indexed is counted at its size on disk, which is what the mapping will hold.
+    buffer.residence = Residence::Memory;
+    buffer.bytes = buffer.text.isLoading() ? static_cast<size_t>(buffer.savedFileSize) : buffer.text.byteCount();
+    buffers.insert(buffers.begin(), std::move(buffer));
+    enforceBudget();
+}
+
+std::optional<MexBufferList::Buffer> MexBufferList::take(size_t index)
+{
+    Buffer& buffer = buffers[index];
+    if (buffer.residence == Residence::Evicted)
+    {
+        if (!read(buffer.file, buffer.text))
+        {
+            // Nothing unsaved is lost with it.
+            buffers.erase(buffers.begin() + static_cast<std::ptrdiff_t>(index));
+            return std::nullopt;
+        }
+
+        std::error_code ec;
+        auto writeTime = fs::last_write_time(buffer.file, ec);
+        auto size = fs::file_size(buffer.file, ec);
+        if (writeTime != buffer.savedWriteTime or size != buffer.savedFileSize)
+        {
+            buffer.history.clear();
+            buffer.journal.start(buffer.file);
+            buffer.savedWriteTime = writeTime;
+            buffer.savedFileSize = size;
+        }
+        buffer.savedVersion = buffer.text.version();
+    }
+    else if (buffer.residence == Residence::Swapped)
+    {
+        if (!read(buffer.swapFile, buffer.text))
+        {
+            return std::nullopt;
+        }
+
+        // The text keeps the mapping of the swap file, which stays readable after the file is removed.
+        std::error_code ec;
+        fs::remove(buffer.swapFile, ec);
+        buffer.swapFile.clear();
+    }
+
+    else if (buffer.modified and buffer.text.detachChangedFiles())
+    {
+        // Its file was rewritten in place; an unmodified buffer is reloaded instead once it is switched to.
+        buffer.history.clear();
+    }
+
+    buffer.residence = Residence::Memory;
+    Buffer taken = std::move(buffer);
+    buffers.erase(buffers.begin() + static_cast<std::ptrdiff_t>(index));
+    return taken;
+}
+
+size_t MexBufferList::find(const fs::path& file) const
+{
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        if (!buffers[i].file.empty() and sameFile(buffers[i].file, file))
+        {
+            return i;
+        }
+    }
+    return buffers.size();
+}
+
+bool MexBufferList::save(size_t index, MexFileWriter::SyncPolicy policy)
+{
+    Buffer& buffer = buffers[index];
+    if (buffer.file.empty())
+    {
+        return false;
+    }
+    if (!buffer.modified)
+    {
+        return true;
+    }
+
+    MexTextBuffer swapped;
+    if (buffer.residence == Residence::Swapped and !read(buffer.swapFile, swapped))
+    {
+        return false;
+    }
+    if (buffer.residence == Residence::Memory and buffer.text.detachChangedFiles())
+    {
+        buffer.history.clear();
+    }
+    const MexTextBuffer& text = buffer.residence == Residence::Swapped ? swapped : buffer.text;
+    if (!write(buffer.file, text, policy))
+    {
+        return false;
+    }
+
+    std::error_code ec;
+    buffer.journal.start(buffer.file);
+    buffer.modified = false;
+    buffer.savedVersion = text.version();
+    buffer.savedWriteTime = fs::last_write_time(buffer.file, ec);
+    buffer.savedFileSize = fs::file_size(buffer.file, ec);
+    return true;
+}
+
+void MexBufferList::discardJournals()
+{
+    for (Buffer& buffer : buffers)
+    {
+        buffer.journal.discard();
+    }
+}
+
+size_t MexBufferList::residentBytes() const
+{
+    size_t total = 0;
+    for (const Buffer& buffer : buffers)
+    {
+        total += buffer.residence == Residence::Memory ? buffer.bytes : 0;
+    }
+    return total;
+}
+
+void MexBufferList::setByteBudget(size_t bytes)
+{
+    byteBudget = bytes;
+    enforceBudget();
+}
+
+void MexBufferList::enforceBudget()
+{
+    size_t total = residentBytes();
+    for (size_t i = buffers.size(); i-- > 0 and total > byteBudget;)
+    {
+        Buffer& buffer = buffers[i];
+        if (buffer.residence != Residence::Memory)
+        {
+            continue;
+        }
+
+        if (!buffer.modified and !buffer.file.empty())
+        {
+            buffer.residence = Residence::Evicted;
+        }
+        else if (!swapOut(buffer))
+        {
+            continue;
+        }
+        buffer.text.clear();
+        total -= buffer.bytes;
+    }
+}
+
+bool MexBufferList::swapOut(Buffer& buffer)
+{
+    std::error_code ec;
+    fs::create_directories(swapDirectory, ec);
+    std::string name = std::string(swapPrefix) + std::to_string(getpid()) + "-" + std::to_string(swapFiles++);
+    fs::path swapFile = swapDirectory / name;
+    if (buffer.text.detachChangedFiles())
+    {
+        buffer.history.clear();
+    }
+    // Swap files are read back at most once, in this session, so they are not synced.
+    if (!write(swapFile, buffer.text, MexFileWriter::SyncPolicy::None))
+    {
+        return false;
+    }
+
+    buffer.residence = Residence::Swapped;
+    buffer.swapFile = std::move(swapFile);
+    return true;
+}
+
+bool MexBufferList::write(const fs::path& file, const MexTextBuffer& text, MexFileWriter::SyncPolicy policy)
+{
+    MexFileWriter writer(policy);
+    if (!writer.open(file))
+    {
+        return false;
+    }
+
+    bool written = true;
+    text.forEachSpan([&](std::string_view span)
+    {
+        written = written and writer.write(span);
+    });
+    return written and writer.commit();
+}
+
+bool MexBufferList::read(const fs::path& file, MexTextBuffer& text)
+{
+    auto mapped = std::make_shared<MexMappedFile>();
+    if (mapped->open(file))
+    {
+        text.assign(std::move(mapped));
+        return true;
+    }
+
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    std::ostringstream content;
+    content << stream.rdbuf();
+    text.assign(std::move(content).str());
+    return true;
+}
+
+bool MexBufferList::sameFile(const fs::path& a, const fs::path& b)
+{
+    std::error_code ec;
+    fs::path first = fs::weakly_canonical(a, ec);
+    if (ec)
+    {
+        first = fs::absolute(a, ec).lexically_normal();
+    }
+    fs::path second = fs::weakly_canonical(b, ec);
+    if (ec)
+    {
+        second = fs::absolute(b, ec).lexically_normal();
+    }
+    return first == second;
+}
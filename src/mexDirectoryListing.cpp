@@ -0,0 +1,183 @@
+#include "../include/mexDirectoryListing.h"
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+    // The first batch is small so the explorer fills in at once; later ones grow, which keeps the number of
+    // merges into the sorted entries logarithmic in the size of the directory.
+    constexpr size_t firstBatch = 256;
+    constexpr size_t largestBatch = 65536;
+}
+
+void MexDirectoryListing::start(const std::filesystem::path& directory)
+{
+    // Destroying the thread stops and joins it.
+    worker = {};
+    this->directory = directory;
+    entries.clear();
+    pending.clear();
+    removedWhileListing.clear();
+
+    listing = true;
+    worker = std::jthread([this, path = directory.native()](std::stop_token stop)
+    {
+        list(path, stop);
+        listing.store(false, std::memory_order_release);
+    });
+}
+
+bool MexDirectoryListing::collectEntries()
+{
+    // Checked first: once the listing has finished, every batch is pending.
+    bool finished = !isListing();
+    std::vector<std::vector<Entry>> batches;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        batches.swap(pending);
+    }
+
+    for (auto& batch : batches)
+    {
+        if (!removedWhileListing.empty())
+        {
+            std::erase_if(batch, [this](const Entry& entry) { return removedWhileListing.contains(entry.name); });
+        }
+
+        size_t middle = entries.size();
+        entries.insert(entries.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        std::inplace_merge(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(middle), entries.end(), before);
+
+        // Entries added while the directory was listed can be listed as well.
+        auto same = [](const Entry& a, const Entry& b) { return a.directory == b.directory and a.name == b.name; };
+        entries.erase(std::unique(entries.begin(), entries.end(), same), entries.end());
+    }
+    if (finished)
+    {
+        removedWhileListing.clear();
+    }
+    return !batches.empty();
+}
+
+bool MexDirectoryListing::addEntry(const std::string& name)
+{
+    struct stat info{};
+    if (stat((directory / name).c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    removedWhileListing.erase(name);
+    Entry entry{name, S_ISDIR(info.st_mode)};
+    auto it = find(name);
+    if (it != entries.end())
+    {
+        if (it->directory == entry.directory)
+        {
+            return false;
+        }
+        entries.erase(it);
+    }
+    entries.insert(std::lower_bound(entries.begin(), entries.end(), entry, before), std::move(entry));
+    return true;
+}
+
+bool MexDirectoryListing::removeEntry(const std::string& name)
+{
+    if (isListing())
+    {
+        removedWhileListing.insert(name);
+    }
+
+    auto it = find(name);
+    if (it == entries.end())
+    {
+        return false;
+    }
+    entries.erase(it);
+    return true;
+}
+
+std::vector<MexDirectoryListing::Entry>::iterator MexDirectoryListing::find(const std::string& name)
+{
+    for (bool directory : {true, false})
+    {
+        Entry key{name, directory};
+        auto it = std::lower_bound(entries.begin(), entries.end(), key, before);
+        if (it != entries.end() and it->name == name and it->directory == directory)
+        {
+            return it;
+        }
+    }
+    return entries.end();
+}
+
+bool MexDirectoryListing::isListing() const
+{
+    return listing.load(std::memory_order_acquire);
+}
+
+bool MexDirectoryListing::before(const Entry& a, const Entry& b)
+{
+    if (a.directory != b.directory)
+    {
+        return a.directory;
+    }
+    return a.name < b.name;
+}
+
+void MexDirectoryListing::list(const std::string& path, const std::stop_token& stop)
+{
+    DIR* handle = opendir(path.c_str());
+    if (!handle)
+    {
+        return;
+    }
+
+    std::string prefix = path.ends_with('/') ? path : path + "/";
+    size_t batchSize = firstBatch;
+    std::vector<Entry> batch;
+    auto handOver = [&]()
+    {
+        std::sort(batch.begin(), batch.end(), before);
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.push_back(std::move(batch));
+        batch.clear();
+    };
+
+    while (dirent* entry = readdir(handle))
+    {
+        if (stop.stop_requested())
+        {
+            break;
+        }
+
+        std::string_view name = entry->d_name;
+        if (name == "." or name == "..")
+        {
+            continue;
+        }
+
+        // Symbolic links count as what they point to.
+        bool isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN or entry->d_type == DT_LNK)
+        {
+            struct stat info{};
+            isDirectory = stat((prefix + entry->d_name).c_str(), &info) == 0 and S_ISDIR(info.st_mode);
+        }
+
+        batch.push_back({std::string(name), isDirectory});
+        if (batch.size() >= batchSize)
+        {
+            handOver();
+            batchSize = std::min(batchSize * 2, largestBatch);
+        }
+    }
+    closedir(handle);
+
+    if (!batch.empty() and !stop.stop_requested())
+    {
+        handOver();
+    }
+}
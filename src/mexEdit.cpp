@@ -1,12 +1,30 @@
 #include "../include/mexEdit.h"
 #include <fstream>
+#include <sstream>
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t combineHash(size_t seed, size_t value)
+    {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+
+    // Documents at least this large are searched lazily, so a common pattern cannot exhaust memory.
+    constexpr size_t lazySearchBytes = 64 * 1024 * 1024;
+}
 
 MexEdit::MexEdit()
 {
     currentDirectory = fs::current_path();
-    document.emplace_back();
+    document.addListener(&history);
+    document.addListener(&syntaxHighlighter);
+    document.addListener(&searchEngine);
+    document.addListener(&journal);
     initscr();
     raw();
     keypad(stdscr, TRUE);
@@ -25,28 +43,11 @@ MexEdit::MexEdit()
     menu = MexMenu();
     menu.addMenuItem("Help", "F1", "Show help menu", [this]() { menu.showHelp(); });
     menu.addMenuItem("Save", "F2", "Save current file", [this]() { saveFile(); });
-    menu.addMenuItem("Open", "F3", "Open a file", [this]() {
-        if (!fileList.empty() && selectedFileIdx < static_cast<int>(fileList.size())) {
-            const auto& selected = fileList[selectedFileIdx];
-            if (selected.is_directory()) {
-                currentDirectory = selected.path();
-                updateFileExplorer();
-            } else {
-                loadFile(selected.path());
-            }
-        }
-    });
+    menu.addMenuItem("Open", "F3", "Open a file", [this]() { openSelectedEntry(); });
     menu.addMenuItem("Line Numbers", "F4", "Toggle line numbers", [this]() {
         showLineNumbers = !showLineNumbers;
     });
-    menu.addMenuItem("New", "F5", "Create new file", [this]() {
-        document.clear();
-        document.emplace_back();
-        currentFile.clear();
-        cursorX = 0;
-        cursorY = 0;
-        editorScroll = 0;
-    });
+    menu.addMenuItem("New", "F5", "Create new file", [this]() { newDocument(); });
     menu.addMenuItem("Save As", "F6", "Save file with new name", [this]() {
         char filename[256];
         mvprintw(0, 0, "Enter filename to save as: ");
@@ -60,6 +61,8 @@ MexEdit::MexEdit()
     });
     menu.addMenuItem("Quit", "F7", "Exit the editor", [this]() {
         if (promptSaveBeforeExit()) {
+            journal.discard();
+            buffers.discardJournals();
             endwin();
             exit(0);
         }
@@ -73,7 +76,7 @@ MexEdit::MexEdit()
         }
     });
     menu.addMenuItem("Next File", "F9", "Select next file", [this]() {
-        if (selectedFileIdx < static_cast<int>(fileList.size()) - 1) {
+        if (selectedFileIdx < static_cast<int>(fileList.getEntries().size()) - 1) {
             selectedFileIdx++;
             if (selectedFileIdx >= fileExplorerScroll + (LINES - 1)) {
                 fileExplorerScroll = selectedFileIdx - (LINES - 1) + 1;
@@ -91,38 +94,166 @@ MexEdit::~MexEdit()
 
 void MexEdit::expandDocument(size_t newSize)
 {
-    if (newSize > document.size())
+    while (newSize > 0 and !document.hasLine(newSize - 1))
     {
-        document.resize(newSize);
+        document.insertLine(document.lineCount(), {});
     }
 }
 
 bool MexEdit::loadFile(const fs::path& fileName)
 {
-    std::ifstream file(fileName);
-    if (!file.is_open())
+    // A file that is open in another buffer is switched to, with its edits, history and cursor.
+    bool reload = !currentFile.empty() and MexBufferList::sameFile(fileName, currentFile);
+    if (!reload)
+    {
+        size_t index = buffers.find(fileName);
+        if (index < buffers.getBuffers().size())
+        {
+            return switchToBuffer(index);
+        }
+    }
+
+    MexTextBuffer text;
+    if (!MexBufferList::read(fileName, text))
     {
         return false;
     }
+    // Read before markSaved() starts the journal over.
+    MexJournal::Recovery recovery = reload ? MexJournal::Recovery{} : MexJournal::recover(fileName);
+    if (!reload)
+    {
+        parkBuffer();
+    }
+    document.adopt(text);
 
-    document.clear();
-    std::string line;
-    while (std::getline(file, line))
+    history.clear();
+    searchEngine.clearMatches();
+    currentFile = fileName;
+    watcher.watchFile(currentFile);
+    diskNotice.clear();
+    markSaved();
+    cursorX = 0;
+    cursorY = 0;
+    editorScroll = 0;
+    syntaxHighlighter.detectLanguage(currentFile.string());
+    invalidateScreen();
+    if (recovery.found)
     {
-        document.push_back(line);
+        offerRecovery(recovery);
     }
 
-    if (document.empty())
+    return true;
+}
+
+void MexEdit::offerRecovery(const MexJournal::Recovery& recovery)
+{
+    std::string name = currentFile.filename().string();
+    if (recovery.matchesFile)
+    {
+        mvprintw(0, 0, "%s has %zu unsaved edits from a session that ended early. Recover them? (y/n): ", name.c_str(), recovery.edits.size());
+    }
+    else
     {
-        document.emplace_back();
+        mvprintw(0, 0, "%s changed since its %zu unsaved edits were journaled. Recover them anyway? (y/n): ", name.c_str(), recovery.edits.size());
+    }
+    echo();
+    int answer = getch();
+    noecho();
+    clear();
+    if (answer != 'y' and answer != 'Y')
+    {
+        return;
     }
 
-    currentFile = fileName;
+    // The edits are journaled again as they are applied, and undone together.
+    history.beginGroup();
+    size_t applied = MexJournal::replay(recovery.edits, document);
+    history.endGroup();
+    journal.flush();
+    showSearchStatus("Recovered " + std::to_string(applied) + " of " + std::to_string(recovery.edits.size()) + " edits");
+}
+
+void MexEdit::parkBuffer()
+{
+    if (currentFile.empty() and document.isEmpty())
+    {
+        history.clear();
+        return;
+    }
+
+    MexBufferList::Buffer parked;
+    parked.file = currentFile;
+    parked.text = document.snapshot();
+    parked.history.swap(history);
+    journal.flush();
+    parked.journal.swap(journal);
+    parked.modified = document.version() != savedVersion;
+    parked.savedVersion = savedVersion;
+    parked.savedWriteTime = savedWriteTime;
+    parked.savedFileSize = savedFileSize;
+    parked.cursorX = cursorX;
+    parked.cursorY = cursorY;
+    parked.editorScroll = editorScroll;
+    if (searchEngine.hasCurrentMatch())
+    {
+        auto match = searchEngine.getCurrentMatch();
+        parked.searchPattern = searchEngine.getLastPattern();
+        parked.matchLine = match.first;
+        parked.matchColumn = match.second.first;
+    }
+    searchEngine.clearMatches();
+    buffers.add(std::move(parked));
+}
+
+void MexEdit::newDocument()
+{
+    parkBuffer();
+    // The parked document took its journal along; nothing typed into a document without a file is journaled.
+    journal.detach();
+    document.clear();
+    history.clear();
+    syntaxHighlighter.resetLineStates();
+    searchEngine.clearMatches();
+    currentFile.clear();
+    watcher.watchFile({});
+    diskNotice.clear();
     cursorX = 0;
     cursorY = 0;
     editorScroll = 0;
+    invalidateScreen();
+}
+
+bool MexEdit::switchToBuffer(size_t index)
+{
+    std::optional<MexBufferList::Buffer> buffer = buffers.take(index);
+    if (!buffer)
+    {
+        return false;
+    }
+
+    parkBuffer();
+    document.adopt(buffer->text);
+    history.swap(buffer->history);
+    journal.swap(buffer->journal);
+    currentFile = buffer->file;
+    savedVersion = buffer->savedVersion;
+    savedWriteTime = buffer->savedWriteTime;
+    savedFileSize = buffer->savedFileSize;
+    cursorX = buffer->cursorX;
+    cursorY = buffer->cursorY;
+    editorScroll = buffer->editorScroll;
+    watcher.watchFile(currentFile);
+    diskNotice.clear();
     syntaxHighlighter.detectLanguage(currentFile.string());
+    if (!buffer->searchPattern.empty())
+    {
+        searchEngine.setLazyMode(document.isLoading() or document.byteCount() >= lazySearchBytes);
+        searchEngine.find(buffer->searchPattern, document, buffer->matchLine, buffer->matchColumn);
+    }
 
+    // The file may have changed on disk while another one was edited.
+    reloadIfChanged();
+    invalidateScreen();
     return true;
 }
 
@@ -134,188 +265,871 @@ bool MexEdit::saveFile(const fs::path& filename)
         return false;
     }
 
-    std::ofstream file(savePath);
-    if (!file.is_open())
+    if (savePath == currentFile and matchesDisk())
+    {
+        return true;
+    }
+
+    // Written in place by someone else, the mapping may have lost its end: what is left is saved, not zeros.
+    detachFromChangedFile();
+
+    // The document may still reference a mapping of savePath, so the file is replaced by
+    // renaming a new one over it instead of being truncated and rewritten in place.
+    MexFileWriter writer(syncPolicy);
+    if (!writer.open(savePath))
     {
         return false;
     }
 
-    for (const auto& line : document)
+    bool written = true;
+    document.forEachSpan([&](std::string_view span)
     {
-        file << line << '\n';
+        written = written and writer.write(span);
+    });
+
+    if (!written or !writer.commit())
+    {
+        return false;
     }
 
     if (!filename.empty())
     {
         currentFile = savePath;
+        watcher.watchFile(currentFile);
         syntaxHighlighter.detectLanguage(currentFile.string());
+        invalidateScreen();
+    }
+
+    if (savePath == currentFile)
+    {
+        markSaved();
+        diskNotice.clear();
     }
 
     return true;
 }
 
+void MexEdit::markSaved()
+{
+    std::error_code ec;
+    savedVersion = document.version();
+    savedWriteTime = fs::last_write_time(currentFile, ec);
+    savedFileSize = fs::file_size(currentFile, ec);
+    journal.start(currentFile);
+}
+
+bool MexEdit::matchesDisk() const
+{
+    return document.version() == savedVersion and diskUnchanged();
+}
+
+bool MexEdit::diskUnchanged() const
+{
+    std::error_code ec;
+    auto writeTime = fs::last_write_time(currentFile, ec);
+    if (ec or writeTime != savedWriteTime)
+    {
+        return false;
+    }
+
+    auto size = fs::file_size(currentFile, ec);
+    return !ec and size == savedFileSize;
+}
+
 void MexEdit::updateFileExplorer()
 {
-    fileList.clear();
-    for (const auto& entry : fs::directory_iterator(currentDirectory))
+    // Watched first, so nothing added while the directory is listed is missed.
+    watcher.watchDirectory(currentDirectory);
+    fileList.start(currentDirectory);
+    selectedFileIdx = 0;
+    fileExplorerScroll = 0;
+}
+
+void MexEdit::updateExplorerEntries(const std::function<bool()>& change)
+{
+    const auto& entries = fileList.getEntries();
+    MexDirectoryListing::Entry selected{};
+    bool moved = selectedFileIdx > 0 and selectedFileIdx < static_cast<int>(entries.size());
+    if (moved)
+    {
+        selected = entries[selectedFileIdx];
+    }
+    if (!change())
+    {
+        return;
+    }
+
+    // Entries sorted before the selected one push it down; follow it, on the same row of the explorer. If it
+    // was removed, the entry after it is selected.
+    if (moved)
     {
-        fileList.push_back(entry);
+        int row = selectedFileIdx - fileExplorerScroll;
+        selectedFileIdx = static_cast<int>(std::lower_bound(entries.begin(), entries.end(), selected, MexDirectoryListing::before) - entries.begin());
+        fileExplorerScroll = std::max(0, selectedFileIdx - row);
     }
+    selectedFileIdx = std::max(0, std::min(selectedFileIdx, static_cast<int>(entries.size()) - 1));
+    fileExplorerScroll = std::min(fileExplorerScroll, selectedFileIdx);
+}
 
-    std::sort(fileList.begin(), fileList.end(), [](const auto& a, const auto& b)
+void MexEdit::openSelectedEntry()
+{
+    const auto& entries = fileList.getEntries();
+    if (selectedFileIdx >= static_cast<int>(entries.size()))
     {
-        bool aIsDir = a.is_directory();
-        bool bIsDir = b.is_directory();
-        if (aIsDir not_eq bIsDir)
-        {
-            return aIsDir;
-        }
+        return;
+    }
 
-        return a.path().filename().string() < b.path().filename().string();
-    });
+    const auto& selected = entries[selectedFileIdx];
+    if (selected.directory)
+    {
+        currentDirectory /= selected.name;
+        updateFileExplorer();
+    }
+    else
+    {
+        loadFile(currentDirectory / selected.name);
+    }
+}
 
-    selectedFileIdx = 0;
-    fileExplorerScroll = 0;
+void MexEdit::invalidateScreen()
+{
+    screenValid = false;
 }
 
 void MexEdit::drawInterface()
 {
-    erase();
     int maxY, maxX;
     getmaxyx(stdscr, maxY, maxX);
 
-    if (searchMode)
+    if (maxY != screenRows or maxX != screenColumns)
     {
-        mvprintw(maxY -1, 0, "/%s", searchString.c_str());
+        screenRows = maxY;
+        screenColumns = maxX;
+        screenValid = false;
     }
 
-    attron(COLOR_PAIR(1));
-    int explorerEnd = fileExplorerWidth;
-    for (int i = 0; i < maxY; ++i)
+    // Rows are only repainted when their key changes. A key of zero stands for a blank row.
+    if (!screenValid)
     {
-        mvhline(i, explorerEnd, ACS_VLINE, 1);
+        erase();
+        explorerRowKeys.assign(maxY, 0);
+        editorRowKeys.assign(maxY, 0);
+        statusKey = 0;
+
+        attron(COLOR_PAIR(1));
+        for (int i = 0; i < maxY - 1; ++i)
+        {
+            mvhline(i, fileExplorerWidth, ACS_VLINE, 1);
+        }
+        attroff(COLOR_PAIR(1));
+        screenValid = true;
     }
 
-    int fileToShow = std::min(maxY - 1, static_cast<int>(fileList.size()) - fileExplorerScroll);
-    for (int i = 0; i < fileToShow; ++i)
+    const auto& entries = fileList.getEntries();
+    int fileToShow = std::min(maxY - 1, static_cast<int>(entries.size()) - fileExplorerScroll);
+    for (int i = 0; i < maxY - 1; ++i)
     {
-        const auto& entry = fileList[i + fileExplorerScroll];
-        bool isSelected = (i + fileExplorerScroll == selectedFileIdx);
+        std::string displayName;
+        bool isSelected = false;
+        size_t key = 0;
+        if (i < fileToShow)
+        {
+            const auto& entry = entries[i + fileExplorerScroll];
+            isSelected = (i + fileExplorerScroll == selectedFileIdx);
 
+            displayName = entry.name;
+            if (entry.directory)
+            {
+                displayName.append("/");
+            }
+
+            if (displayName.length() > static_cast<size_t>(fileExplorerWidth - 2))
+            {
+                displayName = displayName.substr(0, fileExplorerWidth - 5) + "...";
+            }
+
+            key = combineHash(std::hash<std::string>{}(displayName), isSelected) | 1;
+        }
+
+        if (key == explorerRowKeys[i])
+        {
+            continue;
+        }
+        explorerRowKeys[i] = key;
+
+        mvhline(i, 0, ' ', fileExplorerWidth);
+        if (key != 0)
+        {
+            attron(COLOR_PAIR(1));
+            if (isSelected)
+            {
+                attron(A_REVERSE);
+            }
+
+            mvprintw(i, 1, "%s", displayName.c_str());
+
+            if (isSelected)
+            {
+                attroff(A_REVERSE);
+            }
+            attroff(COLOR_PAIR(1));
+        }
+    }
+
+    int editorStart = fileExplorerWidth + 1;
+    int editorWidth = maxX - editorStart;
+    int linesToShow = 0;
+    if (resultsMode)
+    {
+        drawResults(editorStart, editorWidth, maxY - 1);
+    }
+    else if (finderMode)
+    {
+        drawFinder(editorStart, editorWidth, maxY - 1);
+    }
+    else if (buffersMode)
+    {
+        drawBuffers(editorStart, editorWidth, maxY - 1);
+    }
+    else
+    {
+        linesToShow = drawDocument(editorStart, editorWidth, maxY);
+    }
+
+    std::string status;
+    if (resultsMode)
+    {
+        const auto& results = projectSearch.getResults();
+        status = "grep " + projectSearch.getPattern() + ": " + std::to_string(projectSearch.matchCount()) + " matches in " +
+                 std::to_string(projectSearch.fileCount()) + " files";
+        if (results.size() < projectSearch.matchCount() and !projectSearch.isSearching())
+        {
+            status += " (first " + std::to_string(results.size()) + " listed)";
+        }
+        status += projectSearch.usedIndex() ? " (indexed)" : "";
+        status += projectSearch.isSearching() ? " [searching]" : "";
+        status += " | Enter:Open ESC:Close";
+    }
+    else if (finderMode)
+    {
+        status = "open: " + std::to_string(fileFinder.matchCount()) + " of " + std::to_string(fileFinder.pathCount()) + " files";
+        status += fileFinder.isIndexing() ? " [indexing]" : "";
+        status += " | Enter:Open ESC:Close";
+    }
+    else if (buffersMode)
+    {
+        constexpr size_t mebibyte = 1024 * 1024;
+        status = "buffers: " + std::to_string(buffers.getBuffers().size()) + " other files open, " +
+                 std::to_string((buffers.residentBytes() + mebibyte - 1) / mebibyte) + " of " +
+                 std::to_string(buffers.getByteBudget() / mebibyte) + " MiB in memory | Enter:Switch ESC:Close";
+    }
+    else if (searchMode)
+    {
+        status = "/" + searchString;
+        if (searchEngine.isSearching())
+        {
+            status += "   [searching]";
+        }
+        else if (!searchString.empty())
+        {
+            status += "   [" + searchEngine.matchCountText() + " matches]";
+        }
+    }
+    else
+    {
+        status = currentFile.empty() ? "[No File]" : currentFile.filename().string();
+        status += " - " + std::to_string(cursorY + 1) + "," + std::to_string(cursorX + 1);
+        if (document.isLoading())
+        {
+            status += " [indexing]";
+        }
+        if (!diskNotice.empty())
+        {
+            status += " [" + diskNotice + "]";
+        }
+        if (fileList.isListing())
+        {
+            status += " [listing " + std::to_string(fileList.getEntries().size()) + " entries]";
+        }
+        if (searchEngine.hasCurrentMatch())
+        {
+            status += " | /" + searchEngine.getLastPattern() + ": " + searchEngine.matchCountText() + " matches";
+        }
+        status += " | F1:Help ESC:Menu";
+    }
+
+    size_t key = std::hash<std::string>{}(status) | 1;
+    if (key != statusKey)
+    {
+        statusKey = key;
+        attron(COLOR_PAIR(3) | A_REVERSE);
+        mvprintw(maxY - 1, 0, "%-*s", maxX, status.c_str());
+        attroff(COLOR_PAIR(3) | A_REVERSE);
+    }
+
+    if (resultsMode)
+    {
+        move(std::max(selectedResult - resultsScroll, 0), editorStart);
+    }
+    else if (finderMode)
+    {
+        move(0, std::min(editorStart + 2 + static_cast<int>(finderQuery.size()), maxX - 1));
+    }
+    else if (buffersMode)
+    {
+        move(std::max(selectedBuffer - buffersScroll, 0), editorStart);
+    }
+    else if (searchMode)
+    {
+        move(maxY - 1, std::min(static_cast<int>(searchString.size()) + 1, maxX - 1));
+    }
+    else if (cursorY >= editorScroll and cursorY < editorScroll + linesToShow)
+    {
+        int lineIndex = cursorY - editorScroll;
+        int lineStart = showLineNumbers ? editorStart + 5 : editorStart;
+        int cursorPos = std::min(cursorX, static_cast<int>(document.lineLength(cursorY)));
+        move(lineIndex, lineStart + cursorPos);
+    }
+
+    refresh();
+}
+
+int MexEdit::drawDocument(int editorStart, int editorWidth, int maxY)
+{
+    int linesToShow = 0;
+    while (linesToShow < maxY - 2 and document.hasLine(editorScroll + linesToShow))
+    {
+        linesToShow++;
+    }
+
+    syntaxHighlighter.updateLineStates(document, editorScroll + linesToShow);
+    searchEngine.refreshMatches(document, editorScroll, editorScroll + linesToShow);
+
+    std::vector<std::pair<int, int>> rowMatches;
+    for (int i = 0; i < maxY - 1; ++i)
+    {
+        int lineNum = i + editorScroll;
+        std::string_view line;
+        int lineLength = 0;
+        size_t key = 0;
+        rowMatches.clear();
+
+        if (i < linesToShow)
+        {
+            line = document.line(lineNum);
+            lineLength = std::min(static_cast<int>(line.size()), editorWidth - (showLineNumbers ? 5 : 0));
+
+            for (const auto& match : searchEngine.matchesInLines(lineNum, lineNum + 1))
+            {
+                int start = match.second.first;
+                int end = match.second.second;
+
+                if (start < lineLength and end <= lineLength)
+                {
+                    rowMatches.emplace_back(start, end);
+                }
+            }
+
+            key = std::hash<std::string_view>{}(line.substr(0, std::max(lineLength, 0)));
+            key = combineHash(key, showLineNumbers ? static_cast<size_t>(lineNum) + 1 : 0);
+            key = combineHash(key, syntaxHighlighter.lineState(lineNum));
+            for (const auto& [start, end] : rowMatches)
+            {
+                key = combineHash(combineHash(key, start), end);
+            }
+            key |= 1;
+        }
+
+        if (key == editorRowKeys[i])
+        {
+            continue;
+        }
+        editorRowKeys[i] = key;
+
+        move(i, editorStart);
+        clrtoeol();
+        if (key == 0)
+        {
+            continue;
+        }
+
+        int lineStart = showLineNumbers ? editorStart + 5 : editorStart;
+        if (showLineNumbers)
+        {
+            attron(COLOR_PAIR(2));
+            mvprintw(i, editorStart, "%4d ", lineNum + 1);
+            attroff(COLOR_PAIR(2));
+        }
+
+        if (lineLength > 0)
+        {
+            syntaxHighlighter.highlightLine(line.substr(0, lineLength), lineNum, i, lineStart);
+        }
+
+        for (const auto& [start, end] : rowMatches)
+        {
+            attron(A_REVERSE);
+            mvprintw(i, lineStart + start, "%.*s", end - start, line.data() + start);
+            attroff(A_REVERSE);
+        }
+    }
+
+    return linesToShow;
+}
+
+void MexEdit::drawResults(int editorStart, int editorWidth, int rows)
+{
+    const auto& results = projectSearch.getResults();
+    for (int i = 0; i < rows; ++i)
+    {
+        int index = i + resultsScroll;
+        std::string location;
+        std::string_view preview;
+        size_t column = 0;
+        size_t length = 0;
+        size_t key = 0;
+        if (index < static_cast<int>(results.size()))
+        {
+            const auto& result = results[index];
+            location = result.file.lexically_relative(projectSearch.getRoot()).string() + ":" + std::to_string(result.line + 1) + ": ";
+            preview = result.preview;
+            column = std::min(result.column, preview.size());
+            length = std::min(result.length, preview.size() - column);
+            key = combineHash(std::hash<std::string>{}(location), std::hash<std::string_view>{}(preview));
+            key = combineHash(combineHash(key, column), index == selectedResult) | 1;
+        }
+
+        if (key == editorRowKeys[i])
+        {
+            continue;
+        }
+        editorRowKeys[i] = key;
+
+        move(i, editorStart);
+        clrtoeol();
+        if (key == 0)
+        {
+            continue;
+        }
+
+        bool isSelected = index == selectedResult;
         if (isSelected)
         {
             attron(A_REVERSE);
         }
 
-        std::string displayName = entry.path().filename().string();
-        if (entry.is_directory())
+        // The location, then the line with the match in bold, cut to the width of the editor.
+        int width = editorWidth;
+        auto print = [&](std::string_view text)
         {
-            displayName.append("/");
+            int count = std::min(static_cast<int>(text.size()), std::max(width, 0));
+            addnstr(text.data(), count);
+            width -= count;
+        };
+        attron(COLOR_PAIR(1));
+        print(location);
+        attroff(COLOR_PAIR(1));
+        print(preview.substr(0, column));
+        attron(A_BOLD);
+        print(preview.substr(column, length));
+        attroff(A_BOLD);
+        print(preview.substr(column + length));
+
+        if (isSelected)
+        {
+            attroff(A_REVERSE);
         }
+    }
+}
 
-        if (displayName.length() > static_cast<size_t>(fileExplorerWidth - 2))
+void MexEdit::drawFinder(int editorStart, int editorWidth, int rows)
+{
+    const auto& matches = fileFinder.getResults();
+    for (int i = 0; i < rows; ++i)
+    {
+        // The query takes the first row, the matches the rest.
+        int index = i - 1 + matchesScroll;
+        std::string_view path;
+        std::vector<size_t> positions;
+        size_t key = 0;
+        if (i == 0)
+        {
+            key = std::hash<std::string>{}(finderQuery) | 1;
+        }
+        else if (index < static_cast<int>(matches.size()))
         {
-            displayName = displayName.substr(0, fileExplorerWidth - 5) + "...";
+            path = fileFinder.path(matches[index].path);
+            positions = fileFinder.matchPositions(matches[index].path);
+            key = std::hash<std::string_view>{}(path);
+            for (size_t position : positions)
+            {
+                key = combineHash(key, position);
+            }
+            key = combineHash(key, index == selectedMatch) | 1;
         }
 
-        mvprintw(i, 1, "%s", displayName.c_str());
+        if (key == editorRowKeys[i])
+        {
+            continue;
+        }
+        editorRowKeys[i] = key;
 
+        move(i, editorStart);
+        clrtoeol();
+        if (i == 0)
+        {
+            attron(COLOR_PAIR(1));
+            printw("> %.*s", std::max(editorWidth - 2, 0), finderQuery.c_str());
+            attroff(COLOR_PAIR(1));
+            continue;
+        }
+        if (key == 0)
+        {
+            continue;
+        }
+
+        // The path, with the letters of the query in bold, cut to the width of the editor.
+        bool isSelected = index == selectedMatch;
+        if (isSelected)
+        {
+            attron(A_REVERSE);
+        }
+        size_t next = 0;
+        for (size_t column = 0; column < path.size() and column < static_cast<size_t>(std::max(editorWidth, 0)); ++column)
+        {
+            bool matched = next < positions.size() and positions[next] == column;
+            if (matched)
+            {
+                attron(A_BOLD);
+                next++;
+            }
+            addch(static_cast<unsigned char>(path[column]));
+            if (matched)
+            {
+                attroff(A_BOLD);
+            }
+        }
+        if (isSelected)
+        {
+            attroff(A_REVERSE);
+        }
+    }
+}
+
+void MexEdit::drawBuffers(int editorStart, int editorWidth, int rows)
+{
+    const auto& list = buffers.getBuffers();
+    for (int i = 0; i < rows; ++i)
+    {
+        int index = i + buffersScroll;
+        std::string row;
+        size_t key = 0;
+        if (index < static_cast<int>(list.size()))
+        {
+            // A '*' marks unsaved edits; text that is not in memory is read back when the file is switched to.
+            const auto& buffer = list[index];
+            row = buffer.modified ? "* " : "  ";
+            row += buffer.file.empty() ? "[No File]" : buffer.file.string();
+            if (buffer.residence == MexBufferList::Residence::Evicted)
+            {
+                row += "  (on disk)";
+            }
+            else if (buffer.residence == MexBufferList::Residence::Swapped)
+            {
+                row += "  (swapped out)";
+            }
+            key = combineHash(std::hash<std::string>{}(row), index == selectedBuffer) | 1;
+        }
+
+        if (key == editorRowKeys[i])
+        {
+            continue;
+        }
+        editorRowKeys[i] = key;
+
+        move(i, editorStart);
+        clrtoeol();
+        if (key == 0)
+        {
+            continue;
+        }
+
+        bool isSelected = index == selectedBuffer;
+        if (isSelected)
+        {
+            attron(A_REVERSE);
+        }
+        addnstr(row.c_str(), std::min(static_cast<int>(row.size()), std::max(editorWidth, 0)));
         if (isSelected)
         {
             attroff(A_REVERSE);
         }
     }
+}
+
+void MexEdit::showSearchStatus(const std::string &message)
+{
+    int maxY, maxX;
+    getmaxyx(stdscr, maxY, maxX);
+    attron(COLOR_PAIR(3) | A_REVERSE);
+    mvprintw(maxY - 1, 0, "%-*s", maxX, message.c_str());
+    attroff(COLOR_PAIR(3) | A_REVERSE);
+    refresh();
+    napms(1000);
+    statusKey = 0;
+}
+
+void MexEdit::showIncrementalMatch()
+{
+    if (!searchEngine.hasCurrentMatch())
+    {
+        cursorX = searchOriginX;
+        cursorY = searchOriginY;
+        editorScroll = searchOriginScroll;
+        return;
+    }
+
+    cursorY = searchEngine.getCurrentMatch().first;
+    cursorX = searchEngine.getCurrentMatch().second.first;
+    editorScroll = std::max(0, static_cast<int>(cursorY) - LINES / 2);
+}
+
+void MexEdit::performReplace(const std::string &replacement, bool all)
+{
+    if (all)
+    {
+        history.beginGroup();
+        size_t replaced = searchEngine.replaceAll(searchEngine.getLastPattern(), replacement, document);
+        history.endGroup();
+        showSearchStatus("Replaced " + std::to_string(replaced) + " occurrences.");
+    }
+    else
+    {
+        saveState();
+        searchEngine.replaceCurrent(replacement, document);
+        if (searchEngine.findNext(document))
+        {
+            const auto& matches = searchEngine.getMatches();
+            cursorY = searchEngine.getCurrentMatch().first;
+            cursorX = searchEngine.getCurrentMatch().second.first;
+            editorScroll = std::max(0, static_cast<int>(cursorY) - LINES / 2);
+        }
+    }
+}
+
+void MexEdit::startProjectSearch(const std::string& pattern)
+{
+    projectSearch.setCaseSensitive(searchEngine.isCaseSensitive());
+    projectSearch.setWholeWord(searchEngine.isWholeWord());
+    projectSearch.setRegexMode(searchEngine.isRegexMode());
+    projectSearch.setThreadCount(searchEngine.getThreadCount());
+    if (!projectSearch.start(currentDirectory, pattern))
+    {
+        showSearchStatus("Invalid search pattern: " + pattern);
+        return;
+    }
+
+    resultsMode = true;
+    selectedResult = 0;
+    resultsScroll = 0;
+    invalidateScreen();
+}
+
+void MexEdit::handleResultsInput(int ch)
+{
+    int count = static_cast<int>(projectSearch.getResults().size());
+    int rows = LINES - 1;
+    switch (ch)
+    {
+        case 27:
+            resultsMode = false;
+            invalidateScreen();
+            return;
+        case KEY_ENTER:
+        case '\n':
+            openSelectedResult();
+            return;
+        case KEY_UP:
+            selectedResult--;
+            break;
+        case KEY_DOWN:
+            selectedResult++;
+            break;
+        case KEY_PPAGE:
+            selectedResult -= rows;
+            break;
+        case KEY_NPAGE:
+            selectedResult += rows;
+            break;
+        default:
+            return;
+    }
 
-    attroff(COLOR_PAIR(1));
-
-    int editorStart = fileExplorerWidth + 1;
-    int editorWidth = maxX - editorStart;
-    int linesToShow = std::min(maxY - 2, static_cast<int>(document.size()) - editorScroll);
+    selectedResult = std::max(0, std::min(selectedResult, count - 1));
+    if (selectedResult < resultsScroll)
+    {
+        resultsScroll = selectedResult;
+    }
+    else if (selectedResult >= resultsScroll + rows)
+    {
+        resultsScroll = selectedResult - rows + 1;
+    }
+}
 
+void MexEdit::openSelectedResult()
+{
+    const auto& results = projectSearch.getResults();
+    if (selectedResult >= static_cast<int>(results.size()))
+    {
+        return;
+    }
 
-    for (int i = 0; i < linesToShow; ++i)
+    const auto& result = results[selectedResult];
+    if (result.file != currentFile and !loadFile(result.file))
     {
-        int lineNum = i + editorScroll;
-        const auto& line = document[lineNum];
-        int lineStart = showLineNumbers ? editorStart + 5 : editorStart;
-        int lineLength = std::min(static_cast<int>(line.size()), editorWidth - (showLineNumbers ? 5 : 0));
+        showSearchStatus("Failed to open " + result.file.string());
+        return;
+    }
 
-        if (showLineNumbers)
-        {
-            attron(COLOR_PAIR(2));
-            mvprintw(i, editorStart, "%4d ", lineNum + 1);
-            attroff(COLOR_PAIR(2));
-        }
+    // Highlight the pattern in the file, with the opened match as the current one.
+    searchEngine.setLazyMode(document.isLoading() or document.byteCount() >= lazySearchBytes);
+    searchEngine.find(projectSearch.getPattern(), document, result.line, result.column);
+    cursorY = static_cast<int>(result.line);
+    cursorX = static_cast<int>(result.column);
+    editorScroll = std::max(0, cursorY - LINES / 2);
+    resultsMode = false;
+    invalidateScreen();
+}
 
-        if (lineLength > 0)
-        {
-            syntaxHighlighter.highlightLine(line, i, lineStart);
-        }
+void MexEdit::startFinder()
+{
+    // The tree is walked again each time, so files created since the last time are found; paths show up as
+    // they are found.
+    fileFinder.setThreadCount(searchEngine.getThreadCount());
+    fileFinder.start(currentDirectory);
+    finderQuery.clear();
+    fileFinder.setQuery(finderQuery);
+    finderMode = true;
+    selectedMatch = 0;
+    matchesScroll = 0;
+    invalidateScreen();
+}
 
-        for (const auto& match : searchEngine.getMatches())
-        {
-            if (match.first == static_cast<size_t>(lineNum))
+void MexEdit::handleFinderInput(int ch)
+{
+    int count = static_cast<int>(fileFinder.getResults().size());
+    int rows = LINES - 2;
+    switch (ch)
+    {
+        case 27:
+            finderMode = false;
+            invalidateScreen();
+            return;
+        case KEY_ENTER:
+        case '\n':
+            if (selectedMatch < count)
             {
-                int start = match.second.first;
-                int end = match.second.second;
-
-                if (start < lineLength and end <= lineLength)
+                fs::path file = fileFinder.getRoot() / fileFinder.path(fileFinder.getResults()[selectedMatch].path);
+                if (!loadFile(file))
                 {
-                    attron(A_REVERSE);
-                    mvprintw(i, lineStart + start, "%.*s", end - start, line.substr(start, end - start).c_str());
-                    attroff(A_REVERSE);
+                    showSearchStatus("Failed to open " + file.string());
                 }
+                finderMode = false;
+                invalidateScreen();
             }
-        }
+            return;
+        case KEY_UP:
+            selectedMatch--;
+            break;
+        case KEY_DOWN:
+            selectedMatch++;
+            break;
+        case KEY_PPAGE:
+            selectedMatch -= rows;
+            break;
+        case KEY_NPAGE:
+            selectedMatch += rows;
+            break;
+        case KEY_BACKSPACE:
+        case 127:
+            if (finderQuery.empty())
+            {
+                return;
+            }
+            finderQuery.pop_back();
+            fileFinder.setQuery(finderQuery);
+            selectedMatch = 0;
+            break;
+        default:
+            if (ch < 0 or ch > 255 or !isprint(ch))
+            {
+                return;
+            }
+            finderQuery += static_cast<char>(ch);
+            fileFinder.setQuery(finderQuery);
+            selectedMatch = 0;
+            break;
     }
 
-    attron(COLOR_PAIR(3) | A_REVERSE);
-    std::string status = currentFile.empty() ? "[No File]" : currentFile.filename().string();
-    status += " - " + std::to_string(cursorY + 1) + "," + std::to_string(cursorX + 1);
-    status += " | F1:Help ESC:Menu";
-    mvprintw(maxY - 1, 0, "%-*s", maxX, status.c_str());
-    attroff(COLOR_PAIR(3) | A_REVERSE);
-
-    if (cursorY >= editorScroll and cursorY < editorScroll + linesToShow)
+    count = static_cast<int>(fileFinder.getResults().size());
+    selectedMatch = std::max(0, std::min(selectedMatch, count - 1));
+    if (selectedMatch < matchesScroll)
     {
-        int lineIndex = cursorY - editorScroll;
-        const auto& line = document[cursorY];
-        int lineStart = showLineNumbers ? editorStart + 5 : editorStart;
-        int cursorPos = std::min(cursorX, static_cast<int>(line.size()));
-        move(lineIndex, lineStart + cursorPos);
+        matchesScroll = selectedMatch;
+    }
+    else if (selectedMatch >= matchesScroll + rows)
+    {
+        matchesScroll = selectedMatch - rows + 1;
     }
-
-    refresh();
 }
 
-void MexEdit::showSearchStatus(const std::string &message)
+void MexEdit::handleBuffersInput(int ch)
 {
-    int maxY, maxX;
-    getmaxyx(stdscr, maxY, maxX);
-    attron(COLOR_PAIR(3) | A_REVERSE);
-    mvprintw(maxY - 1, 0, "%-*s", maxX, message.c_str());
-    attroff(COLOR_PAIR(3) | A_REVERSE);
-    refresh();
-    napms(1000);
-}
+    int count = static_cast<int>(buffers.getBuffers().size());
+    int rows = LINES - 1;
+    switch (ch)
+    {
+        case 27:
+            buffersMode = false;
+            invalidateScreen();
+            return;
+        case KEY_ENTER:
+        case '\n':
+            if (selectedBuffer < count)
+            {
+                fs::path file = buffers.getBuffers()[selectedBuffer].file;
+                buffersMode = false;
+                invalidateScreen();
+                if (!switchToBuffer(selectedBuffer))
+                {
+                    showSearchStatus("Failed to reopen " + (file.empty() ? std::string("[No File]") : file.string()));
+                }
+            }
+            return;
+        case KEY_UP:
+            selectedBuffer--;
+            break;
+        case KEY_DOWN:
+            selectedBuffer++;
+            break;
+        case KEY_PPAGE:
+            selectedBuffer -= rows;
+            break;
+        case KEY_NPAGE:
+            selectedBuffer += rows;
+            break;
+        default:
+            return;
+    }
 
-void MexEdit::performReplace(const std::string &replacement, bool all)
-{
-    if (all)
+    selectedBuffer = std::max(0, std::min(selectedBuffer, count - 1));
+    if (selectedBuffer < buffersScroll)
     {
-        searchEngine.replaceAll(searchEngine.getLastPattern(), replacement, document);
-        showSearchStatus("Replaced all occurrences. + " + std::to_string(searchEngine.getMatches().size()) + " matches found.");
+        buffersScroll = selectedBuffer;
     }
-    else
+    else if (selectedBuffer >= buffersScroll + rows)
     {
-        searchEngine.replaceCurrent(replacement, document);
-        if (searchEngine.findNext(document))
-        {
-            const auto& matches = searchEngine.getMatches();
-            cursorY = searchEngine.getCurrentMatch().first;
-            cursorX = searchEngine.getCurrentMatch().second.first;
-            editorScroll = std::max(0, static_cast<int>(cursorY) - LINES / 2);
-        }
+        buffersScroll = selectedBuffer - rows + 1;
     }
 }
 
@@ -324,10 +1138,10 @@ void MexEdit::moveCursor(int dx, int dy)
     int newX = cursorX + dx;
     int newY = cursorY + dy;
 
-    if (newY >= 0 and newY < static_cast<int>(document.size()))
+    if (newY >= 0 and document.hasLine(newY))
     {
         cursorY = newY;
-        cursorX = std::min(newX, static_cast<int>(document[cursorY].size()));
+        cursorX = std::min(newX, static_cast<int>(document.lineLength(cursorY)));
     }
 
     int maxY, maxX;
@@ -345,29 +1159,28 @@ void MexEdit::moveCursor(int dx, int dy)
 
 void MexEdit::insertChar(char ch)
 {
-    saveState();
-    if (cursorY >= static_cast<int>(document.size()))
+    saveState(MexHistory::StepKind::Typing);
+    if (!document.hasLine(cursorY))
     {
         expandDocument(cursorY + 1);
     }
 
-    document[cursorY].insert(cursorX, 1, ch);
+    document.insert(cursorY, cursorX, std::string_view(&ch, 1));
     cursorX++;
 }
 
 void MexEdit::deleteChar()
 {
-    saveState();
+    saveState(MexHistory::StepKind::Deleting);
     if (cursorX > 0)
     {
-        document[cursorY].erase(cursorX - 1, 1);
+        document.erase(cursorY, cursorX - 1, cursorY, cursorX);
         cursorX--;
     }
     else if (cursorY > 0)
     {
-        cursorX = document[cursorY - 1].size();
-        document[cursorY - 1] += document[cursorY];
-        document.erase(document.begin() + cursorY);
+        cursorX = document.lineLength(cursorY - 1);
+        document.erase(cursorY - 1, cursorX, cursorY, 0);
         cursorY--;
     }
 }
@@ -375,9 +1188,7 @@ void MexEdit::deleteChar()
 void MexEdit::insertLine()
 {
     saveState();
-    std::string remainder = document[cursorY].substr(cursorX);
-    document[cursorY].resize(cursorX);
-    document.insert(document.begin() + cursorY + 1, remainder);
+    document.insert(cursorY, cursorX, "\n");
     cursorY++;
     cursorX = 0;
 }
@@ -385,55 +1196,70 @@ void MexEdit::insertLine()
 void MexEdit::deleteLine()
 {
     saveState();
-    if (document.size() > 1)
+    if (document.hasLine(1))
     {
-        document.erase(document.begin() + cursorY);
-        if (cursorY >= static_cast<int>(document.size()))
+        document.eraseLine(cursorY);
+        if (!document.hasLine(cursorY))
         {
-            cursorY = document.size() - 1;
+            cursorY--;
         }
-        cursorX = std::min(cursorX, static_cast<int>(document[cursorY].size()));
+        cursorX = std::min(cursorX, static_cast<int>(document.lineLength(cursorY)));
     }
 }
 
-void MexEdit::saveState()
+void MexEdit::saveState(MexHistory::StepKind kind)
 {
-    if (historyIndex < documentHistory.size())
-    {
-        documentHistory.erase(documentHistory.begin() + historyIndex, documentHistory.end());
-    }
-
-    documentHistory.push_back(document);
-    historyIndex++;
-
-    if (documentHistory.size() > 100)
-    {
-        documentHistory.erase(documentHistory.begin());
-        historyIndex--;
-    }
+    history.checkpoint(kind);
 }
 
 void MexEdit::undo()
 {
-    if (historyIndex > 1)
+    MexHistory::Position position;
+    if (history.undo(document, position))
     {
-        historyIndex--;
-        document = documentHistory[historyIndex - 1];
+        cursorY = position.line;
+        cursorX = position.column;
+        moveCursor(0, 0);
     }
 }
 
 void MexEdit::redo()
 {
-    if (historyIndex < documentHistory.size())
+    MexHistory::Position position;
+    if (history.redo(document, position))
     {
-        historyIndex++;
-        document = documentHistory[historyIndex - 1];
+        cursorY = position.line;
+        cursorX = position.column;
+        moveCursor(0, 0);
     }
 }
 
 bool MexEdit::promptSaveBeforeExit()
 {
-    if (currentFile.empty() and (document.size() == 1 and document[0].empty()))
+    const auto& others = buffers.getBuffers();
+    size_t modified = std::count_if(others.begin(), others.end(), [](const MexBufferList::Buffer& buffer) { return buffer.modified; });
+    if (modified > 0)
+    {
+        mvprintw(0, 0, "%zu other open files have unsaved changes. Save them? (y/n): ", modified);
+        echo();
+        int answer = getch();
+        noecho();
+        clear();
+
+        for (size_t i = 0; (answer == 'y' or answer == 'Y') and i < others.size(); ++i)
+        {
+            if (others[i].modified and !buffers.save(i, syncPolicy))
+            {
+                // A document that was never saved needs a name: switching to it with Ctrl+B allows Save As.
+                std::string name = others[i].file.empty() ? "[No File]" : others[i].file.string();
+                mvprintw(1, 0, "Failed to save file: %s Press any key to continue...", name.c_str());
+                getch();
+                return false;
+            }
+        }
+    }
+
+    if (currentFile.empty() and document.isEmpty())
     {
         return true;
     }
@@ -500,32 +1326,86 @@ void MexEdit::startCommandMode()
             performReplace(replacement, all);
         }
     }
+    else if (strcmp(command, "stats") == 0)
+    {
+        MexSyntax::CacheStats stats = syntaxHighlighter.getCacheStats();
+        showSearchStatus("Highlight cache: " + std::to_string(stats.hits) + " hits, " +
+                         std::to_string(stats.misses) + " misses");
+    }
+    else if (strncmp(command, "threads ", 8) == 0)
+    {
+        searchEngine.setThreadCount(strtoul(command + 8, nullptr, 10));
+        size_t threads = searchEngine.getThreadCount();
+        showSearchStatus("Search threads: " + (threads == 0 ? std::string("one per hardware thread") : std::to_string(threads)));
+    }
+    else if (strncmp(command, "grep ", 5) == 0)
+    {
+        startProjectSearch(command + 5);
+    }
+    else if (strcmp(command, "index on") == 0)
+    {
+        projectSearch.setIndexed(true);
+        projectSearch.setThreadCount(searchEngine.getThreadCount());
+        projectSearch.updateIndex(currentDirectory);
+        showSearchStatus("grep uses the index of " + currentDirectory.string() + ", built in the background");
+    }
+    else if (strcmp(command, "index off") == 0)
+    {
+        projectSearch.setIndexed(false);
+        showSearchStatus("grep reads every file");
+    }
+    else if (strncmp(command, "buffermem ", 10) == 0)
+    {
+        buffers.setByteBudget(strtoul(command + 10, nullptr, 10) * 1024 * 1024);
+        showSearchStatus("Other open files keep up to " + std::to_string(buffers.getByteBudget() / (1024 * 1024)) + " MiB in memory");
+    }
+    else if (strncmp(command, "matchcap ", 9) == 0)
+    {
+        searchEngine.setCountCap(strtoul(command + 9, nullptr, 10));
+        showSearchStatus("Large files count up to " + std::to_string(searchEngine.getCountCap()) + " matches");
+    }
 }
 
 void MexEdit::handleInput(int ch)
 {
     static bool escapePressed = false;
 
+    if (resultsMode)
+    {
+        handleResultsInput(ch);
+        return;
+    }
+
+    if (finderMode)
+    {
+        handleFinderInput(ch);
+        return;
+    }
+
+    if (buffersMode)
+    {
+        handleBuffersInput(ch);
+        return;
+    }
+
     if (searchMode)
     {
         if (ch == 27)
         {
+            searchEngine.cancelSearch();
+            searchEngine.clearMatches();
             searchMode = false;
             searchString.clear();
-            noecho();
+            cursorX = searchOriginX;
+            cursorY = searchOriginY;
+            editorScroll = searchOriginScroll;
             return;
         }
         else if (ch == '\n')
         {
-            searchEngine.find(searchString, document);
+            searchEngine.finishSearch();
+            showIncrementalMatch();
             searchMode = false;
-            if (!searchEngine.getMatches().empty())
-            {
-                const auto& matches = searchEngine.getMatches();
-                cursorY = matches[0].first;
-                cursorX = matches[0].second.first;
-                editorScroll = std::max(0, static_cast<int>(cursorY) - LINES / 2);
-            }
             searchString.clear();
             return;
         }
@@ -534,11 +1414,13 @@ void MexEdit::handleInput(int ch)
             if (!searchString.empty())
             {
                 searchString.pop_back();
+                searchEngine.findIncremental(searchString, document, searchOriginY, searchOriginX);
             }
         }
         else if (isprint(ch))
         {
             searchString += ch;
+            searchEngine.findIncremental(searchString, document, searchOriginY, searchOriginX);
         }
         return;
     }
@@ -548,6 +1430,7 @@ void MexEdit::handleInput(int ch)
         if (ch == ':')
         {
             startCommandMode();
+            invalidateScreen();
         }
         escapePressed = false;
         return;
@@ -576,21 +1459,21 @@ void MexEdit::handleInput(int ch)
             insertLine();
             break;
         case KEY_DC:
-            if (cursorX < static_cast<int>(document[cursorY].size()))
+            saveState(MexHistory::StepKind::Deleting);
+            if (cursorX < static_cast<int>(document.lineLength(cursorY)))
             {
-                document[cursorY].erase(cursorX, 1);
+                document.erase(cursorY, cursorX, cursorY, cursorX + 1);
             }
-            else if (cursorY < static_cast<int>(document.size()) - 1)
+            else if (document.hasLine(cursorY + 1))
             {
-                document[cursorY] += document[cursorY + 1];
-                document.erase(document.begin() + cursorY + 1);
+                document.erase(cursorY, cursorX, cursorY + 1, 0);
             }
             break;
         case KEY_HOME:
             cursorX = 0;
             break;
         case KEY_END:
-            cursorX = document[cursorY].size();
+            cursorX = document.lineLength(cursorY);
             break;
         case KEY_PPAGE:
             moveCursor(0, -10);
@@ -600,35 +1483,19 @@ void MexEdit::handleInput(int ch)
             break;
         case KEY_F(1):
             menu.showHelp();
+            invalidateScreen();
             break;
         case KEY_F(2):
             saveFile();
             break;
         case KEY_F(3):
-            if (!fileList.empty() and selectedFileIdx < static_cast<int>(fileList.size()))
-            {
-                const auto& selected = fileList[selectedFileIdx];
-                if (selected.is_directory())
-                {
-                    currentDirectory = selected.path();
-                    updateFileExplorer();
-                }
-                else
-                {
-                    loadFile(selected.path());
-                }
-            }
+            openSelectedEntry();
             break;
         case KEY_F(4):
             showLineNumbers = !showLineNumbers;
             break;
         case KEY_F(5):
-            document.clear();
-            document.emplace_back();
-            currentFile.clear();
-            cursorX = 0;
-            cursorY = 0;
-            editorScroll = 0;
+            newDocument();
             break;
         case KEY_F(6): // save as
         {
@@ -650,15 +1517,19 @@ void MexEdit::handleInput(int ch)
                 mvprintw(0, 0, "File saved as: %s", filename);
             }
             getch();
-            clear();
+            invalidateScreen();
             break;
         }
         case KEY_F(7): // quit
             if (promptSaveBeforeExit())
             {
+                // Unsaved edits were saved or given up, so the journals have nothing left to recover.
+                journal.discard();
+                buffers.discardJournals();
                 endwin();
                 exit(0);
             }
+            invalidateScreen();
             break;
         case KEY_F(8):
             if (selectedFileIdx > 0)
@@ -671,7 +1542,7 @@ void MexEdit::handleInput(int ch)
             }
             break;
         case KEY_F(9):
-            if (selectedFileIdx < static_cast<int>(fileList.size()) - 1)
+            if (selectedFileIdx < static_cast<int>(fileList.getEntries().size()) - 1)
             {
                 selectedFileIdx++;
                 if (selectedFileIdx >= fileExplorerScroll + (LINES - 1))
@@ -686,18 +1557,46 @@ void MexEdit::handleInput(int ch)
         case CTRL('z'):
             undo();
             break;
+        case CTRL('g'):
+            if (!projectSearch.getPattern().empty())
+            {
+                resultsMode = true;
+                invalidateScreen();
+            }
+            break;
+        case CTRL('p'):
+            startFinder();
+            break;
+        case CTRL('b'):
+            // The most recently used file is selected, so Ctrl+B Enter goes back and forth between two files.
+            if (buffers.getBuffers().empty())
+            {
+                showSearchStatus("No other files are open");
+            }
+            else
+            {
+                buffersMode = true;
+                selectedBuffer = 0;
+                buffersScroll = 0;
+                invalidateScreen();
+            }
+            break;
         case CTRL('y'):
             redo();
             break;
         case 27:
             menu.showMainMenu();
+            invalidateScreen();
             drawInterface();
             escapePressed = true;
             break;
         case '/':
             searchMode = true;
             searchString.clear();
-            echo();
+            searchOriginX = cursorX;
+            searchOriginY = cursorY;
+            searchOriginScroll = editorScroll;
+            searchEngine.setLazyMode(document.isLoading() or document.byteCount() >= lazySearchBytes);
             break;
         case CTRL('n'):
             if (searchEngine.findNext(document))
@@ -712,10 +1611,12 @@ void MexEdit::handleInput(int ch)
             insertChar(':');
             break;
         case '\t':
+            history.beginGroup();
             for (int i = 0; i < 4; ++i)
             {
                 insertChar(' ');
             }
+            history.endGroup();
             break;
         default:
             if (isprint(ch))
@@ -726,12 +1627,189 @@ void MexEdit::handleInput(int ch)
     }
 }
 
+int MexEdit::waitForKey(int timeoutMs)
+{
+    // Keys ncurses has already read from the terminal would not wake poll() up.
+    nodelay(stdscr, TRUE);
+    int ch = getch();
+    nodelay(stdscr, FALSE);
+    if (ch != ERR)
+    {
+        return ch;
+    }
+
+    pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {watcher.descriptor(), POLLIN, 0}};
+    int ready = poll(fds, watcher.descriptor() >= 0 ? 2 : 1, timeoutMs);
+    if (ready > 0 and (fds[1].revents & POLLIN))
+    {
+        handleWatchEvents();
+    }
+    // A signal, such as the one for a resized terminal, interrupts poll() and leaves a key for getch().
+    if (ready < 0 or (ready > 0 and (fds[0].revents & POLLIN)))
+    {
+        nodelay(stdscr, TRUE);
+        ch = getch();
+        nodelay(stdscr, FALSE);
+    }
+    return ch;
+}
+
+void MexEdit::detachFromChangedFile()
+{
+    if (!document.detachChangedFiles())
+    {
+        return;
+    }
+
+    // The lines not edited now hold what the file holds, so positions the history or highlighter knew may be off.
+    history.clear();
+    syntaxHighlighter.resetLineStates();
+    searchEngine.clearMatches();
+    if (!document.hasLine(cursorY))
+    {
+        cursorY = static_cast<int>(document.lineCount()) - 1;
+        editorScroll = std::min(editorScroll, cursorY);
+    }
+    invalidateScreen();
+}
+
+void MexEdit::handleWatchEvents()
+{
+    bool fileChanged = false;
+    bool relist = false;
+    for (const MexWatcher::Event& event : watcher.readEvents())
+    {
+        switch (event.change)
+        {
+            case MexWatcher::Change::EntryAdded:
+                updateExplorerEntries([&] { return fileList.addEntry(event.name); });
+                break;
+            case MexWatcher::Change::EntryRemoved:
+                updateExplorerEntries([&] { return fileList.removeEntry(event.name); });
+                break;
+            case MexWatcher::Change::FileChanged:
+            case MexWatcher::Change::FileRemoved:
+                fileChanged = true;
+                break;
+            case MexWatcher::Change::Overflow:
+                relist = true;
+                fileChanged = true;
+                break;
+        }
+    }
+
+    if (relist)
+    {
+        updateFileExplorer();
+    }
+
+    if (fileChanged)
+    {
+        reloadIfChanged();
+    }
+}
+
+void MexEdit::reloadIfChanged()
+{
+    // After our own saves, the file is found as it was saved.
+    if (currentFile.empty() or diskUnchanged())
+    {
+        return;
+    }
+
+    std::error_code ec;
+    if (!fs::exists(currentFile, ec))
+    {
+        diskNotice = "deleted on disk";
+    }
+    else if (document.version() != savedVersion)
+    {
+        detachFromChangedFile();
+        diskNotice = "changed on disk";
+    }
+    else
+    {
+        // Nothing would be lost, so the file is reloaded in place.
+        int x = cursorX;
+        int y = cursorY;
+        int scroll = editorScroll;
+        if (loadFile(currentFile))
+        {
+            cursorY = document.hasLine(y) ? y : 0;
+            cursorX = x;
+            editorScroll = std::min(scroll, cursorY);
+            diskNotice = "reloaded";
+        }
+        else
+        {
+            diskNotice = "changed on disk";
+        }
+    }
+}
+
 void MexEdit::run()
 {
     while (true)
     {
+        if (searchMode and searchEngine.collectResults())
+        {
+            showIncrementalMatch();
+        }
+        // Checked before collecting, so the results handed over just before the search ended are not missed.
+        bool projectSearching = projectSearch.isSearching();
+        projectSearch.collectResults();
+        bool listing = fileList.isListing();
+        updateExplorerEntries([this] { return fileList.collectEntries(); });
+        bool finding = finderMode and fileFinder.isIndexing();
+        if (finderMode and fileFinder.collectPaths())
+        {
+            int count = static_cast<int>(fileFinder.getResults().size());
+            selectedMatch = std::max(0, std::min(selectedMatch, count - 1));
+        }
         drawInterface();
-        int ch = getch();
+
+        // While a search, a match count, a directory listing or a walk for the open file palette runs in the
+        // background, wake up regularly to show its results.
+        bool background = searchEngine.isSearching() or searchEngine.isCounting() or projectSearching or listing or finding;
+        journal.flushIfDue();
+        int timeout = background ? 30 : -1;
+        int flushDelay = journal.flushDelay();
+        if (flushDelay >= 0 and (timeout < 0 or flushDelay < timeout))
+        {
+            timeout = flushDelay;
+        }
+        int ch = waitForKey(timeout);
+        if (ch == ERR)
+        {
+            continue;
+        }
+
+        // A notice about the file on disk lasts until a key is pressed with the document matching the disk again.
+        if (!diskNotice.empty() and matchesDisk())
+        {
+            diskNotice.clear();
+        }
+
+        // Keys that are already queued arrive as one burst (usually a terminal paste) and are undone together.
+        nodelay(stdscr, TRUE);
+        int next = getch();
+        if (next == ERR)
+        {
+            nodelay(stdscr, FALSE);
+            handleInput(ch);
+            continue;
+        }
+
+        history.beginGroup();
         handleInput(ch);
+        while (next != ERR)
+        {
+            nodelay(stdscr, FALSE);
+            handleInput(next);
+            nodelay(stdscr, TRUE);
+            next = getch();
+        }
+        nodelay(stdscr, FALSE);
+        history.endGroup();
     }
 }
\ No newline at end of file
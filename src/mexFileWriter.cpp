@@ -0,0 +1,210 @@
+#include "../include/mexFileWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+MexFileWriter::MexFileWriter(SyncPolicy policy)
+    : policy(policy)
+    , staging(std::make_unique<char[]>(stagingSize))
+{
+
+}
+
+MexFileWriter::~MexFileWriter()
+{
+    abort();
+}
+
+bool MexFileWriter::open(const fs::path& path)
+{
+    abort();
+
+    std::error_code ec;
+    target = path;
+    if (fs::is_symlink(fs::symlink_status(path, ec)))
+    {
+        target = fs::canonical(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+    }
+
+    fs::path directory = target.has_parent_path() ? target.parent_path() : fs::path(".");
+    std::string pattern = (directory / ("." + target.filename().string() + ".mexsave-XXXXXX")).string();
+    fd = mkstemp(pattern.data());
+    if (fd < 0)
+    {
+        return false;
+    }
+    tempPath = pattern;
+
+    struct stat info{};
+    if (stat(target.c_str(), &info) == 0)
+    {
+        fchmod(fd, info.st_mode & 07777);
+        // Keeping the owner is best effort; without privileges the file stays owned by the current user.
+        [[maybe_unused]] int chownResult = fchown(fd, info.st_uid, info.st_gid);
+    }
+    else
+    {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    failed = false;
+    stagedBegin = 0;
+    stagedEnd = 0;
+    pending.clear();
+    return true;
+}
+
+void MexFileWriter::queueStaged()
+{
+    if (stagedEnd > stagedBegin)
+    {
+        pending.push_back({staging.get() + stagedBegin, stagedEnd - stagedBegin});
+        stagedBegin = stagedEnd;
+    }
+}
+
+bool MexFileWriter::write(std::string_view bytes)
+{
+    if (fd < 0 or failed)
+    {
+        return false;
+    }
+
+    if (bytes.size() >= directThreshold)
+    {
+        queueStaged();
+        pending.push_back({const_cast<char*>(bytes.data()), bytes.size()});
+    }
+    else
+    {
+        if (stagedEnd + bytes.size() > stagingSize)
+        {
+            queueStaged();
+            if (!flush())
+            {
+                return false;
+            }
+        }
+
+        std::memcpy(staging.get() + stagedEnd, bytes.data(), bytes.size());
+        stagedEnd += bytes.size();
+    }
+
+    if (pending.size() + 1 >= IOV_MAX)
+    {
+        queueStaged();
+        return flush();
+    }
+
+    return true;
+}
+
+bool MexFileWriter::flush()
+{
+    size_t index = 0;
+    while (index < pending.size())
+    {
+        int count = static_cast<int>(std::min<size_t>(pending.size() - index, IOV_MAX));
+        ssize_t written = writev(fd, pending.data() + index, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+
+        size_t remaining = static_cast<size_t>(written);
+        while (index < pending.size() and remaining >= pending[index].iov_len)
+        {
+            remaining -= pending[index].iov_len;
+            index++;
+        }
+        if (remaining > 0)
+        {
+            pending[index].iov_base = static_cast<char*>(pending[index].iov_base) + remaining;
+            pending[index].iov_len -= remaining;
+        }
+    }
+
+    pending.clear();
+    stagedBegin = 0;
+    stagedEnd = 0;
+    return true;
+}
+
+bool MexFileWriter::commit()
+{
+    if (fd < 0 or failed)
+    {
+        return false;
+    }
+
+    queueStaged();
+    if (!flush())
+    {
+        abort();
+        return false;
+    }
+
+    if (policy != SyncPolicy::None and fsync(fd) != 0)
+    {
+        abort();
+        return false;
+    }
+
+    close(fd);
+    fd = -1;
+
+    if (rename(tempPath.c_str(), target.c_str()) != 0)
+    {
+        unlink(tempPath.c_str());
+        tempPath.clear();
+        return false;
+    }
+    tempPath.clear();
+
+    if (policy == SyncPolicy::FileAndDirectory)
+    {
+        fs::path directory = target.has_parent_path() ? target.parent_path() : fs::path(".");
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd >= 0)
+        {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+    return true;
+}
+
+void MexFileWriter::abort()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    if (!tempPath.empty())
+    {
+        unlink(tempPath.c_str());
+        tempPath.clear();
+    }
+
+    pending.clear();
+}
@@ -0,0 +1,453 @@
+#include "../include/mexFuzzyFinder.h"
+#include "../include/mexLineScan.h"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MEXEDIT_X86 1
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Below this many candidates, scoring on more threads costs more than it saves.
+    constexpr size_t parallelCandidates = 65536;
+
+    char fold(char c)
+    {
+        return c >= 'A' and c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // A bit per byte value modulo 64; a path can only match if it has every bit of the query.
+    uint64_t maskOf(std::string_view text)
+    {
+        uint64_t mask = 0;
+        for (char c : text)
+        {
+            mask |= uint64_t{1} << (static_cast<unsigned char>(c) & 63);
+        }
+        return mask;
+    }
+
+    bool startsWord(char previous, char current)
+    {
+        return previous == '/' or previous == '_' or previous == '-' or previous == '.' or previous == ' ' or
+               (previous >= 'a' and previous <= 'z' and current >= 'A' and current <= 'Z');
+    }
+
+    bool better(const MexFuzzyFinder::Match& a, const MexFuzzyFinder::Match& b)
+    {
+        return a.score != b.score ? a.score > b.score : a.path < b.path;
+    }
+
+    // The findLetters functions look for letters in [at, end), in order, and return the position after the
+    // last one, or nullptr if one is missing. The vector ones may load up to limit, past the end of the path,
+    // and ignore what they find there; they finish with the scalar loop where a whole load does not fit.
+
+    const char* findLettersScalar(const char* at, const char* end, std::string_view letters)
+    {
+        for (char c : letters)
+        {
+            while (at < end and *at != c)
+            {
+                at++;
+            }
+            if (at == end)
+            {
+                return nullptr;
+            }
+            at++;
+        }
+        return at;
+    }
+
+#ifdef MEXEDIT_X86
+    __attribute__((target("sse2")))
+    const char* findLettersSSE2(const char* at, const char* end, const char* limit, std::string_view letters)
+    {
+        for (size_t i = 0; i < letters.size(); ++i)
+        {
+            const __m128i letter = _mm_set1_epi8(letters[i]);
+            while (true)
+            {
+                if (at + 16 > limit)
+                {
+                    return findLettersScalar(at, end, letters.substr(i));
+                }
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, letter)));
+                if (end - at < 16)
+                {
+                    mask &= (1u << (end - at)) - 1;
+                }
+                if (mask)
+                {
+                    at += __builtin_ctz(mask) + 1;
+                    break;
+                }
+                at += 16;
+                if (at >= end)
+                {
+                    return nullptr;
+                }
+            }
+        }
+        return at;
+    }
+
+    __attribute__((target("avx2")))
+    const char* findLettersAVX2(const char* at, const char* end, const char* limit, std::string_view letters)
+    {
+        for (size_t i = 0; i < letters.size(); ++i)
+        {
+            const __m256i letter = _mm256_set1_epi8(letters[i]);
+            while (true)
+            {
+                if (at + 32 > limit)
+                {
+                    return findLettersScalar(at, end, letters.substr(i));
+                }
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, letter)));
+                if (end - at < 32)
+                {
+                    mask &= (1u << (end - at)) - 1;
+                }
+                if (mask)
+                {
+                    at += __builtin_ctz(mask) + 1;
+                    break;
+                }
+                at += 32;
+                if (at >= end)
+                {
+                    return nullptr;
+                }
+            }
+        }
+        return at;
+    }
+#endif
+
+    const char* findLetters(const char* at, const char* end, [[maybe_unused]] const char* limit, std::string_view letters)
+    {
+#ifdef MEXEDIT_X86
+        switch (MexLineScan::bestIsa())
+        {
+            case MexLineScan::Isa::AVX2:
+                return findLettersAVX2(at, end, limit, letters);
+            case MexLineScan::Isa::SSE2:
+                return findLettersSSE2(at, end, limit, letters);
+            default:
+                break;
+        }
+#endif
+        return findLettersScalar(at, end, letters);
+    }
+}
+
+void MexFuzzyFinder::start(const fs::path& root)
+{
+    // Destroying the threads stops and joins them.
+    workers.clear();
+    tasks.clear();
+    pending.clear();
+    names.clear();
+    folded.clear();
+    offsets.clear();
+    masks.clear();
+    nameStarts.clear();
+    matched.clear();
+    matchedQuery.clear();
+    scanned = 0;
+    results.clear();
+
+    std::error_code ec;
+    this->root = fs::absolute(root, ec).lexically_normal();
+    if (!this->root.has_filename() and this->root != this->root.root_path())
+    {
+        this->root = this->root.parent_path();
+    }
+    prefix = this->root.native();
+    if (!prefix.ends_with('/'))
+    {
+        prefix.push_back('/');
+    }
+
+    tasks.push_back({this->root.native(), MexIgnoreRules::forParentsOf(this->root), true});
+    busy = 0;
+    size_t threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    running = threads;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this](std::stop_token stop)
+        {
+            walk(stop);
+            running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+}
+
+bool MexFuzzyFinder::isIndexing() const
+{
+    return running.load(std::memory_order_acquire) > 0;
+}
+
+void MexFuzzyFinder::walk(const std::stop_token& stop)
+{
+    std::vector<MexProjectSearch::Entry> found;
+    std::vector<std::string> files;
+    while (true)
+    {
+        MexProjectSearch::Entry directory;
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            taskReady.wait(lock, stop, [this] { return !tasks.empty() or busy == 0; });
+            if (tasks.empty() or stop.stop_requested())
+            {
+                return;
+            }
+            directory = std::move(tasks.back());
+            tasks.pop_back();
+            busy++;
+        }
+
+        found.clear();
+        files.clear();
+        MexProjectSearch::listDirectory(directory, found);
+        std::vector<MexProjectSearch::Entry> directories;
+        for (auto& entry : found)
+        {
+            if (entry.directory)
+            {
+                directories.push_back(std::move(entry));
+            }
+            else
+            {
+                files.push_back(entry.path.substr(prefix.size()));
+            }
+        }
+
+        if (!files.empty())
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.insert(pending.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        }
+
+        std::lock_guard<std::mutex> lock(taskMutex);
+        tasks.insert(tasks.end(), std::make_move_iterator(directories.begin()), std::make_move_iterator(directories.end()));
+        busy--;
+        taskReady.notify_all();
+    }
+}
+
+bool MexFuzzyFinder::collectPaths()
+{
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        paths.swap(pending);
+    }
+    if (paths.empty())
+    {
+        return false;
+    }
+
+    for (const std::string& path : paths)
+    {
+        offsets.push_back(static_cast<uint32_t>(names.size()));
+        names.append(path);
+        size_t start = folded.size();
+        std::transform(path.begin(), path.end(), std::back_inserter(folded), fold);
+        masks.push_back(maskOf(std::string_view(folded).substr(start)));
+        nameStarts.push_back(static_cast<uint32_t>(path.rfind('/') + 1));
+    }
+    update();
+    return true;
+}
+
+std::string_view MexFuzzyFinder::path(uint32_t index) const
+{
+    size_t end = index + 1 < offsets.size() ? offsets[index + 1] : names.size();
+    return std::string_view(names).substr(offsets[index], end - offsets[index]);
+}
+
+void MexFuzzyFinder::setQuery(const std::string& query)
+{
+    this->query = query;
+    update();
+}
+
+void MexFuzzyFinder::update()
+{
+    std::string wanted;
+    std::transform(query.begin(), query.end(), std::back_inserter(wanted), fold);
+
+    // A query that extends the previous one can only match paths that matched before, and new paths; the
+    // earlier matches only have to go on to find the added letters.
+    std::vector<uint32_t> previous;
+    std::vector<uint32_t> previousEnds;
+    size_t firstNew = 0;
+    size_t known = 0;
+    if (wanted.starts_with(matchedQuery) and scanned > 0)
+    {
+        previous = std::move(matched);
+        previousEnds = std::move(matchEnds);
+        firstNew = scanned;
+        known = matchedQuery.size();
+    }
+    matchedQuery = std::move(wanted);
+    std::string_view added = std::string_view(matchedQuery).substr(known);
+    scanned = offsets.size();
+
+    // Candidates 0 to previous.size() - 1 are the earlier matches, the rest the paths from firstNew on.
+    size_t candidates = previous.size() + offsets.size() - firstNew;
+    uint64_t wantedMask = maskOf(matchedQuery);
+    auto scoreRange = [&](size_t begin, size_t end, std::vector<uint32_t>& found, std::vector<uint32_t>& ends,
+                          std::vector<Match>& best)
+    {
+        // best is a heap with the worst of the best matches at the front. Once it is full, paths that could not
+        // beat that even with every letter scoring its highest are not scored at all.
+        int highest = static_cast<int>(64 * matchedQuery.size()) - (matchedQuery.empty() ? 0 : 16);
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t index = i < previous.size() ? previous[i] : static_cast<uint32_t>(firstNew + i - previous.size());
+            if ((masks[index] & wantedMask) != wantedMask)
+            {
+                continue;
+            }
+            size_t matchEnd = i < previous.size() ? matchFrom(index, previousEnds[i], added) : matchFrom(index, 0, matchedQuery);
+            if (matchEnd == std::string::npos)
+            {
+                continue;
+            }
+
+            found.push_back(index);
+            ends.push_back(static_cast<uint32_t>(matchEnd));
+            if (best.size() == maxResults and highest - static_cast<int>(path(index).size() / 4) < best.front().score)
+            {
+                continue;
+            }
+            Match match{index, score(index, matchEnd, nullptr)};
+            if (best.size() < maxResults)
+            {
+                best.push_back(match);
+                std::push_heap(best.begin(), best.end(), better);
+            }
+            else if (better(match, best.front()))
+            {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.back() = match;
+                std::push_heap(best.begin(), best.end(), better);
+            }
+        }
+    };
+
+    size_t threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, candidates / parallelCandidates + 1);
+    std::vector<std::vector<uint32_t>> found(threads);
+    std::vector<std::vector<uint32_t>> ends(threads);
+    std::vector<std::vector<Match>> best(threads);
+    if (threads == 1)
+    {
+        found[0].reserve(candidates);
+        ends[0].reserve(candidates);
+        scoreRange(0, candidates, found[0], ends[0], best[0]);
+    }
+    else
+    {
+        std::vector<std::jthread> scorers;
+        size_t chunk = (candidates + threads - 1) / threads;
+        for (size_t t = 0; t < threads; ++t)
+        {
+            scorers.emplace_back([&, t]
+            {
+                scoreRange(t * chunk, std::min(candidates, (t + 1) * chunk), found[t], ends[t], best[t]);
+            });
+        }
+    }
+
+    matched = std::move(found[0]);
+    matchEnds = std::move(ends[0]);
+    results = std::move(best[0]);
+    for (size_t t = 1; t < threads; ++t)
+    {
+        matched.insert(matched.end(), found[t].begin(), found[t].end());
+        matchEnds.insert(matchEnds.end(), ends[t].begin(), ends[t].end());
+        results.insert(results.end(), best[t].begin(), best[t].end());
+    }
+    if (results.size() > maxResults)
+    {
+        std::nth_element(results.begin(), results.begin() + maxResults, results.end(), better);
+        results.resize(maxResults);
+    }
+    std::sort(results.begin(), results.end(), better);
+}
+
+size_t MexFuzzyFinder::matchFrom(uint32_t index, size_t from, std::string_view letters) const
+{
+    // Loads past the end of the path stay within the arena.
+    const char* text = folded.data() + offsets[index];
+    const char* at = findLetters(text + from, text + path(index).size(), folded.data() + folded.size(), letters);
+    return at ? static_cast<size_t>(at - text) : std::string::npos;
+}
+
+int MexFuzzyFinder::score(uint32_t index, size_t end, std::vector<size_t>* positions) const
+{
+    std::string_view original = path(index);
+    const char* text = folded.data() + offsets[index];
+    std::string_view wanted = matchedQuery;
+    size_t nameStart = nameStarts[index];
+    int total = -static_cast<int>(original.size() / 4);
+
+    // The first match found going forward ends as early as possible; matching the letters again backwards from
+    // its end finds the shortest window that contains the query, and scores it on the way.
+    size_t next = wanted.size();
+    for (size_t i = end, later = end; next > 0; later = i)
+    {
+        while (text[--i] != wanted[next - 1])
+        {
+        }
+        int bonus = 16;
+        if (later == i + 1 and later < end)
+        {
+            bonus += 16;
+        }
+        else if (later < end)
+        {
+            // Every byte skipped costs one, and breaking a run of matches costs two more.
+            total -= static_cast<int>(later - i - 1) + 2;
+        }
+        if (i == 0 or startsWord(original[i - 1], original[i]))
+        {
+            bonus += 24;
+        }
+        if (i >= nameStart)
+        {
+            bonus += 8;
+        }
+        total += bonus;
+        next--;
+        if (positions)
+        {
+            positions->push_back(i);
+        }
+    }
+    if (positions)
+    {
+        std::reverse(positions->begin(), positions->end());
+    }
+    return total;
+}
+
+std::vector<size_t> MexFuzzyFinder::matchPositions(uint32_t index) const
+{
+    std::vector<size_t> positions;
+    size_t end = matchFrom(index, 0, matchedQuery);
+    if (end != std::string::npos)
+    {
+        score(index, end, &positions);
+    }
+    return positions;
+}
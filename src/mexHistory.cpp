@@ -0,0 +1,232 @@
+#include "../include/mexHistory.h"
+
+MexHistory::MexHistory() = default;
+
+void MexHistory::checkpoint(StepKind kind)
+{
+    if (groupDepth > 0)
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool continues = kind != StepKind::Other and kind == stepKind and !stepPending and
+                     stepIndex == steps.size() and now - lastEdit < groupTimeout;
+    if (!continues)
+    {
+        stepPending = true;
+    }
+
+    stepKind = kind;
+}
+
+void MexHistory::beginGroup()
+{
+    if (groupDepth++ == 0)
+    {
+        stepPending = true;
+        stepKind = StepKind::Other;
+    }
+}
+
+void MexHistory::endGroup()
+{
+    if (groupDepth > 0 and --groupDepth == 0)
+    {
+        stepPending = true;
+    }
+}
+
+void MexHistory::setByteLimit(size_t bytes)
+{
+    byteLimit = bytes;
+    enforceLimit();
+}
+
+void MexHistory::onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted)
+{
+    if (replaying)
+    {
+        return;
+    }
+
+    lastEdit = std::chrono::steady_clock::now();
+
+    if (stepIndex < steps.size())
+    {
+        for (size_t i = stepIndex; i < steps.size(); ++i)
+        {
+            totalBytes -= steps[i].bytes;
+        }
+        steps.erase(steps.begin() + stepIndex, steps.end());
+        stepPending = true;
+    }
+
+    Position start{line, column};
+    if (!stepPending and !steps.empty())
+    {
+        if (coalesce(start, removed, inserted))
+        {
+            size_t added = removed.size() + inserted.size();
+            steps.back().bytes += added;
+            totalBytes += added;
+            enforceLimit();
+            return;
+        }
+
+        // A burst of typing or deleting ends when the cursor jumps elsewhere.
+        if (groupDepth == 0 and stepKind != StepKind::Other)
+        {
+            stepPending = true;
+        }
+    }
+
+    if (stepPending or steps.empty())
+    {
+        steps.emplace_back();
+        stepIndex = steps.size();
+        stepPending = false;
+    }
+
+    size_t bytes = sizeof(Operation) + removed.size() + inserted.size();
+    steps.back().operations.push_back({start, std::string(removed), std::string(inserted)});
+    steps.back().bytes += bytes;
+    totalBytes += bytes;
+    enforceLimit();
+}
+
+bool MexHistory::coalesce(const Position& start, std::string_view removed, std::string_view inserted)
+{
+    auto& operations = steps.back().operations;
+    if (operations.empty())
+    {
+        return false;
+    }
+
+    Operation& last = operations.back();
+    if (removed.empty())
+    {
+        Position end = endOf(last.start, last.inserted);
+        if (start.line == end.line and start.column == end.column)
+        {
+            last.inserted.append(inserted);
+            return true;
+        }
+        return false;
+    }
+
+    if (!inserted.empty() or !last.inserted.empty())
+    {
+        return false;
+    }
+
+    Position end = endOf(start, removed);
+    if (end.line == last.start.line and end.column == last.start.column)
+    {
+        last.start = start;
+        last.removed.insert(0, removed);
+        return true;
+    }
+
+    if (start.line == last.start.line and start.column == last.start.column)
+    {
+        last.removed.append(removed);
+        return true;
+    }
+
+    return false;
+}
+
+void MexHistory::enforceLimit()
+{
+    while (totalBytes > byteLimit and steps.size() > 1 and stepIndex > 0)
+    {
+        totalBytes -= steps.front().bytes;
+        steps.pop_front();
+        stepIndex--;
+    }
+}
+
+bool MexHistory::undo(MexTextBuffer& document, Position& cursor)
+{
+    if (stepIndex == 0)
+    {
+        return false;
+    }
+
+    const auto& operations = steps[--stepIndex].operations;
+    for (auto it = operations.rbegin(); it != operations.rend(); ++it)
+    {
+        apply(document, it->start, it->inserted, it->removed);
+        cursor = endOf(it->start, it->removed);
+    }
+
+    stepPending = true;
+    return true;
+}
+
+bool MexHistory::redo(MexTextBuffer& document, Position& cursor)
+{
+    if (stepIndex >= steps.size())
+    {
+        return false;
+    }
+
+    const auto& operations = steps[stepIndex++].operations;
+    for (const auto& operation : operations)
+    {
+        apply(document, operation.start, operation.removed, operation.inserted);
+        cursor = endOf(operation.start, operation.inserted);
+    }
+
+    stepPending = true;
+    return true;
+}
+
+void MexHistory::clear()
+{
+    steps.clear();
+    stepIndex = 0;
+    stepPending = true;
+    stepKind = StepKind::Other;
+    totalBytes = 0;
+}
+
+void MexHistory::swap(MexHistory& other)
+{
+    std::swap(steps, other.steps);
+    std::swap(stepIndex, other.stepIndex);
+    std::swap(totalBytes, other.totalBytes);
+    std::swap(lastEdit, other.lastEdit);
+    stepPending = true;
+    other.stepPending = true;
+    stepKind = StepKind::Other;
+    other.stepKind = StepKind::Other;
+    enforceLimit();
+    other.enforceLimit();
+}
+
+MexHistory::Position MexHistory::endOf(const Position& start, std::string_view text)
+{
+    size_t lastNewline = text.rfind('\n');
+    if (lastNewline == std::string_view::npos)
+    {
+        return {start.line, start.column + text.size()};
+    }
+
+    size_t newlines = 0;
+    for (char c : text)
+    {
+        newlines += c == '\n';
+    }
+
+    return {start.line + newlines, text.size() - lastNewline - 1};
+}
+
+void MexHistory::apply(MexTextBuffer& document, const Position& start, std::string_view current, std::string_view replacement)
+{
+    Position end = endOf(start, current);
+    replaying = true;
+    document.replace(start.line, start.column, end.line, end.column, replacement);
+    replaying = false;
+}
@@ -0,0 +1,262 @@
+#include "../include/mexIgnore.h"
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::shared_ptr<const MexIgnoreRules> loadFile(const fs::path& file, const fs::path& directory,
+                                                   std::shared_ptr<const MexIgnoreRules> parent)
+    {
+        std::ifstream stream(file, std::ios::binary);
+        if (!stream.is_open())
+        {
+            return parent;
+        }
+
+        std::ostringstream content;
+        content << stream.rdbuf();
+        return std::make_shared<const MexIgnoreRules>(directory, content.str(), std::move(parent));
+    }
+}
+
+MexIgnoreRules::MexIgnoreRules(const fs::path& directory, std::string_view text, std::shared_ptr<const MexIgnoreRules> parent)
+    : base(directory.native())
+    , parent(std::move(parent))
+{
+    if (base.empty() or base.back() != '/')
+    {
+        base.push_back('/');
+    }
+
+    while (!text.empty())
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        if (!line.empty() and line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        // Trailing spaces are dropped unless escaped with a backslash.
+        while (!line.empty() and line.back() == ' ' and !(line.size() > 1 and line[line.size() - 2] == '\\'))
+        {
+            line.remove_suffix(1);
+        }
+        if (line.empty() or line.front() == '#')
+        {
+            continue;
+        }
+
+        Rule rule;
+        if (line.front() == '!')
+        {
+            rule.negated = true;
+            line.remove_prefix(1);
+        }
+        else if (line.starts_with("\\!") or line.starts_with("\\#"))
+        {
+            line.remove_prefix(1);
+        }
+
+        if (!line.empty() and line.back() == '/')
+        {
+            rule.directoryOnly = true;
+            line.remove_suffix(1);
+        }
+        rule.anchored = line.find('/') != std::string_view::npos;
+        if (!line.empty() and line.front() == '/')
+        {
+            line.remove_prefix(1);
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+
+        rule.pattern = line;
+        rules.push_back(std::move(rule));
+    }
+}
+
+std::shared_ptr<const MexIgnoreRules> MexIgnoreRules::load(const fs::path& directory, std::shared_ptr<const MexIgnoreRules> parent)
+{
+    return loadFile(directory / ".gitignore", directory, std::move(parent));
+}
+
+std::shared_ptr<const MexIgnoreRules> MexIgnoreRules::forParentsOf(const fs::path& directory)
+{
+    // The directories from the parent of directory up to the top of the work tree, innermost first.
+    std::error_code ec;
+    std::vector<fs::path> parents;
+    for (fs::path current = directory; !fs::exists(current / ".git", ec); current = current.parent_path())
+    {
+        if (!current.has_relative_path())
+        {
+            return nullptr;
+        }
+        parents.push_back(current.parent_path());
+    }
+
+    const fs::path& top = parents.empty() ? directory : parents.back();
+    std::shared_ptr<const MexIgnoreRules> rules = loadFile(top / ".git" / "info" / "exclude", top, nullptr);
+    for (auto it = parents.rbegin(); it != parents.rend(); ++it)
+    {
+        rules = load(*it, std::move(rules));
+    }
+    return rules;
+}
+
+bool MexIgnoreRules::isIgnored(std::string_view path, bool directory) const
+{
+    for (const MexIgnoreRules* current = this; current; current = current->parent.get())
+    {
+        if (!path.starts_with(current->base))
+        {
+            continue;
+        }
+
+        std::string_view relative = path.substr(current->base.size());
+        size_t slash = relative.rfind('/');
+        std::string_view name = slash == std::string_view::npos ? relative : relative.substr(slash + 1);
+
+        for (auto rule = current->rules.rbegin(); rule != current->rules.rend(); ++rule)
+        {
+            if (rule->directoryOnly and !directory)
+            {
+                continue;
+            }
+            if (matchGlob(rule->pattern, rule->anchored ? relative : name))
+            {
+                return !rule->negated;
+            }
+        }
+    }
+    return false;
+}
+
+bool MexIgnoreRules::matchGlob(std::string_view pattern, std::string_view text)
+{
+    while (!pattern.empty())
+    {
+        if (pattern.starts_with("**"))
+        {
+            pattern.remove_prefix(2);
+            if (pattern.empty())
+            {
+                return true;
+            }
+            if (pattern.front() == '/')
+            {
+                // "**/" matches any number of directories, including none.
+                pattern.remove_prefix(1);
+                for (size_t i = 0;; ++i)
+                {
+                    if (matchGlob(pattern, text.substr(i)))
+                    {
+                        return true;
+                    }
+                    i = text.find('/', i);
+                    if (i == std::string_view::npos)
+                    {
+                        return false;
+                    }
+                }
+            }
+            for (size_t i = 0; i <= text.size(); ++i)
+            {
+                if (matchGlob(pattern, text.substr(i)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        char c = pattern.front();
+        if (c == '*')
+        {
+            pattern.remove_prefix(1);
+            for (size_t i = 0; i <= text.size(); ++i)
+            {
+                if (matchGlob(pattern, text.substr(i)))
+                {
+                    return true;
+                }
+                if (i < text.size() and text[i] == '/')
+                {
+                    break;
+                }
+            }
+            return false;
+        }
+
+        if (text.empty())
+        {
+            return false;
+        }
+
+        size_t consumed = 1;
+        if (c == '?')
+        {
+            if (text.front() == '/')
+            {
+                return false;
+            }
+        }
+        else if (c == '[' and pattern.find(']', 2) != std::string_view::npos)
+        {
+            size_t i = 1;
+            bool negated = pattern[i] == '!' or pattern[i] == '^';
+            if (negated)
+            {
+                i++;
+            }
+
+            bool matched = false;
+            // A ']' right after the opening bracket is part of the set.
+            for (bool first = true; i < pattern.size() and (first or pattern[i] != ']'); first = false)
+            {
+                char low = pattern[i];
+                char high = low;
+                if (i + 2 < pattern.size() and pattern[i + 1] == '-' and pattern[i + 2] != ']')
+                {
+                    high = pattern[i + 2];
+                    i += 3;
+                }
+                else
+                {
+                    i++;
+                }
+                matched = matched or (text.front() >= low and text.front() <= high);
+            }
+            if (i >= pattern.size())
+            {
+                return false;
+            }
+            if (matched == negated or text.front() == '/')
+            {
+                return false;
+            }
+            consumed = i + 1;
+        }
+        else
+        {
+            if (c == '\\' and pattern.size() > 1)
+            {
+                pattern.remove_prefix(1);
+                c = pattern.front();
+            }
+            if (c != text.front())
+            {
+                return false;
+            }
+        }
+
+        pattern.remove_prefix(consumed);
+        text.remove_prefix(1);
+    }
+    return text.empty();
+}
@@ -0,0 +1,333 @@
+#include "../include/mexJournal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char journalMagic[8] = {'M', 'E', 'X', 'J', 'R', 'N', '0', '1'};
+
+    /// @brief The start of a journal file: the version of the file its edits apply to. \struct Header
+    struct Header
+    {
+        char magic[8];
+        int64_t writeTime;
+        uint64_t size;
+    };
+
+    // Every flush appends a frame: the length and checksum of its records, then the records.
+    struct FrameHeader
+    {
+        uint32_t length;
+        uint32_t checksum;
+    };
+
+    uint32_t checksumOf(std::string_view bytes)
+    {
+        // FNV-1a.
+        uint32_t hash = 2166136261u;
+        for (char c : bytes)
+        {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    void appendVarint(std::string& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    bool readVarint(std::string_view& in, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 and !in.empty(); shift += 7)
+        {
+            auto byte = static_cast<unsigned char>(in.front());
+            in.remove_prefix(1);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool writeAll(int fd, std::string_view bytes)
+    {
+        while (!bytes.empty())
+        {
+            ssize_t written = ::write(fd, bytes.data(), bytes.size());
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            bytes.remove_prefix(static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    bool stampOf(const fs::path& file, int64_t& writeTime, uint64_t& size)
+    {
+        std::error_code ec;
+        auto time = fs::last_write_time(file, ec);
+        if (ec)
+        {
+            return false;
+        }
+        size = fs::file_size(file, ec);
+        writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return !ec;
+    }
+}
+
+MexJournal::~MexJournal()
+{
+    flush();
+    close();
+}
+
+MexJournal::MexJournal(MexJournal&& other) noexcept
+{
+    swap(other);
+}
+
+MexJournal& MexJournal::operator=(MexJournal&& other) noexcept
+{
+    swap(other);
+    return *this;
+}
+
+void MexJournal::swap(MexJournal& other) noexcept
+{
+    std::swap(file, other.file);
+    std::swap(path, other.path);
+    std::swap(baseWriteTime, other.baseWriteTime);
+    std::swap(baseSize, other.baseSize);
+    std::swap(fd, other.fd);
+    std::swap(pending, other.pending);
+    std::swap(firstPending, other.firstPending);
+}
+
+void MexJournal::start(const fs::path& file)
+{
+    discard();
+    this->file = file;
+    if (file.empty() or !stampOf(file, baseWriteTime, baseSize))
+    {
+        this->file.clear();
+        return;
+    }
+
+    path = journalPath(file);
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+void MexJournal::discard()
+{
+    close();
+    pending.clear();
+    if (!path.empty())
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+    file.clear();
+    path.clear();
+}
+
+void MexJournal::detach()
+{
+    flush();
+    close();
+    file.clear();
+    path.clear();
+}
+
+void MexJournal::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void MexJournal::flush()
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    if (fd < 0)
+    {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+        Header header{};
+        std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+        header.writeTime = baseWriteTime;
+        header.size = baseSize;
+        if (fd >= 0 and !writeAll(fd, std::string_view(reinterpret_cast<const char*>(&header), sizeof(header))))
+        {
+            close();
+        }
+    }
+
+    // Without a journal file (e.g. in a read-only directory) the edits are only lost on a crash, as before.
+    if (fd >= 0)
+    {
+        FrameHeader frame{static_cast<uint32_t>(pending.size()), checksumOf(pending)};
+        std::string bytes(reinterpret_cast<const char*>(&frame), sizeof(frame));
+        bytes += pending;
+        writeAll(fd, bytes);
+    }
+    pending.clear();
+}
+
+void MexJournal::flushIfDue()
+{
+    if (!pending.empty() and std::chrono::steady_clock::now() - firstPending >= flushInterval)
+    {
+        flush();
+    }
+}
+
+int MexJournal::flushDelay() const
+{
+    if (pending.empty())
+    {
+        return -1;
+    }
+
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - firstPending);
+    return static_cast<int>(std::max<int64_t>(0, (flushInterval - waited).count()));
+}
+
+void MexJournal::onReplace(size_t line, size_t column, std::string_view removed, std::string_view inserted)
+{
+    if (file.empty())
+    {
+        return;
+    }
+
+    // The removed text is only needed for its extent: the lines it spans and the length of its last one.
+    size_t newlines = static_cast<size_t>(std::count(removed.begin(), removed.end(), '\n'));
+    size_t tail = newlines > 0 ? removed.size() - removed.rfind('\n') - 1 : removed.size();
+    if (pending.empty())
+    {
+        firstPending = std::chrono::steady_clock::now();
+    }
+    appendVarint(pending, line);
+    appendVarint(pending, column);
+    appendVarint(pending, newlines);
+    appendVarint(pending, tail);
+    appendVarint(pending, inserted.size());
+    pending += inserted;
+
+    if (pending.size() >= flushBytes)
+    {
+        flush();
+    }
+}
+
+MexJournal::Recovery MexJournal::recover(const fs::path& file)
+{
+    Recovery recovery;
+    std::ifstream stream(journalPath(file), std::ios::binary);
+    if (!stream.is_open())
+    {
+        return recovery;
+    }
+    std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    Header header{};
+    if (content.size() < sizeof(header))
+    {
+        return recovery;
+    }
+    std::memcpy(&header, content.data(), sizeof(header));
+    if (std::memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0)
+    {
+        return recovery;
+    }
+
+    int64_t writeTime = 0;
+    uint64_t size = 0;
+    recovery.found = true;
+    recovery.matchesFile = stampOf(file, writeTime, size) and writeTime == header.writeTime and size == header.size;
+
+    // A crash can leave the last frame incomplete; everything before it is intact.
+    std::string_view rest = std::string_view(content).substr(sizeof(header));
+    while (rest.size() >= sizeof(FrameHeader))
+    {
+        FrameHeader frame{};
+        std::memcpy(&frame, rest.data(), sizeof(frame));
+        rest.remove_prefix(sizeof(frame));
+        if (frame.length > rest.size() or checksumOf(rest.substr(0, frame.length)) != frame.checksum)
+        {
+            break;
+        }
+
+        std::string_view records = rest.substr(0, frame.length);
+        rest.remove_prefix(frame.length);
+        while (!records.empty())
+        {
+            uint64_t line, column, newlines, tail, length;
+            if (!readVarint(records, line) or !readVarint(records, column) or !readVarint(records, newlines) or
+                !readVarint(records, tail) or !readVarint(records, length) or length > records.size())
+            {
+                return recovery;
+            }
+
+            Edit edit;
+            edit.line = line;
+            edit.column = column;
+            edit.endLine = line + newlines;
+            edit.endColumn = newlines > 0 ? tail : column + tail;
+            edit.text = records.substr(0, length);
+            records.remove_prefix(length);
+            recovery.edits.push_back(std::move(edit));
+        }
+    }
+    return recovery;
+}
+
+size_t MexJournal::replay(const std::vector<Edit>& edits, MexTextBuffer& document)
+{
+    size_t applied = 0;
+    for (const Edit& edit : edits)
+    {
+        bool fits = document.hasLine(edit.endLine) and edit.column <= document.lineLength(edit.line) and
+                    edit.endColumn <= document.lineLength(edit.endLine) and
+                    (edit.line < edit.endLine or edit.column <= edit.endColumn);
+        if (!fits)
+        {
+            break;
+        }
+        document.replace(edit.line, edit.column, edit.endLine, edit.endColumn, edit.text);
+        applied++;
+    }
+    return applied;
+}
+
+fs::path MexJournal::journalPath(const fs::path& file)
+{
+    return file.parent_path() / ("." + file.filename().string() + ".mexjournal");
+}
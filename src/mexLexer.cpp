@@ -0,0 +1,337 @@
+#include "../include/mexLexer.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr std::array<uint8_t, 256> makeCharClasses()
+    {
+        std::array<uint8_t, 256> classes{};
+        for (int c = 'a'; c <= 'z'; ++c)
+        {
+            classes[c] = 1;
+        }
+        for (int c = 'A'; c <= 'Z'; ++c)
+        {
+            classes[c] = 1;
+        }
+        classes['_'] = 1;
+        for (int c = '0'; c <= '9'; ++c)
+        {
+            classes[c] = 2;
+        }
+        return classes;
+    }
+
+    // 1 marks bytes that start an identifier, 2 marks digits; both continue one.
+    constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+    bool isWord(char c)
+    {
+        return charClasses[static_cast<unsigned char>(c)] != 0;
+    }
+
+    bool isDigit(char c)
+    {
+        return charClasses[static_cast<unsigned char>(c)] == 2;
+    }
+
+    size_t skipWord(std::string_view line, size_t pos)
+    {
+        while (pos < line.size() and isWord(line[pos]))
+        {
+            pos++;
+        }
+        return pos;
+    }
+
+    size_t scanNumber(std::string_view line, size_t pos)
+    {
+        if (line[pos] == '0' and pos + 1 < line.size() and (line[pos + 1] == 'x' or line[pos + 1] == 'X'))
+        {
+            return skipWord(line, pos + 2);
+        }
+
+        while (pos < line.size() and isDigit(line[pos]))
+        {
+            pos++;
+        }
+        if (pos + 1 < line.size() and line[pos] == '.' and isDigit(line[pos + 1]))
+        {
+            pos++;
+            while (pos < line.size() and isDigit(line[pos]))
+            {
+                pos++;
+            }
+        }
+        if (pos < line.size() and (line[pos] == 'e' or line[pos] == 'E'))
+        {
+            size_t exponent = pos + 1;
+            if (exponent < line.size() and (line[exponent] == '+' or line[exponent] == '-'))
+            {
+                exponent++;
+            }
+            if (exponent < line.size() and isDigit(line[exponent]))
+            {
+                pos = exponent;
+            }
+        }
+
+        // Type suffixes such as 10u or 1.0f belong to the literal.
+        return skipWord(line, pos);
+    }
+}
+
+MexLexer::MexLexer(std::vector<Rule> languageRules, MexKeywordSet keywords)
+    : rules(std::move(languageRules))
+    , keywords(keywords)
+{
+    searchSlots.assign(rules.size(), 0);
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        const Rule& rule = rules[i];
+        if (rule.kind == Kind::Delimited or rule.kind == Kind::Link)
+        {
+            searchSlots[i] = static_cast<uint16_t>(searchCount);
+            searchCount += rule.kind == Kind::Link ? 2 : 1;
+        }
+
+        switch (rule.kind)
+        {
+            case Kind::Identifier:
+                identifierColor = rule.colorPair;
+                break;
+            case Kind::Number:
+                numberColor = rule.colorPair;
+                break;
+            case Kind::LinePrefix:
+            case Kind::NumberedPrefix:
+                linePrefixes.push_back(static_cast<uint16_t>(i));
+                break;
+            default:
+                if (!rule.open.empty())
+                {
+                    openers[static_cast<unsigned char>(rule.open[0])].push_back(static_cast<uint16_t>(i));
+                }
+                break;
+        }
+    }
+
+    for (auto& candidates : openers)
+    {
+        std::stable_sort(candidates.begin(), candidates.end(), [this](uint16_t a, uint16_t b)
+        {
+            return rules[a].open.size() > rules[b].open.size();
+        });
+    }
+}
+
+MexLexer::State MexLexer::tokenize(std::string_view line, State state, std::vector<Token>& tokens) const
+{
+    tokens.clear();
+
+    std::vector<Search> searches(searchCount);
+    size_t pos = 0;
+    if (state != 0)
+    {
+        const Rule& rule = rules[state - 1];
+        size_t end = findClose(rule, line, 0);
+        if (end == std::string_view::npos)
+        {
+            tokens.push_back({0, static_cast<int>(line.size()), rule.colorPair});
+            return state;
+        }
+
+        tokens.push_back({0, static_cast<int>(end), rule.colorPair});
+        pos = end;
+    }
+    else
+    {
+        for (uint16_t index : linePrefixes)
+        {
+            const Rule& rule = rules[index];
+            size_t prefixEnd = 0;
+            if (rule.kind == Kind::NumberedPrefix)
+            {
+                while (prefixEnd < line.size() and isDigit(line[prefixEnd]))
+                {
+                    prefixEnd++;
+                }
+                if (prefixEnd == 0)
+                {
+                    continue;
+                }
+            }
+
+            if (line.substr(prefixEnd).starts_with(rule.open))
+            {
+                tokens.push_back({0, static_cast<int>(line.size()), rule.colorPair});
+                return 0;
+            }
+        }
+    }
+
+    while (pos < line.size())
+    {
+        char c = line[pos];
+
+        bool matched = false;
+        for (uint16_t index : openers[static_cast<unsigned char>(c)])
+        {
+            const Rule& rule = rules[index];
+            if (!line.substr(pos).starts_with(rule.open))
+            {
+                continue;
+            }
+
+            if (rule.kind == Kind::BlockComment or rule.kind == Kind::BlockString)
+            {
+                size_t end = findClose(rule, line, pos + rule.open.size());
+                if (end == std::string_view::npos)
+                {
+                    tokens.push_back({static_cast<int>(pos), static_cast<int>(line.size() - pos), rule.colorPair});
+                    return static_cast<State>(index + 1);
+                }
+
+                tokens.push_back({static_cast<int>(pos), static_cast<int>(end - pos), rule.colorPair});
+                pos = end;
+                matched = true;
+                break;
+            }
+
+            size_t end = match(rule, line, pos, searches.data() + searchSlots[index]);
+            if (end != std::string_view::npos)
+            {
+                tokens.push_back({static_cast<int>(pos), static_cast<int>(end - pos), rule.colorPair});
+                pos = end;
+                matched = true;
+                break;
+            }
+        }
+        if (matched)
+        {
+            continue;
+        }
+
+        if (isDigit(c))
+        {
+            size_t end = scanNumber(line, pos);
+            if (numberColor >= 0)
+            {
+                tokens.push_back({static_cast<int>(pos), static_cast<int>(end - pos), numberColor});
+            }
+            pos = end;
+        }
+        else if (isWord(c))
+        {
+            size_t end = skipWord(line, pos);
+            int color = keywords.find(line.substr(pos, end - pos));
+            if (color < 0)
+            {
+                color = identifierColor;
+            }
+            if (color >= 0)
+            {
+                tokens.push_back({static_cast<int>(pos), static_cast<int>(end - pos), color});
+            }
+            pos = end;
+        }
+        else
+        {
+            pos++;
+        }
+    }
+
+    return 0;
+}
+
+size_t MexLexer::match(const Rule& rule, std::string_view line, size_t pos, Search* searches)
+{
+    size_t body = pos + rule.open.size();
+    switch (rule.kind)
+    {
+        case Kind::LineComment:
+            return line.size();
+
+        case Kind::String:
+        {
+            size_t end = findClose(rule, line, body);
+            return end == std::string_view::npos ? line.size() : end;
+        }
+
+        case Kind::PrefixedWord:
+        {
+            size_t end = skipWord(line, body);
+            return end > body ? end : std::string_view::npos;
+        }
+
+        case Kind::Directive:
+        {
+            if (pos != 0)
+            {
+                return std::string_view::npos;
+            }
+            while (body < line.size() and (line[body] == ' ' or line[body] == '\t'))
+            {
+                body++;
+            }
+            size_t end = skipWord(line, body);
+            return end > body ? end : std::string_view::npos;
+        }
+
+        case Kind::Delimited:
+        {
+            size_t close = find(line, rule.close, body + 1, searches[0]);
+            return close == std::string_view::npos ? close : close + rule.close.size();
+        }
+
+        case Kind::Link:
+        {
+            size_t middle = find(line, "](", body, searches[0]);
+            if (middle == std::string_view::npos)
+            {
+                return middle;
+            }
+            size_t close = find(line, rule.close, middle + 2, searches[1]);
+            return close == std::string_view::npos ? close : close + rule.close.size();
+        }
+
+        case Kind::Literal:
+            return body;
+
+        default:
+            return std::string_view::npos;
+    }
+}
+
+size_t MexLexer::find(std::string_view line, std::string_view needle, size_t pos, Search& search)
+{
+    if (search.from <= pos and (search.at == std::string_view::npos or pos <= search.at))
+    {
+        return search.at;
+    }
+
+    search = {pos, line.find(needle, pos)};
+    return search.at;
+}
+
+size_t MexLexer::findClose(const Rule& rule, std::string_view line, size_t pos)
+{
+    if (rule.kind == Kind::BlockComment)
+    {
+        size_t close = line.find(rule.close, pos);
+        return close == std::string_view::npos ? close : close + rule.close.size();
+    }
+
+    for (size_t i = pos; i < line.size(); ++i)
+    {
+        if (line[i] == '\\')
+        {
+            i++;
+        }
+        else if (line.substr(i).starts_with(rule.close))
+        {
+            return i + rule.close.size();
+        }
+    }
+    return std::string_view::npos;
+}
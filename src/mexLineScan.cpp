@@ -0,0 +1,164 @@
+#include "../include/mexLineScan.h"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MEXEDIT_X86 1
+#endif
+
+namespace
+{
+    size_t countScalar(const char* data, size_t size)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            count += data[i] == '\n';
+        }
+        return count;
+    }
+
+#ifdef MEXEDIT_X86
+    // Both vector loops add the compare masks (0 or -1 per byte) into byte counters and
+    // fold them into 64-bit sums with psadbw before any lane can overflow.
+
+    __attribute__((target("sse2")))
+    size_t countSSE2(const char* data, size_t size)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i zero = _mm_setzero_si128();
+        __m128i total = zero;
+        size_t i = 0;
+
+        while (i + 16 <= size)
+        {
+            __m128i counters = zero;
+            size_t blockEnd = i + 255 * 16 < size ? i + 255 * 16 : size;
+            for (; i + 16 <= blockEnd; i += 16)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(bytes, newline));
+            }
+            total = _mm_add_epi64(total, _mm_sad_epu8(counters, zero));
+        }
+
+        size_t count = static_cast<size_t>(_mm_cvtsi128_si64(total)) +
+                       static_cast<size_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total)));
+        return count + countScalar(data + i, size - i);
+    }
+
+    __attribute__((target("avx2")))
+    size_t countAVX2(const char* data, size_t size)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i total = zero;
+        size_t i = 0;
+
+        while (i + 32 <= size)
+        {
+            __m256i counters = zero;
+            size_t blockEnd = i + 255 * 32 < size ? i + 255 * 32 : size;
+            for (; i + 32 <= blockEnd; i += 32)
+            {
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(bytes, newline));
+            }
+            total = _mm256_add_epi64(total, _mm256_sad_epu8(counters, zero));
+        }
+
+        size_t count = static_cast<size_t>(_mm256_extract_epi64(total, 0)) +
+                       static_cast<size_t>(_mm256_extract_epi64(total, 1)) +
+                       static_cast<size_t>(_mm256_extract_epi64(total, 2)) +
+                       static_cast<size_t>(_mm256_extract_epi64(total, 3));
+        return count + countScalar(data + i, size - i);
+    }
+
+    __attribute__((target("avx2")))
+    const char* findAVX2(const char* begin, const char* end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        for (; begin + 32 <= end; begin += 32)
+        {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)));
+            if (mask)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+        }
+
+        const void* found = begin < end ? std::memchr(begin, '\n', end - begin) : nullptr;
+        return found ? static_cast<const char*>(found) : end;
+    }
+#endif
+
+    MexLineScan::Isa detectIsa()
+    {
+#ifdef MEXEDIT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return MexLineScan::Isa::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2"))
+        {
+            return MexLineScan::Isa::SSE2;
+        }
+#endif
+        return MexLineScan::Isa::Scalar;
+    }
+}
+
+MexLineScan::Isa MexLineScan::bestIsa()
+{
+    static const Isa isa = detectIsa();
+    return isa;
+}
+
+const char* MexLineScan::isaName(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::AVX2:
+            return "AVX2";
+        case Isa::SSE2:
+            return "SSE2";
+        default:
+            return "scalar";
+    }
+}
+
+size_t MexLineScan::countNewlines(const char* data, size_t size)
+{
+    return countNewlines(data, size, bestIsa());
+}
+
+size_t MexLineScan::countNewlines(const char* data, size_t size, Isa isa)
+{
+#ifdef MEXEDIT_X86
+    switch (isa)
+    {
+        case Isa::AVX2:
+            return countAVX2(data, size);
+        case Isa::SSE2:
+            return countSSE2(data, size);
+        default:
+            break;
+    }
+#endif
+    return countScalar(data, size);
+}
+
+const char* MexLineScan::findNewline(const char* begin, const char* end)
+{
+#ifdef MEXEDIT_X86
+    if (bestIsa() == Isa::AVX2)
+    {
+        return findAVX2(begin, end);
+    }
+#endif
+    // memchr is already vectorized by the C library on every other target.
+    const void* found = begin < end ? std::memchr(begin, '\n', end - begin) : nullptr;
+    return found ? static_cast<const char*>(found) : end;
+}
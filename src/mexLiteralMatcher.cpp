@@ -0,0 +1,225 @@
+#include "../include/mexLiteralMatcher.h"
+#include "../include/mexLineScan.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MEXEDIT_X86 1
+#endif
+
+namespace
+{
+    constexpr std::array<uint8_t, 256> makeFoldTable()
+    {
+        std::array<uint8_t, 256> table{};
+        for (int c = 0; c < 256; ++c)
+        {
+            table[c] = static_cast<uint8_t>(c >= 'A' and c <= 'Z' ? c + ('a' - 'A') : c);
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> foldTable = makeFoldTable();
+
+    uint8_t fold(char c)
+    {
+        return foldTable[static_cast<unsigned char>(c)];
+    }
+
+    bool isLetter(char c)
+    {
+        return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z');
+    }
+
+    bool isWord(char c)
+    {
+        return isLetter(c) or (c >= '0' and c <= '9') or c == '_';
+    }
+
+#ifdef MEXEDIT_X86
+    // Both scans test the first and the last byte of the needle at 16 or 32 positions per step and only
+    // verify positions where both agree. Setting bit 0x20 folds an ASCII letter to lowercase; the needle is
+    // already folded, and only the case pair of a letter maps onto it.
+
+    template<typename Equals>
+    __attribute__((target("sse2")))
+    size_t findPairSSE2(const char* data, size_t size, size_t from, char first, char last, size_t length,
+                        bool foldFirst, bool foldLast, const Equals& equals)
+    {
+        const __m128i firstBytes = _mm_set1_epi8(first);
+        const __m128i lastBytes = _mm_set1_epi8(last);
+        const __m128i firstCase = _mm_set1_epi8(foldFirst ? 0x20 : 0);
+        const __m128i lastCase = _mm_set1_epi8(foldLast ? 0x20 : 0);
+
+        size_t i = from;
+        for (; i + length - 1 + 16 <= size; i += 16)
+        {
+            __m128i head = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), firstCase);
+            __m128i tail = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + length - 1)), lastCase);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(head, firstBytes), _mm_cmpeq_epi8(tail, lastBytes))));
+            while (mask)
+            {
+                size_t candidate = i + __builtin_ctz(mask);
+                if (equals(data + candidate))
+                {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+
+        for (; i + length <= size; ++i)
+        {
+            if (equals(data + i))
+            {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    template<typename Equals>
+    __attribute__((target("avx2")))
+    size_t findPairAVX2(const char* data, size_t size, size_t from, char first, char last, size_t length,
+                        bool foldFirst, bool foldLast, const Equals& equals)
+    {
+        const __m256i firstBytes = _mm256_set1_epi8(first);
+        const __m256i lastBytes = _mm256_set1_epi8(last);
+        const __m256i firstCase = _mm256_set1_epi8(foldFirst ? 0x20 : 0);
+        const __m256i lastCase = _mm256_set1_epi8(foldLast ? 0x20 : 0);
+
+        size_t i = from;
+        for (; i + length - 1 + 32 <= size; i += 32)
+        {
+            __m256i head = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), firstCase);
+            __m256i tail = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + length - 1)), lastCase);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(head, firstBytes), _mm256_cmpeq_epi8(tail, lastBytes))));
+            while (mask)
+            {
+                size_t candidate = i + __builtin_ctz(mask);
+                if (equals(data + candidate))
+                {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+
+        return findPairSSE2(data, size, i, first, last, length, foldFirst, foldLast, equals);
+    }
+#endif
+}
+
+MexLiteralMatcher::MexLiteralMatcher(std::string_view needle, bool caseSensitive, bool wholeWord)
+    : needle(needle)
+    , caseSensitive(caseSensitive)
+    , wholeWord(wholeWord)
+{
+    if (!caseSensitive)
+    {
+        std::transform(this->needle.begin(), this->needle.end(), this->needle.begin(), [](char c)
+        {
+            return static_cast<char>(fold(c));
+        });
+    }
+
+    size_t length = this->needle.size();
+    shift.fill(static_cast<uint8_t>(std::min<size_t>(length, 255)));
+    for (size_t i = 0; i + 1 < length; ++i)
+    {
+        auto distance = static_cast<uint8_t>(std::min<size_t>(length - 1 - i, 255));
+        unsigned char c = static_cast<unsigned char>(this->needle[i]);
+        shift[c] = distance;
+        if (!caseSensitive and isLetter(static_cast<char>(c)))
+        {
+            shift[c & ~0x20] = distance;
+        }
+    }
+}
+
+size_t MexLiteralMatcher::find(std::string_view text, size_t from) const
+{
+    while (true)
+    {
+        size_t candidate = findCandidate(text, from);
+        if (candidate == std::string_view::npos or !wholeWord or onWordBoundaries(text, candidate))
+        {
+            return candidate;
+        }
+        from = candidate + 1;
+    }
+}
+
+bool MexLiteralMatcher::matchesAt(std::string_view text, size_t offset) const
+{
+    return occursAt(text, offset) and (!wholeWord or onWordBoundaries(text, offset));
+}
+
+size_t MexLiteralMatcher::findCandidate(std::string_view text, size_t from) const
+{
+    if (needle.empty() or from + needle.size() > text.size())
+    {
+        return std::string_view::npos;
+    }
+
+#ifdef MEXEDIT_X86
+    char first = needle.front();
+    char last = needle.back();
+    bool foldFirst = !caseSensitive and isLetter(first);
+    bool foldLast = !caseSensitive and isLetter(last);
+    auto equals = [this](const char* data) { return this->equals(data); };
+
+    if (MexLineScan::bestIsa() == MexLineScan::Isa::AVX2)
+    {
+        return findPairAVX2(text.data(), text.size(), from, first, last, needle.size(), foldFirst, foldLast, equals);
+    }
+    return findPairSSE2(text.data(), text.size(), from, first, last, needle.size(), foldFirst, foldLast, equals);
+#else
+    return findHorspool(text, from);
+#endif
+}
+
+size_t MexLiteralMatcher::findHorspool(std::string_view text, size_t from) const
+{
+    size_t length = needle.size();
+    uint8_t last = static_cast<uint8_t>(needle.back());
+
+    for (size_t i = from; i + length <= text.size();)
+    {
+        char c = text[i + length - 1];
+        if ((caseSensitive ? static_cast<uint8_t>(c) : fold(c)) == last and equals(text.data() + i))
+        {
+            return i;
+        }
+        i += shift[static_cast<unsigned char>(c)];
+    }
+    return std::string_view::npos;
+}
+
+bool MexLiteralMatcher::equals(const char* data) const
+{
+    if (caseSensitive)
+    {
+        return std::memcmp(data, needle.data(), needle.size()) == 0;
+    }
+
+    for (size_t i = 0; i < needle.size(); ++i)
+    {
+        if (fold(data[i]) != static_cast<uint8_t>(needle[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MexLiteralMatcher::onWordBoundaries(std::string_view text, size_t offset) const
+{
+    size_t end = offset + needle.size();
+    bool before = offset > 0 and isWord(text[offset - 1]);
+    bool after = end < text.size() and isWord(text[end]);
+    return before != isWord(needle.front()) and after != isWord(needle.back());
+}
@@ -0,0 +1,189 @@
+#include "../include/mexMappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /// @brief A mapping the SIGBUS handler may patch; begin is 0 while the slot is free. \struct GuardSlot
+    struct GuardSlot
+    {
+        std::atomic<uintptr_t> begin{0};
+        std::atomic<uintptr_t> end{0};
+    };
+
+    // Mappings beyond the last slot are not guarded; an editor rarely holds this many files at once.
+    constexpr size_t guardSlotCount = 256;
+    GuardSlot guardSlots[guardSlotCount];
+    std::mutex guardMutex;
+    std::once_flag guardInstalled;
+    struct sigaction previousAction{};
+    uintptr_t guardPageSize = 0;
+
+    void onBusError(int signal, siginfo_t* info, void* context)
+    {
+        auto address = reinterpret_cast<uintptr_t>(info->si_addr);
+        for (const GuardSlot& slot : guardSlots)
+        {
+            uintptr_t begin = slot.begin.load(std::memory_order_acquire);
+            uintptr_t end = slot.end.load(std::memory_order_acquire);
+            if (begin == 0 or address < begin or address >= end)
+            {
+                continue;
+            }
+
+            // The file lost its end: the rest of the mapping reads as zeros from now on, and the read is retried.
+            uintptr_t page = address & ~(guardPageSize - 1);
+            if (mmap(reinterpret_cast<void*>(page), end - page, PROT_READ, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) != MAP_FAILED)
+            {
+                return;
+            }
+            break;
+        }
+
+        // Not ours: whoever handled SIGBUS before does, or the default action ends the process on the retried read.
+        if (previousAction.sa_flags & SA_SIGINFO)
+        {
+            previousAction.sa_sigaction(signal, info, context);
+        }
+        else if (previousAction.sa_handler != SIG_DFL and previousAction.sa_handler != SIG_IGN)
+        {
+            previousAction.sa_handler(signal);
+        }
+        else
+        {
+            sigaction(SIGBUS, &previousAction, nullptr);
+        }
+    }
+
+    void installGuard()
+    {
+        guardPageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+        struct sigaction action{};
+        action.sa_sigaction = onBusError;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGBUS, &action, &previousAction);
+    }
+
+    void guard(const char* bytes, size_t length)
+    {
+        std::call_once(guardInstalled, installGuard);
+
+        std::lock_guard<std::mutex> lock(guardMutex);
+        for (GuardSlot& slot : guardSlots)
+        {
+            if (slot.begin.load(std::memory_order_relaxed) == 0)
+            {
+                auto begin = reinterpret_cast<uintptr_t>(bytes);
+                slot.end.store((begin + length + guardPageSize - 1) & ~(guardPageSize - 1), std::memory_order_release);
+                slot.begin.store(begin, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    void unguard(const char* bytes)
+    {
+        std::lock_guard<std::mutex> lock(guardMutex);
+        for (GuardSlot& slot : guardSlots)
+        {
+            if (slot.begin.load(std::memory_order_relaxed) == reinterpret_cast<uintptr_t>(bytes))
+            {
+                slot.begin.store(0, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    int64_t writeTimeOf(const struct stat& info)
+    {
+#ifdef __APPLE__
+        return static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    }
+}
+
+MexMappedFile::~MexMappedFile()
+{
+    if (bytes)
+    {
+        unguard(bytes);
+        munmap(const_cast<char*>(bytes), length);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool MexMappedFile::open(const std::filesystem::path& path)
+{
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat info{};
+    if (fstat(file, &info) != 0 or info.st_size <= 0)
+    {
+        close(file);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(file);
+        return false;
+    }
+
+    madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+    bytes = static_cast<const char*>(mapping);
+    length = static_cast<size_t>(info.st_size);
+    fd = file;
+    mappedWriteTime = writeTimeOf(info);
+    guard(bytes, length);
+    return true;
+}
+
+void MexMappedFile::release(size_t offset, size_t count) const
+{
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = (offset + count) / pageSize * pageSize;
+    if (end > begin)
+    {
+        madvise(const_cast<char*>(bytes) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+bool MexMappedFile::changedOnDisk() const
+{
+    struct stat info{};
+    if (fd < 0 or fstat(fd, &info) != 0)
+    {
+        return false;
+    }
+    return static_cast<size_t>(info.st_size) != length or writeTimeOf(info) != mappedWriteTime;
+}
+
+size_t MexMappedFile::readableSize() const
+{
+    struct stat info{};
+    if (fd < 0 or fstat(fd, &info) != 0)
+    {
+        return length;
+    }
+    return std::min(length, static_cast<size_t>(info.st_size));
+}
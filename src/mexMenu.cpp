@@ -98,6 +98,11 @@ void MexMenu::showHelp()
     mvprintw(startY + line++, startX, "%-15s %-15s %s", "Search", "/", "Start search mode");
     mvprintw(startY + line++, startX, "%-15s %-15s %s", "Find Next", "Ctrl+N", "Find next match");
     mvprintw(startY + line++, startX, "%-15s %-15s %s", "Command Mode", ":", "Enter commands");
+    mvprintw(startY + line++, startX, "%-15s %-15s %s", "Search Project", ":grep PATTERN", "Search files below the explorer's directory");
+    mvprintw(startY + line++, startX, "%-15s %-15s %s", "Grep Results", "Ctrl+G", "Reopen the last project search");
+    mvprintw(startY + line++, startX, "%-15s %-15s %s", "Open File", "Ctrl+P", "Find a file below the explorer's directory by name");
+    mvprintw(startY + line++, startX, "%-15s %-15s %s", "Open Files", "Ctrl+B", "Switch to another open file");
+    mvprintw(startY + line++, startX, "%-15s %-15s %s", "Search Index", ":index on|off", "Keep a trigram index for :grep");
 
     line++;
     for (const auto& item : menuItems)
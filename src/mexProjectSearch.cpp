@@ -0,0 +1,397 @@
+#include "../include/mexProjectSearch.h"
+#include "../include/mexLineScan.h"
+#include "../include/mexMappedFile.h"
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Like git, a file with a NUL byte in its first bytes is taken to be binary.
+    constexpr size_t binaryProbeBytes = 8000;
+    // Smaller files are read instead of mapped: for them, setting up and tearing down a mapping costs more
+    // than copying the bytes.
+    constexpr size_t mapBytes = 1 << 20;
+
+    fs::path normalRoot(const fs::path& root)
+    {
+        std::error_code ec;
+        fs::path normal = fs::absolute(root, ec).lexically_normal();
+        if (!normal.has_filename() and normal != normal.root_path())
+        {
+            normal = normal.parent_path();
+        }
+        return normal;
+    }
+
+    // A regex without special characters is the literal it matches, so the index can narrow it down too.
+    bool isPlainRegex(std::string_view pattern)
+    {
+        return pattern.find_first_of("\\^$.|?*+()[]{}") == std::string_view::npos;
+    }
+}
+
+MexProjectSearch::~MexProjectSearch()
+{
+    cancel();
+}
+
+bool MexProjectSearch::start(const fs::path& root, const std::string& pattern)
+{
+    cancel();
+    results.clear();
+    pending.clear();
+    matches = 0;
+    files = 0;
+
+    this->root = normalRoot(root);
+    this->pattern = pattern;
+    literal.reset();
+    regex.reset();
+
+    if (pattern.empty())
+    {
+        return false;
+    }
+    if (regexMode)
+    {
+        std::regex::flag_type flags = std::regex_constants::ECMAScript;
+        if (!caseSensitive)
+        {
+            flags |= std::regex_constants::icase;
+        }
+
+        try
+        {
+            regex = std::make_shared<const std::regex>(pattern, flags);
+        }
+        catch (const std::regex_error&)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Matches never span lines, as in the buffer search.
+        if (pattern.find('\n') != std::string::npos)
+        {
+            return false;
+        }
+        literal = std::make_shared<const MexLiteralMatcher>(pattern, caseSensitive, wholeWord);
+    }
+
+    indexUsed = false;
+    if (indexed)
+    {
+        std::shared_ptr<const MexTrigramIndex> current;
+        {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            current = index;
+        }
+        if (!current or current->getRoot() != this->root.native())
+        {
+            current = MexTrigramIndex::load(this->root);
+        }
+
+        std::optional<std::vector<std::string>> candidates;
+        if (current and (!regexMode or isPlainRegex(pattern)))
+        {
+            candidates = current->candidates(pattern);
+        }
+        if (candidates)
+        {
+            indexUsed = true;
+            for (std::string& file : *candidates)
+            {
+                tasks.push_back({std::move(file), nullptr, false});
+            }
+        }
+        updateIndex(this->root);
+    }
+
+    if (!indexUsed)
+    {
+        tasks.push_back({this->root.native(), MexIgnoreRules::forParentsOf(this->root), true});
+    }
+    busy = 0;
+
+    size_t threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    running = threads;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this](std::stop_token stop)
+        {
+            work(stop);
+            running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    return true;
+}
+
+void MexProjectSearch::cancel()
+{
+    // Destroying the threads stops and joins them.
+    workers.clear();
+    tasks.clear();
+    running = 0;
+}
+
+void MexProjectSearch::updateIndex(const fs::path& root)
+{
+    fs::path normal = normalRoot(root);
+    std::shared_ptr<const MexTrigramIndex> previous;
+    {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        if (index and index->getRoot() == normal.native())
+        {
+            if (std::chrono::steady_clock::now() - indexTime < indexRefreshInterval)
+            {
+                return;
+            }
+            previous = index;
+        }
+    }
+    if (indexing.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    if (!previous)
+    {
+        previous = MexTrigramIndex::load(normal);
+    }
+
+    // The previous build has finished, so replacing its thread only joins it.
+    indexer = std::jthread([this, normal, previous, threads = threadCount](std::stop_token stop)
+    {
+        std::shared_ptr<const MexTrigramIndex> built = MexTrigramIndex::build(normal, previous.get(), threads, stop);
+        if (built)
+        {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            index = std::move(built);
+            indexTime = std::chrono::steady_clock::now();
+        }
+        indexing.store(false, std::memory_order_release);
+    });
+}
+
+bool MexProjectSearch::collectResults()
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (pending.empty())
+    {
+        return false;
+    }
+
+    results.insert(results.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+    pending.clear();
+    return true;
+}
+
+bool MexProjectSearch::isSearching() const
+{
+    return running.load(std::memory_order_acquire) > 0;
+}
+
+void MexProjectSearch::work(const std::stop_token& stop)
+{
+    while (true)
+    {
+        Entry task;
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            taskReady.wait(lock, stop, [this] { return !tasks.empty() or busy == 0; });
+            if (tasks.empty() or stop.stop_requested())
+            {
+                return;
+            }
+            task = std::move(tasks.back());
+            tasks.pop_back();
+            busy++;
+        }
+
+        if (task.directory)
+        {
+            std::vector<Entry> found;
+            listDirectory(task, found);
+            if (!found.empty())
+            {
+                std::lock_guard<std::mutex> lock(taskMutex);
+                tasks.insert(tasks.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+                taskReady.notify_all();
+            }
+        }
+        else
+        {
+            searchFile(task.path, stop);
+        }
+
+        std::lock_guard<std::mutex> lock(taskMutex);
+        busy--;
+        if (tasks.empty() and busy == 0)
+        {
+            taskReady.notify_all();
+        }
+    }
+}
+
+void MexProjectSearch::listDirectory(const Entry& task, std::vector<Entry>& found)
+{
+    DIR* directory = opendir(task.path.c_str());
+    if (!directory)
+    {
+        return;
+    }
+
+    std::string prefix = task.path.ends_with('/') ? task.path : task.path + "/";
+
+    // The entry types come from the directory listing, so files are not stat'ed one by one.
+    std::vector<std::pair<std::string, bool>> entries;
+    bool hasIgnoreFile = false;
+    while (dirent* entry = readdir(directory))
+    {
+        std::string_view name = entry->d_name;
+        if (name == "." or name == ".." or name == ".git")
+        {
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+        std::string path = prefix + entry->d_name;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat info{};
+            type = lstat(path.c_str(), &info) != 0 ? DT_UNKNOWN : S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR or type == DT_REG)
+        {
+            hasIgnoreFile = hasIgnoreFile or name == ".gitignore";
+            entries.emplace_back(std::move(path), type == DT_DIR);
+        }
+    }
+    closedir(directory);
+
+    std::shared_ptr<const MexIgnoreRules> ignore = task.ignore;
+    if (hasIgnoreFile)
+    {
+        ignore = MexIgnoreRules::load(task.path, std::move(ignore));
+    }
+
+    for (auto& [path, isDirectory] : entries)
+    {
+        if (!ignore or !ignore->isIgnored(path, isDirectory))
+        {
+            found.push_back({std::move(path), isDirectory ? ignore : nullptr, isDirectory});
+        }
+    }
+}
+
+bool MexProjectSearch::isBinary(std::string_view text)
+{
+    return std::memchr(text.data(), 0, std::min(text.size(), binaryProbeBytes)) != nullptr;
+}
+
+std::string_view MexProjectSearch::readFile(const std::string& path, std::string& buffer, MexMappedFile& file)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return {};
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0 or info.st_size <= 0)
+    {
+        close(fd);
+        return {};
+    }
+
+    if (static_cast<size_t>(info.st_size) < mapBytes)
+    {
+        buffer.resize(static_cast<size_t>(info.st_size));
+        ssize_t count = read(fd, buffer.data(), buffer.size());
+        close(fd);
+        return std::string_view(buffer.data(), count > 0 ? static_cast<size_t>(count) : 0);
+    }
+
+    close(fd);
+    if (!file.open(path))
+    {
+        return {};
+    }
+    return std::string_view(file.data(), file.size());
+}
+
+void MexProjectSearch::searchFile(const std::string& path, const std::stop_token& stop)
+{
+    thread_local std::string buffer;
+    MexMappedFile file;
+    std::string_view text = readFile(path, buffer, file);
+    if (text.empty())
+    {
+        return;
+    }
+    if (isBinary(text))
+    {
+        return;
+    }
+    files.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<Result> found;
+    auto report = [&](size_t lineNum, size_t lineStart, size_t column, size_t length)
+    {
+        if (matches.fetch_add(1, std::memory_order_relaxed) >= maxResults)
+        {
+            return;
+        }
+
+        size_t lineEnd = std::min(text.find('\n', lineStart + column), text.size());
+        std::string_view line = text.substr(lineStart, lineEnd - lineStart);
+        if (!line.empty() and line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        found.push_back({path, lineNum, column, length, std::string(line.substr(0, previewBytes))});
+    };
+
+    if (literal)
+    {
+        size_t lineNum = 0;
+        size_t lineStart = 0;
+        size_t scanned = 0;
+        literal->forEach(text, [&](size_t offset)
+        {
+            size_t newlines = MexLineScan::countNewlines(text.data() + scanned, offset - scanned);
+            if (newlines > 0)
+            {
+                lineNum += newlines;
+                lineStart = text.rfind('\n', offset - 1) + 1;
+            }
+            scanned = offset;
+            report(lineNum, lineStart, offset - lineStart, literal->size());
+        });
+    }
+    else
+    {
+        size_t lineNum = 0;
+        for (size_t lineStart = 0; lineStart < text.size() and !stop.stop_requested(); ++lineNum)
+        {
+            size_t lineEnd = std::min(text.find('\n', lineStart), text.size());
+            std::cregex_iterator it(text.data() + lineStart, text.data() + lineEnd, *regex);
+            for (std::cregex_iterator end; it != end; ++it)
+            {
+                report(lineNum, lineStart, it->position(), it->length());
+            }
+            lineStart = lineEnd + 1;
+        }
+    }
+
+    if (!found.empty())
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        pending.insert(pending.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+}
@@ -1,8 +1,354 @@
 #include "../include/mexSearch.h"
+#include "../include/mexLineScan.h"
+#include "../include/mexLiteralMatcher.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <iostream>
 
+namespace
+{
+    using Match = std::pair<size_t, std::pair<size_t, size_t>>;
+    using Position = std::pair<size_t, size_t>;
+
+    struct Chunk
+    {
+        size_t firstLine;
+        std::string_view text;
+    };
+
+    struct GroupResult
+    {
+        std::vector<Match> matches;
+        std::vector<Position> occurrences;
+    };
+
+    // Documents smaller than this are searched on the calling thread.
+    constexpr size_t minParallelBytes = 1 << 20;
+    // Each thread gets several groups of chunks, so a thread that finishes early can take over more work.
+    constexpr size_t groupsPerThread = 4;
+
+    size_t resolveThreads(size_t threadCount)
+    {
+        return threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * @brief Splits the stored chunks of a document into contiguous groups of about the same number of bytes.
+     * @param chunks The chunks of the document, in order.
+     * @param threads The number of threads that will search the groups.
+     * @return The group boundaries as indices into chunks: group i is [bounds[i], bounds[i + 1]).
+     */
+    std::vector<size_t> splitChunks(const std::vector<Chunk>& chunks, size_t threads)
+    {
+        size_t total = 0;
+        for (const Chunk& chunk : chunks)
+        {
+            total += chunk.text.size();
+        }
+
+        size_t groups = total < minParallelBytes ? 1 : threads * groupsPerThread;
+        std::vector<size_t> bounds{0};
+        size_t bytes = 0;
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            bytes += chunks[i].text.size();
+            if (i + 1 < chunks.size() and bytes * groups >= total * bounds.size())
+            {
+                bounds.push_back(i + 1);
+            }
+        }
+        bounds.push_back(chunks.size());
+        return bounds;
+    }
+
+    std::vector<Chunk> collectChunks(const MexTextBuffer& document)
+    {
+        std::vector<Chunk> chunks;
+        document.forEachChunk([&](size_t firstLine, std::string_view text)
+        {
+            chunks.push_back({firstLine, text});
+        });
+        return chunks;
+    }
+
+    /**
+     * @brief Runs fn(task) for every task on up to threads threads, the calling thread included.
+     * @param tasks The number of tasks.
+     * @param threads The maximum number of threads.
+     * @param fn The function to run for each task.
+     */
+    template<typename Fn>
+    void runParallel(size_t tasks, size_t threads, Fn&& fn)
+    {
+        std::atomic<size_t> next{0};
+        auto work = [&]()
+        {
+            for (size_t task; (task = next.fetch_add(1, std::memory_order_relaxed)) < tasks;)
+            {
+                fn(task);
+            }
+        };
+
+        std::vector<std::jthread> workers;
+        for (size_t i = 1; i < std::min(threads, tasks); ++i)
+        {
+            workers.emplace_back(work);
+        }
+        work();
+    }
+
+    // Each scan returns false when it was stopped before reaching the end of the document.
+
+    bool scanRegex(const std::regex& pattern, const MexTextBuffer& document, std::vector<Match>& matches,
+                   size_t threads, const std::stop_token& stop)
+    {
+        std::vector<Chunk> chunks = collectChunks(document);
+        std::vector<size_t> bounds = splitChunks(chunks, threads);
+        std::vector<GroupResult> results(bounds.size() - 1);
+        size_t lineCount = document.lineCount();
+
+        runParallel(results.size(), threads, [&](size_t group)
+        {
+            size_t first = chunks[bounds[group]].firstLine;
+            size_t last = bounds[group + 1] < chunks.size() ? chunks[bounds[group + 1]].firstLine : lineCount;
+            document.forEachLine(first, last, [&](size_t lineNum, std::string_view line)
+            {
+                std::cregex_iterator it(line.data(), line.data() + line.size(), pattern);
+                std::cregex_iterator end;
+
+                for (; it != end; ++it)
+                {
+                    results[group].matches.emplace_back(lineNum, std::make_pair(it->position(), it->position() + it->length()));
+                }
+                return !stop.stop_requested();
+            });
+        });
+
+        for (GroupResult& result : results)
+        {
+            matches.insert(matches.end(), result.matches.begin(), result.matches.end());
+        }
+        return !stop.stop_requested();
+    }
+
+    // Matches are chosen from the occurrences the way the regex iterator picks them: the leftmost occurrence
+    // that passes the word check, then the next one starting at or after its end. Occurrences are only
+    // collected when occurrences is not null.
+    void scanChunk(const MexLiteralMatcher& matcher, const Chunk& chunk, std::vector<Match>& matches,
+                   std::vector<Position>* occurrences)
+    {
+        std::string_view text = chunk.text;
+        size_t lineNum = chunk.firstLine;
+        size_t lineStart = 0;
+        size_t scanned = 0;
+        size_t nextFree = 0;
+
+        auto report = [&](size_t offset)
+        {
+            size_t newlines = MexLineScan::countNewlines(text.data() + scanned, offset - scanned);
+            if (newlines > 0)
+            {
+                lineNum += newlines;
+                lineStart = text.rfind('\n', offset - 1) + 1;
+            }
+            scanned = offset;
+
+            size_t column = offset - lineStart;
+            if (occurrences)
+            {
+                occurrences->emplace_back(lineNum, column);
+            }
+            if (offset >= nextFree and matcher.matchesAt(text, offset))
+            {
+                matches.emplace_back(lineNum, std::make_pair(column, column + matcher.size()));
+                nextFree = offset + matcher.size();
+            }
+        };
+
+        if (occurrences)
+        {
+            matcher.forEachOccurrence(text, report);
+        }
+        else
+        {
+            matcher.forEach(text, report);
+        }
+    }
+
+    // When occurrences is not null every occurrence is collected into it, unless there are more than limit
+    // of them; it is then reset.
+    bool scanLiteral(const MexLiteralMatcher& matcher, const MexTextBuffer& document, std::vector<Match>& matches,
+                     std::shared_ptr<std::vector<Position>>& occurrences, size_t limit, size_t threads,
+                     const std::stop_token& stop)
+    {
+        std::vector<Chunk> chunks = collectChunks(document);
+        std::vector<size_t> bounds = splitChunks(chunks, threads);
+        std::vector<GroupResult> results(bounds.size() - 1);
+        std::atomic<size_t> collected{0};
+
+        runParallel(results.size(), threads, [&](size_t group)
+        {
+            GroupResult& result = results[group];
+            for (size_t i = bounds[group]; i < bounds[group + 1] and !stop.stop_requested(); ++i)
+            {
+                bool collect = occurrences and collected.load(std::memory_order_relaxed) <= limit;
+                size_t before = result.occurrences.size();
+                scanChunk(matcher, chunks[i], result.matches, collect ? &result.occurrences : nullptr);
+                collected.fetch_add(result.occurrences.size() - before, std::memory_order_relaxed);
+            }
+        });
+
+        bool keepOccurrences = occurrences and collected.load() <= limit;
+        for (GroupResult& result : results)
+        {
+            matches.insert(matches.end(), result.matches.begin(), result.matches.end());
+            if (keepOccurrences)
+            {
+                occurrences->insert(occurrences->end(), result.occurrences.begin(), result.occurrences.end());
+            }
+        }
+        if (!keepOccurrences)
+        {
+            occurrences.reset();
+        }
+        return !stop.stop_requested();
+    }
+
+    // Every occurrence of a pattern starts with an occurrence of any prefix of it, so extending the pattern
+    // only needs the previous occurrences checked again.
+    bool refineLiteral(const MexLiteralMatcher& matcher, const MexTextBuffer& document,
+                       const std::vector<Position>& previous, std::vector<Match>& matches,
+                       std::vector<Position>& occurrences, const std::stop_token& stop)
+    {
+        std::string_view line;
+        size_t currentLine = std::string_view::npos;
+        size_t nextFree = 0;
+
+        for (size_t i = 0; i < previous.size(); ++i)
+        {
+            if (i % 4096 == 0 and stop.stop_requested())
+            {
+                return false;
+            }
+
+            auto [lineNum, column] = previous[i];
+            if (lineNum != currentLine)
+            {
+                line = document.line(lineNum);
+                currentLine = lineNum;
+                nextFree = 0;
+            }
+
+            if (!matcher.occursAt(line, column))
+            {
+                continue;
+            }
+            occurrences.emplace_back(lineNum, column);
+            if (column >= nextFree and matcher.matchesAt(line, column))
+            {
+                matches.emplace_back(lineNum, std::make_pair(column, column + matcher.size()));
+                nextFree = column + matcher.size();
+            }
+        }
+        return true;
+    }
+
+    /// @brief A run of whole lines rebuilt by replaceAll, put back with one edit. \struct Rewrite
+    struct Rewrite
+    {
+        size_t firstLine;
+        size_t lastLine;
+        std::string text;
+    };
+
+    /// @brief The rewrites of a group of chunks and the number of replacements in them. \struct GroupRewrite
+    struct GroupRewrite
+    {
+        std::vector<Rewrite> rewrites;
+        size_t replaced = 0;
+    };
+
+    // Rewritten lines are put back with one edit when fewer bytes than this lie between them.
+    constexpr size_t rewriteGapBytes = 4096;
+
+    /**
+     * @brief Rebuilds the lines of a chunk that hold matches in one pass, copying the text between matches and
+     *        the replacement for each match.
+     * @param chunk The chunk, which holds whole lines.
+     * @param replacement The text that replaces every match.
+     * @param forEachMatch Calls its argument with the start and end offset of every match in the chunk, in order.
+     * @param out The group to append the rewrites to.
+     */
+    template<typename ForEachMatch>
+    void rewriteChunk(const Chunk& chunk, std::string_view replacement, ForEachMatch&& forEachMatch, GroupRewrite& out)
+    {
+        std::string_view text = chunk.text;
+        size_t lineNum = chunk.firstLine;
+        size_t scanned = 0;
+        auto lineOf = [&](size_t offset)
+        {
+            lineNum += MexLineScan::countNewlines(text.data() + scanned, offset - scanned);
+            scanned = offset;
+            return lineNum;
+        };
+
+        bool open = false;
+        size_t copied = 0;
+        size_t lineEnd = 0;
+        auto close = [&]()
+        {
+            Rewrite& rewrite = out.rewrites.back();
+            rewrite.text.append(text.substr(copied, lineEnd - copied));
+            rewrite.lastLine = lineOf(lineEnd);
+        };
+
+        forEachMatch([&](size_t begin, size_t end)
+        {
+            if (!open or begin > lineEnd)
+            {
+                size_t lineStart = begin == 0 ? 0 : text.rfind('\n', begin - 1) + 1;
+                if (open and lineStart - lineEnd > rewriteGapBytes)
+                {
+                    close();
+                    open = false;
+                }
+                if (!open)
+                {
+                    out.rewrites.push_back({lineOf(lineStart), 0, {}});
+                    copied = lineStart;
+                    open = true;
+                }
+                lineEnd = std::min(text.find('\n', begin), text.size());
+            }
+
+            std::string& rebuilt = out.rewrites.back().text;
+            rebuilt.append(text.substr(copied, begin - copied));
+            rebuilt.append(replacement);
+            copied = end;
+            out.replaced++;
+        });
+
+        if (open)
+        {
+            close();
+        }
+    }
+
+    // Lazy searches walk the document in blocks of this many lines.
+    constexpr size_t searchBlockLines = 4096;
+
+    std::regex::flag_type regexFlags(bool caseSensitive)
+    {
+        std::regex::flag_type flags = std::regex_constants::ECMAScript;
+        if (!caseSensitive)
+        {
+            flags |= std::regex_constants::icase;
+        }
+        return flags;
+    }
+}
+
 MexSearch::MexSearch()
     : currentMatch(0)
     , caseSensitive(false)
@@ -12,61 +358,241 @@ MexSearch::MexSearch()
 
 }
 
-void MexSearch::findMatches(const std::string &pattern, const std::vector<std::string> &document)
+void MexSearch::findMatches(const std::string &pattern, const MexTextBuffer &document)
 {
+    cancelSearch();
     matches.clear();
-    if (pattern.empty()) return;
+    linePattern.reset();
+    dirtyLines.clear();
+    // Matches never span lines, as with the line-by-line regex search.
+    if (pattern.empty() or (!regexMode and pattern.find('\n') != std::string::npos)) return;
 
-    std::string searchPattern = regexMode ? pattern : getRegexPattern(pattern);
-    std::regex::flag_type flags = std::regex_constants::ECMAScript;
-    if (!caseSensitive)
+    try
     {
-        flags |= std::regex_constants::icase;
+        linePattern = compile(pattern);
+    }
+    catch (const std::regex_error& e)
+    {
+        std::cerr << "Regex error: " << e.what() << std::endl;
+        return;
     }
 
+    if (linePattern->literal)
+    {
+        std::shared_ptr<std::vector<Position>> occurrences;
+        scanLiteral(*linePattern->literal, document, matches, occurrences, 0, resolveThreads(threadCount), {});
+    }
+    else
+    {
+        scanRegex(*linePattern->regex, document, matches, resolveThreads(threadCount), {});
+    }
+}
+
+void MexSearch::findIncremental(const std::string &pattern, const MexTextBuffer &document, size_t line, size_t column)
+{
+    clearMatches();
+    lastPattern = pattern;
+    incrementalOrigin = {line, column};
+    if (pattern.empty() or (!regexMode and pattern.find('\n') != std::string::npos)) return;
+
     try
     {
-        std::regex regexPatterns(searchPattern, flags);
+        linePattern = compile(pattern);
+    }
+    catch (const std::regex_error&)
+    {
+        // The pattern is still being typed; it matches nothing until it is valid.
+        return;
+    }
 
-        for (size_t lineNum = 0; lineNum < document.size(); ++lineNum)
+    if (lazyMode)
+    {
+        startCounting(document);
+        searching = true;
+        worker = std::jthread([this, snapshot = document.snapshot(), pattern = linePattern,
+                               from = incrementalOrigin](std::stop_token stop)
         {
-            const std::string& line = document[lineNum];
-            std::sregex_iterator it(line.begin(), line.end(), regexPatterns);
-            std::sregex_iterator end;
+            Result result;
+            result.current = searchForward(*pattern, snapshot, from, stop);
+            if (!stop.stop_requested())
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                finishedResult = std::move(result);
+            }
+        });
+        return;
+    }
 
-            for (; it != end; ++it)
+    std::shared_ptr<const std::vector<Position>> previous;
+    if (!regexMode and occurrences.positions and occurrences.version == document.version() and
+        occurrences.caseSensitive == caseSensitive and pattern.starts_with(occurrences.pattern))
+    {
+        previous = occurrences.positions;
+    }
+
+    searching = true;
+    worker = std::jthread([this, snapshot = document.snapshot(), pattern, compiled = linePattern, previous,
+                           caseSensitive = caseSensitive, threads = resolveThreads(threadCount)](std::stop_token stop)
+    {
+        Result result;
+        bool finished;
+        if (compiled->regex)
+        {
+            finished = scanRegex(*compiled->regex, snapshot, result.matches, threads, stop);
+        }
+        else
+        {
+            const MexLiteralMatcher& matcher = *compiled->literal;
+            auto positions = std::make_shared<std::vector<Position>>();
+            if (previous)
+            {
+                finished = refineLiteral(matcher, snapshot, *previous, result.matches, *positions, stop);
+            }
+            else
             {
-                matches.emplace_back(lineNum, std::make_pair(it->position(), it->position() + it->length()));
+                finished = scanLiteral(matcher, snapshot, result.matches, positions, maxOccurrences, threads, stop);
             }
+            result.occurrences = {pattern, snapshot.version(), caseSensitive, std::move(positions)};
+        }
+
+        if (finished)
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            finishedResult = std::move(result);
         }
+    });
+}
+
+bool MexSearch::collectResults()
+{
+    if (!searching)
+    {
+        return false;
     }
-    catch (const std::regex_error& e)
+
     {
-        std::cerr << "Regex error: " << e.what() << std::endl;
+        std::lock_guard<std::mutex> lock(resultMutex);
+        if (!finishedResult)
+        {
+            return false;
+        }
+        if (lazyMode)
+        {
+            current = finishedResult->current;
+        }
+        else
+        {
+            matches = std::move(finishedResult->matches);
+            occurrences = std::move(finishedResult->occurrences);
+        }
+        finishedResult.reset();
+    }
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    searching = false;
+    if (!lazyMode)
+    {
+        selectMatchFrom(incrementalOrigin.first, incrementalOrigin.second);
+    }
+    return true;
+}
+
+void MexSearch::finishSearch()
+{
+    if (searching)
+    {
+        worker.join();
+        collectResults();
+    }
+}
+
+void MexSearch::cancelSearch()
+{
+    if (worker.joinable())
+    {
+        worker.request_stop();
+        worker.join();
     }
+    searching = false;
+    finishedResult.reset();
 }
 
-std::string MexSearch::getRegexPattern(const std::string &pattern) const
+void MexSearch::selectMatchFrom(size_t line, size_t column)
 {
-    if (wholeWord)
+    if (matches.empty())
     {
-        return "\\b" + std::regex_replace(pattern, std::regex("([.^$|()\\[\\]{}*+?\\\\])"), "\\$1") + "\\b";
+        currentMatch = 0;
+        return;
     }
 
-    return std::regex_replace(pattern, std::regex("([.^$|()\\[\\]{}*+?\\\\])"), "\\$1");
+    auto it = std::lower_bound(matches.begin(), matches.end(), Position(line, column), [](const Match& match, const Position& position)
+    {
+        return Position(match.first, match.second.first) < position;
+    });
+    currentMatch = it == matches.end() ? 1 : static_cast<size_t>(it - matches.begin()) + 1;
 }
 
-bool MexSearch::find(const std::string &pattern, const std::vector<std::string> &document)
+bool MexSearch::find(const std::string &pattern, const MexTextBuffer &document)
 {
+    if (lazyMode)
+    {
+        return find(pattern, document, 0, 0);
+    }
+
     lastPattern = pattern;
     findMatches(pattern, document);
     currentMatch = matches.empty() ? 0 : 1;
     return !matches.empty();
 }
 
-bool MexSearch::findNext(const std::vector<std::string> &document)
+bool MexSearch::find(const std::string &pattern, const MexTextBuffer &document, size_t line, size_t column)
 {
-    if (matches.empty())
+    if (!lazyMode)
+    {
+        find(pattern, document);
+        selectMatchFrom(line, column);
+        return !matches.empty();
+    }
+
+    clearMatches();
+    lastPattern = pattern;
+    if (pattern.empty()) return false;
+
+    try
+    {
+        linePattern = compile(pattern);
+    }
+    catch (const std::regex_error& e)
+    {
+        std::cerr << "Regex error: " << e.what() << std::endl;
+        return false;
+    }
+
+    current = searchForward(*linePattern, document, {line, column}, {});
+    startCounting(document);
+    return current.has_value();
+}
+
+bool MexSearch::findNext(const MexTextBuffer &document)
+{
+    if (lazyMode)
+    {
+        if (!current)
+        {
+            return !lastPattern.empty() and find(lastPattern, document, 0, 0);
+        }
+
+        // A match that ends where it starts must not be found again.
+        Position from(current->first, std::max(current->second.second, current->second.first + 1));
+        current = searchForward(*linePattern, document, from, {});
+        return current.has_value();
+    }
+
+    matchDirtyLines(document);
+    if (matches.empty() and !linePattern)
     {
         if (lastPattern.empty()) return false;
         findMatches(lastPattern, document);
@@ -83,9 +609,21 @@ bool MexSearch::findNext(const std::vector<std::string> &document)
     return true;
 }
 
-bool MexSearch::findPrevious(const std::vector<std::string> &document)
+bool MexSearch::findPrevious(const MexTextBuffer &document)
 {
-    if (matches.empty())
+    if (lazyMode)
+    {
+        if (!current)
+        {
+            if (lastPattern.empty() or !find(lastPattern, document, 0, 0)) return false;
+        }
+
+        current = searchBackward(*linePattern, document, {current->first, current->second.first});
+        return current.has_value();
+    }
+
+    matchDirtyLines(document);
+    if (matches.empty() and !linePattern)
     {
         if (lastPattern.empty()) return false;
         findMatches(lastPattern, document);
@@ -105,36 +643,104 @@ bool MexSearch::findPrevious(const std::vector<std::string> &document)
     return true;
 }
 
-void MexSearch::replaceCurrent(const std::string &replacement, std::vector<std::string> &document)
+void MexSearch::replaceCurrent(const std::string &replacement, MexTextBuffer &document)
 {
-    if (matches.empty() or currentMatch == 0 or currentMatch > matches.size()) return;
+    if (lazyMode)
+    {
+        if (!current) return;
 
-    const auto& match = matches[currentMatch - 1];
-    std::string& line = document[match.first];
+        std::string line(document.line(current->first));
+        line.replace(current->second.first, current->second.second - current->second.first, replacement);
+        document.replaceLine(current->first, line);
+        current->second.second = current->second.first + replacement.length();
+        return;
+    }
+
+    matchDirtyLines(document);
+    if (!hasCurrentMatch()) return;
+
+    // The edit is reported back through onReplace, which changes matches.
+    Match match = matches[currentMatch - 1];
+    std::string line(document.line(match.first));
     line.replace(match.second.first, match.second.second - match.second.first, replacement);
+    document.replaceLine(match.first, line);
+    matchDirtyLines(document);
 
-    size_t lengthDiff = replacement.length() - (match.second.second - match.second.first);
-    for (auto& m : matches)
+    // Leave the match before the end of the replacement current, so findNext continues after it.
+    auto next = std::lower_bound(matches.begin(), matches.end(), Position(match.first, match.second.first + replacement.length()),
+                                 [](const Match& m, const Position& position)
     {
-        if (m.first == match.first and m.second.first > match.second.first)
-        {
-            m.second.first += lengthDiff;
-            m.second.second += lengthDiff;
-        }
-    }
+        return Position(m.first, m.second.first) < position;
+    });
+    currentMatch = static_cast<size_t>(next - matches.begin());
 }
 
-void MexSearch::replaceAll(const std::string &pattern, const std::string &replacement, std::vector<std::string> &document)
+size_t MexSearch::replaceAll(const std::string &pattern, const std::string &replacement, MexTextBuffer &document)
 {
+    clearMatches();
     lastPattern = pattern;
-    findMatches(pattern, document);
+    if (pattern.empty() or (!regexMode and pattern.find('\n') != std::string::npos)) return 0;
 
-    for (auto it = matches.rbegin(); it != matches.rend(); ++it)
+    std::shared_ptr<const LinePattern> compiled;
+    try
     {
-        std::string& line = document[it->first];
-        line.replace(it->second.first, it->second.second - it->second.first, replacement);
+        compiled = compile(pattern);
     }
-    matches.clear();
+    catch (const std::regex_error& e)
+    {
+        std::cerr << "Regex error: " << e.what() << std::endl;
+        return 0;
+    }
+
+    size_t threads = resolveThreads(threadCount);
+    std::vector<Chunk> chunks = collectChunks(document);
+    std::vector<size_t> bounds = splitChunks(chunks, threads);
+    std::vector<GroupRewrite> results(bounds.size() - 1);
+
+    runParallel(results.size(), threads, [&](size_t group)
+    {
+        std::vector<Match> lineMatches;
+        for (size_t i = bounds[group]; i < bounds[group + 1]; ++i)
+        {
+            std::string_view text = chunks[i].text;
+            rewriteChunk(chunks[i], replacement, [&](auto&& report)
+            {
+                if (compiled->literal)
+                {
+                    // Chunks hold whole lines, so matching over them finds the same matches as line by line.
+                    compiled->literal->forEach(text, [&](size_t offset)
+                    {
+                        report(offset, offset + compiled->literal->size());
+                    });
+                    return;
+                }
+
+                for (size_t lineStart = 0; lineStart < text.size();)
+                {
+                    size_t lineEnd = std::min(text.find('\n', lineStart), text.size());
+                    lineMatches.clear();
+                    compiled->matchLine(0, text.substr(lineStart, lineEnd - lineStart), lineMatches);
+                    for (const Match& match : lineMatches)
+                    {
+                        report(lineStart + match.second.first, lineStart + match.second.second);
+                    }
+                    lineStart = lineEnd + 1;
+                }
+            }, results[group]);
+        }
+    });
+
+    // Rewrites are put back from the end, so the line numbers of the ones before stay valid.
+    size_t replaced = 0;
+    for (auto group = results.rbegin(); group != results.rend(); ++group)
+    {
+        for (auto rewrite = group->rewrites.rbegin(); rewrite != group->rewrites.rend(); ++rewrite)
+        {
+            document.replace(rewrite->firstLine, 0, rewrite->lastLine, std::string_view::npos, rewrite->text);
+        }
+        replaced += group->replaced;
+    }
+    return replaced;
 }
 
 const std::vector<std::pair<size_t, std::pair<size_t, size_t>>>& MexSearch::getMatches() const
@@ -142,8 +748,21 @@ const std::vector<std::pair<size_t, std::pair<size_t, size_t>>>& MexSearch::getM
     return matches;
 }
 
+std::span<const std::pair<size_t, std::pair<size_t, size_t>>> MexSearch::matchesInLines(size_t first, size_t last) const
+{
+    auto byLine = [](const Match& match, size_t line) { return match.first < line; };
+    auto begin = std::lower_bound(matches.begin(), matches.end(), first, byLine);
+    auto end = std::lower_bound(begin, matches.end(), last, byLine);
+    return {begin, end};
+}
+
 std::pair<size_t, std::pair<size_t, size_t>> MexSearch::getCurrentMatch() const
 {
+    if (lazyMode)
+    {
+        return current.value_or(Match{0, {0, 0}});
+    }
+
     if (currentMatch == 0 || currentMatch > matches.size())
     {
         return {0, {0, 0}};
@@ -153,8 +772,190 @@ std::pair<size_t, std::pair<size_t, size_t>> MexSearch::getCurrentMatch() const
 
 void MexSearch::clearMatches()
 {
+    cancelSearch();
+    stopCounting();
     matches.clear();
     currentMatch = 0;
+    current.reset();
+    linePattern.reset();
+    dirtyLines.clear();
+    windowValid = false;
+    counted = 0;
+}
+
+bool MexSearch::hasCurrentMatch() const
+{
+    return lazyMode ? current.has_value() : currentMatch != 0 and currentMatch <= matches.size();
+}
+
+bool MexSearch::isCounting() const
+{
+    return lazyMode and !countFinished.load(std::memory_order_acquire);
+}
+
+std::string MexSearch::matchCountText() const
+{
+    if (!lazyMode)
+    {
+        return std::to_string(matches.size());
+    }
+
+    size_t count = counted.load(std::memory_order_relaxed);
+    if (count > countCap)
+    {
+        return std::to_string(countCap) + "+";
+    }
+    return std::to_string(count) + (isCounting() ? "..." : "");
+}
+
+void MexSearch::refreshMatches(const MexTextBuffer &document, size_t first, size_t last)
+{
+    if (!lazyMode)
+    {
+        matchDirtyLines(document);
+        return;
+    }
+    if (!linePattern)
+    {
+        return;
+    }
+    if (windowValid and first == windowFirst and last == windowLast and windowVersion == document.version())
+    {
+        return;
+    }
+
+    matches.clear();
+    document.forEachLine(first, last, [&](size_t lineNum, std::string_view line)
+    {
+        linePattern->matchLine(lineNum, line, matches);
+    });
+    windowFirst = first;
+    windowLast = last;
+    windowVersion = document.version();
+    windowValid = true;
+}
+
+void MexSearch::onReplace(size_t line, size_t, std::string_view removed, std::string_view inserted)
+{
+    if (!linePattern)
+    {
+        return;
+    }
+
+    size_t removedLines = std::count(removed.begin(), removed.end(), '\n');
+    size_t insertedLines = std::count(inserted.begin(), inserted.end(), '\n');
+
+    if (lazyMode)
+    {
+        // Only the current match is kept; the lines in view are matched again once the version changes.
+        if (current and current->first > line)
+        {
+            current->first = current->first > line + removedLines ? current->first - removedLines + insertedLines
+                                                                   : std::min(current->first, line + insertedLines);
+        }
+        return;
+    }
+
+    auto byLine = [](const Match& match, size_t lineNum) { return match.first < lineNum; };
+    auto begin = std::lower_bound(matches.begin(), matches.end(), line, byLine);
+    auto end = std::lower_bound(begin, matches.end(), line + removedLines + 1, byLine);
+    size_t erased = static_cast<size_t>(begin - matches.begin());
+    spliceMatches(erased, static_cast<size_t>(end - matches.begin()), {});
+    if (removedLines != insertedLines)
+    {
+        for (auto it = matches.begin() + erased; it != matches.end(); ++it)
+        {
+            it->first = it->first - removedLines + insertedLines;
+        }
+    }
+
+    auto shift = [&](size_t index)
+    {
+        if (index <= line)
+        {
+            return index;
+        }
+        return index <= line + removedLines ? line + 1 : index - removedLines + insertedLines;
+    };
+
+    std::map<size_t, size_t> previous;
+    previous.swap(dirtyLines);
+    for (const auto& [first, last] : previous)
+    {
+        markDirty(shift(first), shift(last));
+    }
+    markDirty(line, line + insertedLines + 1);
+}
+
+void MexSearch::markDirty(size_t begin, size_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    auto it = dirtyLines.upper_bound(begin);
+    if (it != dirtyLines.begin() and std::prev(it)->second >= begin)
+    {
+        --it;
+        begin = it->first;
+        end = std::max(end, it->second);
+        it = dirtyLines.erase(it);
+    }
+    while (it != dirtyLines.end() and it->first <= end)
+    {
+        end = std::max(end, it->second);
+        it = dirtyLines.erase(it);
+    }
+
+    dirtyLines.emplace(begin, end);
+}
+
+void MexSearch::matchDirtyLines(const MexTextBuffer &document)
+{
+    if (dirtyLines.empty() or !linePattern)
+    {
+        return;
+    }
+
+    auto byLine = [](const Match& match, size_t lineNum) { return match.first < lineNum; };
+    size_t lineCount = document.lineCount();
+    std::vector<Match> lineMatches;
+    for (const auto& [first, last] : dirtyLines)
+    {
+        size_t end = std::min(last, lineCount);
+        if (first >= end)
+        {
+            continue;
+        }
+
+        lineMatches.clear();
+        document.forEachLine(first, end, [&](size_t lineNum, std::string_view line)
+        {
+            linePattern->matchLine(lineNum, line, lineMatches);
+        });
+
+        auto begin = std::lower_bound(matches.begin(), matches.end(), first, byLine);
+        auto stop = std::lower_bound(begin, matches.end(), end, byLine);
+        spliceMatches(static_cast<size_t>(begin - matches.begin()), static_cast<size_t>(stop - matches.begin()), lineMatches);
+    }
+    dirtyLines.clear();
+}
+
+void MexSearch::spliceMatches(size_t begin, size_t end, const std::vector<Match>& replacement)
+{
+    // currentMatch counts from 1.
+    if (currentMatch > end)
+    {
+        currentMatch = currentMatch - (end - begin) + replacement.size();
+    }
+    else if (currentMatch > begin)
+    {
+        currentMatch = begin;
+    }
+
+    matches.erase(matches.begin() + begin, matches.begin() + end);
+    matches.insert(matches.begin() + begin, replacement.begin(), replacement.end());
 }
 
 void MexSearch::setCaseSensitive(bool sensitive)
@@ -170,4 +971,184 @@ void MexSearch::setWholeWord(bool wholeWord)
 void MexSearch::setRegexMode(bool regex)
 {
     regexMode = regex;
+}
+
+void MexSearch::setThreadCount(size_t threads)
+{
+    threadCount = threads;
+}
+
+void MexSearch::setLazyMode(bool lazy)
+{
+    if (lazy != lazyMode)
+    {
+        clearMatches();
+        lazyMode = lazy;
+    }
+}
+
+void MexSearch::setCountCap(size_t cap)
+{
+    countCap = cap;
+}
+
+void MexSearch::LinePattern::matchLine(size_t lineNum, std::string_view line, std::vector<Match>& out) const
+{
+    if (literal)
+    {
+        literal->forEach(line, [&](size_t offset)
+        {
+            out.emplace_back(lineNum, std::make_pair(offset, offset + literal->size()));
+        });
+        return;
+    }
+
+    std::cregex_iterator it(line.data(), line.data() + line.size(), *regex);
+    std::cregex_iterator end;
+    for (; it != end; ++it)
+    {
+        out.emplace_back(lineNum, std::make_pair(it->position(), it->position() + it->length()));
+    }
+}
+
+std::shared_ptr<const MexSearch::LinePattern> MexSearch::compile(const std::string &pattern) const
+{
+    auto compiled = std::make_shared<LinePattern>();
+    if (regexMode)
+    {
+        compiled->regex.emplace(pattern, regexFlags(caseSensitive));
+    }
+    else
+    {
+        compiled->literal.emplace(pattern, caseSensitive, wholeWord);
+    }
+    return compiled;
+}
+
+void MexSearch::startCounting(const MexTextBuffer &document)
+{
+    stopCounting();
+    counted = 0;
+    countFinished = false;
+
+    counter = std::jthread([this, snapshot = document.snapshot(), pattern = linePattern,
+                            limit = countCap + 1](std::stop_token stop)
+    {
+        size_t count = 0;
+        if (pattern->literal)
+        {
+            // Chunks hold whole lines, so counting over them finds the same matches as line by line.
+            snapshot.forEachChunk([&](size_t, std::string_view text)
+            {
+                pattern->literal->forEach(text, [&](size_t) { count++; });
+                counted.store(std::min(count, limit), std::memory_order_relaxed);
+                return count < limit and !stop.stop_requested();
+            });
+        }
+        else
+        {
+            std::vector<Match> lineMatches;
+            snapshot.forEachLine(0, snapshot.lineCount(), [&](size_t lineNum, std::string_view line)
+            {
+                lineMatches.clear();
+                pattern->matchLine(lineNum, line, lineMatches);
+                count += lineMatches.size();
+                counted.store(std::min(count, limit), std::memory_order_relaxed);
+                return count < limit and !stop.stop_requested();
+            });
+        }
+        countFinished.store(true, std::memory_order_release);
+    });
+}
+
+void MexSearch::stopCounting()
+{
+    if (counter.joinable())
+    {
+        counter.request_stop();
+        counter.join();
+    }
+    countFinished = true;
+}
+
+std::optional<MexSearch::Match> MexSearch::searchForward(const LinePattern &pattern, const MexTextBuffer &document,
+                                                        Position from, const std::stop_token &stop)
+{
+    std::vector<Match> lineMatches;
+    std::optional<Match> found;
+    auto visit = [&](size_t lineNum, std::string_view line)
+    {
+        lineMatches.clear();
+        pattern.matchLine(lineNum, line, lineMatches);
+        for (const Match& match : lineMatches)
+        {
+            if (Position(match.first, match.second.first) >= from)
+            {
+                found = match;
+                return false;
+            }
+        }
+        return !stop.stop_requested();
+    };
+
+    // Lines are only indexed as far as the walk gets, so a match near the start is found while a large
+    // file is still loading.
+    for (size_t first = from.first; !found and !stop.stop_requested() and document.hasLine(first); first += searchBlockLines)
+    {
+        document.forEachLine(first, first + searchBlockLines, visit);
+    }
+
+    // Wrap around to the lines before the position; matches on its own line were all after the column.
+    size_t wrapEnd = from.first + 1;
+    from = {0, 0};
+    for (size_t first = 0; !found and !stop.stop_requested() and first < wrapEnd; first += searchBlockLines)
+    {
+        document.forEachLine(first, std::min(first + searchBlockLines, wrapEnd), visit);
+    }
+    return stop.stop_requested() ? std::nullopt : found;
+}
+
+std::optional<MexSearch::Match> MexSearch::searchBackward(const LinePattern &pattern, const MexTextBuffer &document,
+                                                         Position before)
+{
+    std::vector<Match> blockMatches;
+    auto lastBefore = [&](size_t first, size_t last, Position limit) -> std::optional<Match>
+    {
+        blockMatches.clear();
+        document.forEachLine(first, last, [&](size_t lineNum, std::string_view line)
+        {
+            pattern.matchLine(lineNum, line, blockMatches);
+        });
+        for (auto it = blockMatches.rbegin(); it != blockMatches.rend(); ++it)
+        {
+            if (Position(it->first, it->second.first) < limit)
+            {
+                return *it;
+            }
+        }
+        return std::nullopt;
+    };
+
+    for (size_t last = before.first + 1; last > 0;)
+    {
+        size_t first = last > searchBlockLines ? last - searchBlockLines : 0;
+        if (auto match = lastBefore(first, last, before))
+        {
+            return match;
+        }
+        last = first;
+    }
+
+    // Wrap around to the end of the document, back down to the line of the position.
+    Position end(std::string_view::npos, std::string_view::npos);
+    for (size_t last = document.lineCount(); last > before.first;)
+    {
+        size_t first = std::max(before.first, last > searchBlockLines ? last - searchBlockLines : 0);
+        if (auto match = lastBefore(first, last, end))
+        {
+            return match;
+        }
+        last = first;
+    }
+    return std::nullopt;
 }
\ No newline at end of file
@@ -1,6 +1,5 @@
 #include "mexSyntax.h"
 #include <algorithm>
-#include <iostream>
 
 MexSyntax::MexSyntax()
 {
@@ -17,8 +16,9 @@ void MexSyntax::detectLanguage(const std::string& filename)
     if (filename.empty())
     {
         currentLanguage.clear();
-        currentRules.clear();
-        currentKeywords.clear();
+        currentLexer = nullptr;
+        tokenCache.clear();
+        resetLineStates();
         return;
     }
 
@@ -26,6 +26,9 @@ void MexSyntax::detectLanguage(const std::string& filename)
     if (dotPos == std::string::npos)
     {
         currentLanguage.clear();
+        currentLexer = nullptr;
+        tokenCache.clear();
+        resetLineStates();
         return;
     }
 
@@ -36,45 +39,183 @@ void MexSyntax::detectLanguage(const std::string& filename)
     if (it != fileExtensions.end())
     {
         currentLanguage = it->second;
-        currentRules = languageRules[currentLanguage];
+        currentLexer = &lexers[currentLanguage];
     }
     else
     {
         currentLanguage.clear();
-        currentRules.clear();
+        currentLexer = nullptr;
     }
+    tokenCache.clear();
+    resetLineStates();
 }
 
-void MexSyntax::highlightLine(const std::string& line, int yPos, int startCol)
+void MexSyntax::highlightLine(std::string_view line, size_t lineIndex, int yPos, int startCol)
 {
-    if (currentLanguage.empty() || currentRules.empty())
+    mvprintw(yPos, startCol, "%.*s", static_cast<int>(line.size()), line.data());
+
+    if (currentLexer == nullptr)
     {
-        mvprintw(yPos, startCol, "%s", line.c_str());
         return;
     }
 
-    mvprintw(yPos, startCol, "%s", line.c_str());
+    for (const auto& token : tokenize(line, lineState(lineIndex)))
+    {
+        if (static_cast<size_t>(token.start) >= line.size())
+        {
+            break;
+        }
+        int length = std::min(token.length, static_cast<int>(line.size()) - token.start);
+
+        attron(COLOR_PAIR(token.colorPair));
+        mvprintw(yPos, startCol + token.start, "%.*s", length, line.data() + token.start);
+        attroff(COLOR_PAIR(token.colorPair));
+    }
+}
+
+const std::vector<MexSyntax::Token>& MexSyntax::tokenize(std::string_view line, MexLexer::State state)
+{
+    size_t key = std::hash<std::string_view>{}(line) ^ (state * 0x9e3779b97f4a7c15ULL);
+    auto cached = tokenCache.find(key);
+    if (cached != tokenCache.end() and cached->second.state == state and cached->second.line == line)
+    {
+        cacheStats.hits++;
+        return cached->second.tokens;
+    }
+
+    cacheStats.misses++;
+    if (cached == tokenCache.end() and tokenCache.size() >= tokenCacheCapacity)
+    {
+        tokenCache.clear();
+    }
+
+    // A colliding line takes over the entry of the line it collided with.
+    CachedLine& entry = tokenCache[key];
+    entry.line.assign(line);
+    entry.state = state;
+    currentLexer->tokenize(line, state, entry.tokens);
+    return entry.tokens;
+}
+
+MexSyntax::CacheStats MexSyntax::getCacheStats() const
+{
+    return cacheStats;
+}
+
+void MexSyntax::updateLineStates(const MexTextBuffer& document, size_t lineEnd)
+{
+    if (currentLexer == nullptr)
+    {
+        return;
+    }
+
+    while (!dirtyLines.empty() and dirtyLines.begin()->first < lineEnd)
+    {
+        auto [begin, end] = *dirtyLines.begin();
+        dirtyLines.erase(dirtyLines.begin());
+
+        // Walk forward until the dirty range is behind us and a recomputed state matches the stored one.
+        size_t next = begin;
+        bool changed = false;
+        document.forEachLine(begin, lineStates.size() - 1, [&](size_t index, std::string_view text)
+        {
+            MexLexer::State state = currentLexer->tokenize(text, lineStates[index], scratchTokens);
+            next = index + 1;
+            changed = state != lineStates[next];
+            lineStates[next] = state;
+            return (next < end or changed) and next < lineEnd;
+        });
+
+        while (!dirtyLines.empty() and dirtyLines.begin()->first < next)
+        {
+            size_t passedEnd = dirtyLines.begin()->second;
+            dirtyLines.erase(dirtyLines.begin());
+            end = std::max(end, passedEnd);
+        }
+
+        if (next < end or changed)
+        {
+            markDirty(next, std::max(end, next + 1));
+        }
+    }
+
+    if (lineStates.size() < lineEnd)
+    {
+        document.forEachLine(lineStates.size() - 1, lineEnd - 1, [&](size_t index, std::string_view text)
+        {
+            MexLexer::State state = currentLexer->tokenize(text, lineStates[index], scratchTokens);
+            lineStates.push_back(state);
+        });
+    }
+}
+
+MexLexer::State MexSyntax::lineState(size_t index) const
+{
+    return index < lineStates.size() ? lineStates[index] : 0;
+}
+
+void MexSyntax::resetLineStates()
+{
+    lineStates.assign(1, 0);
+    dirtyLines.clear();
+}
 
-    for (const auto& rule : currentRules)
+void MexSyntax::onReplace(size_t line, size_t, std::string_view removed, std::string_view inserted)
+{
+    // States past the computed prefix are produced on demand, so only stored ones need adjusting.
+    if (line + 1 >= lineStates.size())
     {
-        std::sregex_iterator it(line.begin(), line.end(), rule.pattern);
-        std::sregex_iterator end;
+        return;
+    }
 
-        for (; it != end; ++it)
+    size_t removedLines = std::count(removed.begin(), removed.end(), '\n');
+    size_t insertedLines = std::count(inserted.begin(), inserted.end(), '\n');
+
+    size_t removedEnd = std::min(line + 1 + removedLines, lineStates.size());
+    lineStates.erase(lineStates.begin() + line + 1, lineStates.begin() + removedEnd);
+    lineStates.insert(lineStates.begin() + line + 1, insertedLines, 0);
+
+    auto shift = [&](size_t index)
+    {
+        if (index <= line)
         {
-            int start = it->position() + startCol;
-            int length = it->length();
-
-            if (!rule.wholeWord ||
-                (start == startCol || isWordBoundary(line[start - 1 - startCol])) &&
-                (start + length == startCol + line.length() || isWordBoundary(line[start + length - startCol])))
-            {
-                attron(COLOR_PAIR(rule.colorPair));
-                mvprintw(yPos, start, "%.*s", length, line.substr(it->position(), length).c_str());
-                attroff(COLOR_PAIR(rule.colorPair));
-            }
+            return index;
         }
+        return index <= line + removedLines ? line + 1 : index - removedLines + insertedLines;
+    };
+
+    std::map<size_t, size_t> previous;
+    previous.swap(dirtyLines);
+    for (const auto& [begin, end] : previous)
+    {
+        markDirty(shift(begin), shift(end));
     }
+    markDirty(line, line + insertedLines + 1);
+}
+
+void MexSyntax::markDirty(size_t begin, size_t end)
+{
+    end = std::min(end, lineStates.size() - 1);
+    if (begin >= end)
+    {
+        return;
+    }
+
+    auto it = dirtyLines.upper_bound(begin);
+    if (it != dirtyLines.begin() and std::prev(it)->second >= begin)
+    {
+        --it;
+        begin = it->first;
+        end = std::max(end, it->second);
+        it = dirtyLines.erase(it);
+    }
+    while (it != dirtyLines.end() and it->first <= end)
+    {
+        end = std::max(end, it->second);
+        it = dirtyLines.erase(it);
+    }
+
+    dirtyLines.emplace(begin, end);
 }
 
 void MexSyntax::initLanguages()
@@ -92,223 +233,110 @@ void MexSyntax::initLanguages()
     addPythonRules();
     addShellRules();
     addMarkdownRules();
+
+    for (const auto& [lang, rules] : languageRules)
+    {
+        lexers.emplace(lang, MexLexer(rules, languageKeywords[lang]));
+    }
 }
 
 void MexSyntax::addCPPRules()
 {
     std::string lang = "C++";
 
-    addKeyword(lang, "int", 10);
-    addKeyword(lang, "float", 10);
-    addKeyword(lang, "double", 10);
-    addKeyword(lang, "char", 10);
-    addKeyword(lang, "void", 10);
-    addKeyword(lang, "bool", 10);
-    addKeyword(lang, "auto", 10);
-    addKeyword(lang, "const", 10);
-
-    addKeyword(lang, "if", 11);
-    addKeyword(lang, "else", 11);
-    addKeyword(lang, "for", 11);
-    addKeyword(lang, "while", 11);
-    addKeyword(lang, "do", 11);
-    addKeyword(lang, "switch", 11);
-    addKeyword(lang, "case", 11);
-    addKeyword(lang, "default", 11);
-    addKeyword(lang, "break", 11);
-    addKeyword(lang, "continue", 11);
-    addKeyword(lang, "return", 11);
-    addKeyword(lang, "goto", 11);
-
-    addKeyword(lang, "class", 12);
-    addKeyword(lang, "struct", 12);
-    addKeyword(lang, "namespace", 12);
-    addKeyword(lang, "template", 12);
-    addKeyword(lang, "typename", 12);
-    addKeyword(lang, "public", 13);
-    addKeyword(lang, "private", 13);
-    addKeyword(lang, "protected", 13);
-    addKeyword(lang, "virtual", 13);
-    addKeyword(lang, "override", 13);
-    addKeyword(lang, "final", 13);
-
-    addRule(lang, R"("(\\.|[^"\\])*")", 14);
-    addRule(lang, R"('(\\.|[^'\\])')", 14);
-
-    addRule(lang, R"(//.*$)", 15);
-    addRule(lang, R"(/\*.*?\*/)", 15);
-
-    addRule(lang, R"(\b[0-9]+\b)", 16);
-    addRule(lang, R"(\b0x[0-9a-fA-F]+\b)", 16);
-    addRule(lang, R"(\b[0-9]+\.[0-9]+([eE][+-]?[0-9]+)?\b)", 16);
+    languageKeywords[lang] = cppKeywordTable.view();
+
+    addRule(lang, MexLexer::Kind::String, "\"", 14, "\"");
+    addRule(lang, MexLexer::Kind::String, "'", 14, "'");
+
+    addRule(lang, MexLexer::Kind::LineComment, "//", 15);
+    addRule(lang, MexLexer::Kind::BlockComment, "/*", 15, "*/");
+
+    addRule(lang, MexLexer::Kind::Number, {}, 16);
 }
 
 void MexSyntax::addCRules()
 {
     std::string lang = "C";
 
-    addKeyword(lang, "int", 10);
-    addKeyword(lang, "float", 10);
-    addKeyword(lang, "double", 10);
-    addKeyword(lang, "char", 10);
-    addKeyword(lang, "void", 10);
-    addKeyword(lang, "short", 10);
-    addKeyword(lang, "long", 10);
-    addKeyword(lang, "signed", 10);
-    addKeyword(lang, "unsigned", 10);
-    addKeyword(lang, "const", 10);
-    addKeyword(lang, "volatile", 10);
-
-    addKeyword(lang, "if", 11);
-    addKeyword(lang, "else", 11);
-    addKeyword(lang, "for", 11);
-    addKeyword(lang, "while", 11);
-    addKeyword(lang, "do", 11);
-    addKeyword(lang, "switch", 11);
-    addKeyword(lang, "case", 11);
-    addKeyword(lang, "default", 11);
-    addKeyword(lang, "break", 11);
-    addKeyword(lang, "continue", 11);
-    addKeyword(lang, "return", 11);
-    addKeyword(lang, "goto", 11);
-
-    addKeyword(lang, "struct", 12);
-    addKeyword(lang, "union", 12);
-    addKeyword(lang, "enum", 12);
-    addKeyword(lang, "typedef", 12);
-
-    addRule(lang, R"(^#\s*[a-zA-Z]+\b)", 13);
-
-    addRule(lang, R"("(\\.|[^"\\])*")", 14);
-    addRule(lang, R"('(\\.|[^'\\])')", 14);
-    addRule(lang, R"(//.*$)", 15);
-    addRule(lang, R"(/\*.*?\*/)", 15);
-    addRule(lang, R"(\b[0-9]+\b)", 16);
+    languageKeywords[lang] = cKeywordTable.view();
+
+    addRule(lang, MexLexer::Kind::Directive, "#", 13);
+
+    addRule(lang, MexLexer::Kind::String, "\"", 14, "\"");
+    addRule(lang, MexLexer::Kind::String, "'", 14, "'");
+    addRule(lang, MexLexer::Kind::LineComment, "//", 15);
+    addRule(lang, MexLexer::Kind::BlockComment, "/*", 15, "*/");
+    addRule(lang, MexLexer::Kind::Number, {}, 16);
 }
 
 void MexSyntax::addPythonRules()
 {
     std::string lang = "Python";
 
-    addKeyword(lang, "def", 10);
-    addKeyword(lang, "class", 10);
-    addKeyword(lang, "lambda", 10);
-    addKeyword(lang, "if", 11);
-    addKeyword(lang, "elif", 11);
-    addKeyword(lang, "else", 11);
-    addKeyword(lang, "for", 11);
-    addKeyword(lang, "while", 11);
-    addKeyword(lang, "try", 11);
-    addKeyword(lang, "except", 11);
-    addKeyword(lang, "finally", 11);
-    addKeyword(lang, "with", 11);
-    addKeyword(lang, "return", 11);
-    addKeyword(lang, "yield", 11);
-    addKeyword(lang, "import", 11);
-    addKeyword(lang, "from", 11);
-    addKeyword(lang, "as", 11);
-    addKeyword(lang, "pass", 11);
-    addKeyword(lang, "break", 11);
-    addKeyword(lang, "continue", 11);
-    addKeyword(lang, "raise", 11);
-    addKeyword(lang, "and", 11);
-    addKeyword(lang, "or", 11);
-    addKeyword(lang, "not", 11);
-    addKeyword(lang, "is", 11);
-    addKeyword(lang, "in", 11);
-    addKeyword(lang, "None", 12);
-    addKeyword(lang, "True", 12);
-    addKeyword(lang, "False", 12);
-
-    addRule(lang, R"("(\\"|.)*?")", 14);
-    addRule(lang, R"('(\\'|.)*?')", 14);
-    addRule(lang, R"(""".*?""")", 14);
-    addRule(lang, R"('''.*?''')", 14);
-
-    addRule(lang, R"(#.*$)", 15);
-
-    addRule(lang, R"(\b[0-9]+\b)", 16);
-    addRule(lang, R"(\b0x[0-9a-fA-F]+\b)", 16);
-    addRule(lang, R"(\b[0-9]+\.[0-9]+([eE][+-]?[0-9]+)?\b)", 16);
-
-    addRule(lang, R"(@[a-zA-Z_][a-zA-Z0-9_]*)", 13);
+    languageKeywords[lang] = pythonKeywordTable.view();
+
+    addRule(lang, MexLexer::Kind::BlockString, "\"\"\"", 14, "\"\"\"");
+    addRule(lang, MexLexer::Kind::BlockString, "'''", 14, "'''");
+    addRule(lang, MexLexer::Kind::String, "\"", 14, "\"");
+    addRule(lang, MexLexer::Kind::String, "'", 14, "'");
+
+    addRule(lang, MexLexer::Kind::LineComment, "#", 15);
+
+    addRule(lang, MexLexer::Kind::Number, {}, 16);
+
+    addRule(lang, MexLexer::Kind::PrefixedWord, "@", 13);
 }
 
 void MexSyntax::addShellRules()
 {
     std::string lang = "Shell";
 
-    addKeyword(lang, "if", 10);
-    addKeyword(lang, "then", 10);
-    addKeyword(lang, "else", 10);
-    addKeyword(lang, "elif", 10);
-    addKeyword(lang, "fi", 10);
-    addKeyword(lang, "for", 11);
-    addKeyword(lang, "while", 11);
-    addKeyword(lang, "do", 11);
-    addKeyword(lang, "done", 11);
-    addKeyword(lang, "case", 11);
-    addKeyword(lang, "esac", 11);
-    addKeyword(lang, "function", 12);
-    addKeyword(lang, "return", 12);
+    languageKeywords[lang] = shellKeywordTable.view();
 
-    addRule(lang, R"("(\\"|.)*?")", 14);
-    addRule(lang, R"('(\\'|.)*?')", 14);
+    addRule(lang, MexLexer::Kind::String, "\"", 14, "\"");
+    addRule(lang, MexLexer::Kind::String, "'", 14, "'");
 
-    addRule(lang, R"(#.*$)", 15);
+    addRule(lang, MexLexer::Kind::LineComment, "#", 15);
 
-    addRule(lang, R"(\$\w+)", 16);
+    addRule(lang, MexLexer::Kind::PrefixedWord, "$", 16);
 
-    addRule(lang, R"(\b[a-zA-Z_][a-zA-Z0-9_]*\b)", 17);
+    addRule(lang, MexLexer::Kind::Identifier, {}, 17);
 }
 
 void MexSyntax::addMarkdownRules()
 {
     std::string lang = "Markdown";
 
-    addRule(lang, R"(^#{1,6}\s.*$)", 10);
-
-    addRule(lang, R"(\*\*.*?\*\*)", 11);
-    addRule(lang, R"(\*.*?\*)", 12);
+    std::string heading = "#";
+    for (int level = 1; level <= 6; ++level, heading += "#")
+    {
+        addRule(lang, MexLexer::Kind::LinePrefix, heading + " ", 10);
+    }
 
-    addRule(lang, R"(\[.*?\]\(.*?\))", 13);
+    addRule(lang, MexLexer::Kind::Delimited, "**", 11, "**");
+    addRule(lang, MexLexer::Kind::Delimited, "*", 12, "*");
 
-    addRule(lang, R"(```.*?```)", 14);
-    addRule(lang, R"(`[^`]+`)", 14);
+    addRule(lang, MexLexer::Kind::Link, "[", 13, ")");
 
-    addRule(lang, R"(^[-*+] .*$)", 15);
-    addRule(lang, R"(^\d+\. .*$)", 15);
+    addRule(lang, MexLexer::Kind::BlockString, "```", 14, "```");
+    addRule(lang, MexLexer::Kind::Delimited, "`", 14, "`");
 
-    addRule(lang, R"(^> .*$)", 16);
+    addRule(lang, MexLexer::Kind::LinePrefix, "- ", 15);
+    addRule(lang, MexLexer::Kind::LinePrefix, "* ", 15);
+    addRule(lang, MexLexer::Kind::LinePrefix, "+ ", 15);
+    addRule(lang, MexLexer::Kind::NumberedPrefix, ". ", 15);
 
-    addRule(lang, R"(---|___|\*\*\*)", 17);
-}
+    addRule(lang, MexLexer::Kind::LinePrefix, "> ", 16);
 
-void MexSyntax::addRule(const std::string& lang, const std::string& pattern, int colorPair, bool wholeWord)
-{
-    try
-    {
-        HighlightRule rule;
-        rule.pattern = std::regex(pattern);
-        rule.colorPair = colorPair;
-        rule.wholeWord = wholeWord;
-        languageRules[lang].push_back(rule);
-    }
-    catch (const std::regex_error& e)
-    {
-        std::cerr << "Regex error in language '" << lang << "': " << e.what() << std::endl;
-    }
-}
-
-void MexSyntax::addKeyword(const std::string& lang, const std::string& keyword, int colorPair)
-{
-    std::string pattern = R"(\b)" + keyword + R"(\b)";
-    addRule(lang, pattern, colorPair, true);
+    addRule(lang, MexLexer::Kind::Literal, "---", 17);
+    addRule(lang, MexLexer::Kind::Literal, "___", 17);
+    addRule(lang, MexLexer::Kind::Literal, "***", 17);
 }
 
-bool MexSyntax::isWordBoundary(char c)
+void MexSyntax::addRule(const std::string& lang, MexLexer::Kind kind, const std::string& open, int colorPair, const std::string& close)
 {
-    return !(isalnum(c) || c == '_');
+    languageRules[lang].push_back({kind, open, close, colorPair});
 }
 
 void MexSyntax::applyHighlight(int y, int x, int length, int colorPair)
@@ -320,6 +348,7 @@ void MexSyntax::applyHighlight(int y, int x, int length, int colorPair)
 
 void MexSyntax::clearCache()
 {
-    currentRules.clear();
-    currentKeywords.clear();
+    currentLexer = nullptr;
+    tokenCache.clear();
+    resetLineStates();
 }
\ No newline at end of file
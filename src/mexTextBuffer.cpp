@@ -0,0 +1,701 @@
+#include "../include/mexTextBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include "../include/mexLineScan.h"
+
+/// @brief Background newline indexer for a mapped file. \struct LoadState
+///
+/// The file is cut into cells of pieceTargetSize bytes; each cell's chunk starts after the first newline
+/// following the cell start, so every boundary can be found independently. Contiguous runs of cells
+/// (segments) are indexed in parallel, and the chunks of a segment are published in order.
+struct MexTextBuffer::LoadState
+{
+    struct Chunk
+    {
+        size_t end;
+        size_t lines;
+    };
+
+    struct Segment
+    {
+        size_t firstCell = 0;
+        size_t lastCell = 0;
+        std::atomic<size_t> done{0};
+    };
+
+    static constexpr size_t releaseStride = 16 * 1024 * 1024;
+    static constexpr size_t minSegmentSize = 8 * 1024 * 1024;
+
+    std::shared_ptr<const MexMappedFile> file;
+    size_t cellCount;
+    std::unique_ptr<Chunk[]> chunks;
+    size_t segmentCount;
+    std::unique_ptr<Segment[]> segments;
+    std::atomic<size_t> finishedSegments{0};
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::vector<std::jthread> workers;
+
+    explicit LoadState(std::shared_ptr<const MexMappedFile> mapped)
+        : file(std::move(mapped))
+        , cellCount((file->size() + pieceTargetSize - 1) / pieceTargetSize)
+        , chunks(std::make_unique<Chunk[]>(cellCount))
+    {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        segmentCount = std::clamp<size_t>(file->size() / minSegmentSize, 1, threads);
+        segments = std::make_unique<Segment[]>(segmentCount);
+
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            segments[i].firstCell = cellCount * i / segmentCount;
+            segments[i].lastCell = cellCount * (i + 1) / segmentCount;
+        }
+
+        workers.reserve(segmentCount);
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            workers.emplace_back([this, i](std::stop_token stop) { index(segments[i], stop); });
+        }
+    }
+
+    size_t boundary(size_t cell) const
+    {
+        const char* data = file->data();
+        size_t size = file->size();
+        if (cell == 0)
+        {
+            return 0;
+        }
+        if (cell >= cellCount)
+        {
+            return size;
+        }
+
+        const char* newline = MexLineScan::findNewline(data + cell * pieceTargetSize - 1, data + size);
+        return newline == data + size ? size : newline - data + 1;
+    }
+
+    void index(Segment& segment, const std::stop_token& stop)
+    {
+        const char* data = file->data();
+        size_t size = file->size();
+        size_t begin = boundary(segment.firstCell);
+        size_t released = begin;
+        size_t end = begin;
+
+        for (size_t cell = segment.firstCell; cell < segment.lastCell; ++cell)
+        {
+            if (stop.stop_requested())
+            {
+                return;
+            }
+
+            // A scan that ran past the next cell start found its boundary too, and that of every cell it
+            // crossed: those get empty chunks, so a long line is scanned once rather than once per cell.
+            if ((cell + 1) * pieceTargetSize > end)
+            {
+                end = boundary(cell + 1);
+            }
+            size_t lines = MexLineScan::countNewlines(data + begin, end - begin);
+            if (end == size and begin < end and data[size - 1] != '\n')
+            {
+                lines++;
+            }
+
+            chunks[cell] = {end, lines};
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                segment.done.store(cell + 1 - segment.firstCell, std::memory_order_release);
+            }
+            progress.notify_all();
+
+            if (end - released >= releaseStride)
+            {
+                file->release(released, end - released);
+                released = end;
+            }
+            begin = end;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedSegments.fetch_add(1, std::memory_order_release);
+        }
+        progress.notify_all();
+    }
+
+    size_t ready() const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            size_t done = segments[i].done.load(std::memory_order_acquire);
+            count += done;
+            if (done < segments[i].lastCell - segments[i].firstCell)
+            {
+                break;
+            }
+        }
+        return count;
+    }
+
+    bool finished() const
+    {
+        return finishedSegments.load(std::memory_order_acquire) == segmentCount;
+    }
+};
+
+MexTextBuffer::MexTextBuffer()
+{
+    clear();
+}
+
+uint64_t MexTextBuffer::nextVersion()
+{
+    // Shared by every buffer, so a version names the same content even after it moves to another buffer.
+    static std::atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+uint32_t MexTextBuffer::nextPriority() const
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+MexTextBuffer::NodePtr MexTextBuffer::makeNode(Piece piece, NodePtr left, NodePtr right, uint32_t priority)
+{
+    auto node = std::make_shared<Node>();
+    node->subtreeLines = linesOf(left) + piece.lines + linesOf(right);
+    node->subtreeBytes = bytesOf(left) + piece.length + bytesOf(right);
+    node->piece = std::move(piece);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->priority = priority;
+    return node;
+}
+
+MexTextBuffer::NodePtr MexTextBuffer::merge(const NodePtr& a, const NodePtr& b)
+{
+    if (!a) return b;
+    if (!b) return a;
+
+    if (a->priority >= b->priority)
+    {
+        return makeNode(a->piece, a->left, merge(a->right, b), a->priority);
+    }
+
+    return makeNode(b->piece, merge(a, b->left), b->right, b->priority);
+}
+
+std::pair<MexTextBuffer::NodePtr, MexTextBuffer::NodePtr> MexTextBuffer::split(const NodePtr& node, size_t lines)
+{
+    if (!node)
+    {
+        return {};
+    }
+
+    size_t leftLines = linesOf(node->left);
+    if (lines <= leftLines)
+    {
+        auto [left, right] = split(node->left, lines);
+        return {left, makeNode(node->piece, right, node->right, node->priority)};
+    }
+
+    size_t pieceEnd = leftLines + node->piece.lines;
+    if (lines >= pieceEnd)
+    {
+        auto [left, right] = split(node->right, lines - pieceEnd);
+        return {makeNode(node->piece, node->left, left, node->priority), right};
+    }
+
+    auto [head, tail] = splitPiece(node->piece, lines - leftLines);
+    return {makeNode(std::move(head), node->left, nullptr, node->priority),
+            makeNode(std::move(tail), nullptr, node->right, node->priority)};
+}
+
+std::pair<MexTextBuffer::Piece, MexTextBuffer::Piece> MexTextBuffer::splitPiece(const Piece& piece, size_t lines)
+{
+    size_t offset = lineStarts(piece)[lines];
+
+    Piece head;
+    head.storage = piece.storage;
+    head.mapping = piece.mapping;
+    head.data = piece.data;
+    head.length = offset;
+    head.lines = lines;
+    head.terminated = true;
+
+    Piece tail;
+    tail.storage = piece.storage;
+    tail.mapping = piece.mapping;
+    tail.data = piece.data + offset;
+    tail.length = piece.length - offset;
+    tail.lines = piece.lines - lines;
+    tail.terminated = piece.terminated;
+
+    if (head.lines > 1) head.index = std::make_shared<LineIndex>();
+    if (tail.lines > 1) tail.index = std::make_shared<LineIndex>();
+
+    return {std::move(head), std::move(tail)};
+}
+
+const std::vector<uint32_t>& MexTextBuffer::lineStarts(const Piece& piece)
+{
+    std::call_once(piece.index->once, [&piece]()
+    {
+        auto& starts = piece.index->starts;
+        starts.reserve(piece.lines);
+        starts.push_back(0);
+
+        const char* cursor = piece.data;
+        const char* end = piece.data + piece.length;
+        while (starts.size() < piece.lines)
+        {
+            // A mapped file truncated in place reads as zeros past its new end, so newlines can go missing:
+            // the lines that lost theirs end with the piece, and the ones after them are empty.
+            const void* newline = cursor < end ? std::memchr(cursor, '\n', end - cursor) : nullptr;
+            cursor = newline ? static_cast<const char*>(newline) + 1 : end;
+            starts.push_back(static_cast<uint32_t>(cursor - piece.data));
+        }
+    });
+
+    return piece.index->starts;
+}
+
+std::string_view MexTextBuffer::pieceLine(const Piece& piece, size_t local)
+{
+    size_t begin = 0;
+    size_t end = piece.length;
+
+    if (piece.lines > 1)
+    {
+        const auto& starts = lineStarts(piece);
+        begin = starts[local];
+        if (local + 1 < piece.lines)
+        {
+            size_t next = starts[local + 1];
+            return {piece.data + begin, next > begin and piece.data[next - 1] == '\n' ? next - 1 - begin : next - begin};
+        }
+    }
+
+    if (piece.terminated and end > begin)
+    {
+        end--;
+    }
+
+    return {piece.data + begin, end - begin};
+}
+
+size_t MexTextBuffer::pieceEnd(const char* data, size_t size, size_t offset)
+{
+    size_t cut = std::min(size, offset + pieceTargetSize);
+    if (cut < size)
+    {
+        const char* newline = MexLineScan::findNewline(data + cut, data + size);
+        cut = newline == data + size ? size : newline - data + 1;
+    }
+    return cut;
+}
+
+MexTextBuffer::NodePtr MexTextBuffer::appendText(NodePtr tree, const std::shared_ptr<const void>& storage,
+                                                 const char* data, size_t size, bool terminated) const
+{
+    size_t offset = 0;
+    while (offset < size)
+    {
+        size_t cut = pieceEnd(data, size, offset);
+
+        Piece piece;
+        piece.storage = storage;
+        piece.data = data + offset;
+        piece.length = cut - offset;
+        piece.lines = MexLineScan::countNewlines(piece.data, piece.length);
+        piece.terminated = cut < size or (terminated and data[size - 1] == '\n');
+        if (!piece.terminated)
+        {
+            piece.lines++;
+        }
+
+        if (piece.lines > 1)
+        {
+            piece.index = std::make_shared<LineIndex>();
+        }
+
+        tree = merge(tree, makeNode(std::move(piece), nullptr, nullptr, nextPriority()));
+        offset = cut;
+    }
+
+    return tree;
+}
+
+void MexTextBuffer::replaceLines(size_t first, size_t count, std::string text)
+{
+    auto [head, rest] = split(root, first);
+    auto tail = split(rest, count).second;
+
+    auto storage = std::make_shared<const std::string>(std::move(text));
+    const std::string& content = *storage;
+    NodePtr middle = appendText(nullptr, storage, content.data(), content.size(), false);
+    if (content.empty())
+    {
+        middle = merge(middle, makeNode(Piece{}, nullptr, nullptr, nextPriority()));
+    }
+
+    root = merge(merge(head, middle), tail);
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::ensureLines(size_t count) const
+{
+    while (loading and linesOf(root) < count)
+    {
+        absorbChunks();
+        if (!loading or linesOf(root) >= count)
+        {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(loading->mutex);
+        loading->progress.wait(lock, [this]()
+        {
+            return loading->finished() or loading->ready() > loadedChunks;
+        });
+    }
+}
+
+void MexTextBuffer::absorbChunks() const
+{
+    bool finished = loading->finished();
+    size_t ready = loading->ready();
+    const char* data = loading->file->data();
+
+    for (; loadedChunks < ready; ++loadedChunks)
+    {
+        const auto& chunk = loading->chunks[loadedChunks];
+        size_t begin = loadedChunks == 0 ? 0 : loading->chunks[loadedChunks - 1].end;
+        if (chunk.end == begin)
+        {
+            continue;
+        }
+
+        Piece piece;
+        piece.storage = loading->file;
+        piece.mapping = loading->file.get();
+        piece.data = data + begin;
+        piece.length = chunk.end - begin;
+        piece.lines = chunk.lines;
+        piece.terminated = data[chunk.end - 1] == '\n';
+        if (piece.lines > 1)
+        {
+            piece.index = std::make_shared<LineIndex>();
+        }
+
+        root = merge(root, makeNode(std::move(piece), nullptr, nullptr, nextPriority()));
+    }
+
+    if (finished)
+    {
+        loading.reset();
+        loadedChunks = 0;
+    }
+}
+
+void MexTextBuffer::assign(std::shared_ptr<const MexMappedFile> file)
+{
+    root.reset();
+    loadedChunks = 0;
+    loading = std::make_shared<LoadState>(std::move(file));
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::assign(std::string text)
+{
+    loading.reset();
+    loadedChunks = 0;
+
+    auto storage = std::make_shared<const std::string>(std::move(text));
+    const std::string& content = *storage;
+    root = appendText(nullptr, storage, content.data(), content.size(), true);
+
+    if (!root)
+    {
+        clear();
+    }
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::clear()
+{
+    loading.reset();
+    loadedChunks = 0;
+    root = makeNode(Piece{}, nullptr, nullptr, nextPriority());
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::adopt(const MexTextBuffer& other)
+{
+    root = other.root;
+    loading = other.loading;
+    loadedChunks = other.loadedChunks;
+    editVersion = other.editVersion;
+}
+
+template<typename Fn>
+void MexTextBuffer::visitPieces(const NodePtr& node, Fn& fn)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    visitPieces(node->left, fn);
+    fn(node->piece);
+    visitPieces(node->right, fn);
+}
+
+bool MexTextBuffer::detachChangedFiles()
+{
+    // Besides the file being loaded, only files read back whole are mapped, so there are few to check.
+    std::vector<std::pair<const MexMappedFile*, size_t>> mappings;
+    auto collect = [&mappings](const MexMappedFile* mapping)
+    {
+        if (mapping and std::ranges::find(mappings, mapping, &std::pair<const MexMappedFile*, size_t>::first) == mappings.end())
+        {
+            mappings.emplace_back(mapping, mapping->size());
+        }
+    };
+    collect(loading ? loading->file.get() : nullptr);
+    auto collectPiece = [&collect](const Piece& piece) { collect(piece.mapping); };
+    visitPieces(root, collectPiece);
+
+    if (std::ranges::none_of(mappings, [](const auto& mapping) { return mapping.first->changedOnDisk(); }))
+    {
+        return false;
+    }
+
+    for (auto& [mapping, readable] : mappings)
+    {
+        readable = mapping->readableSize();
+    }
+
+    // The bytes still in the file are copied as they are now; they may already differ from what was loaded.
+    lineCount();
+    std::string text;
+    auto copyPiece = [&](const Piece& piece)
+    {
+        size_t length = piece.length;
+        if (piece.mapping)
+        {
+            size_t readable = std::ranges::find(mappings, piece.mapping, &std::pair<const MexMappedFile*, size_t>::first)->second;
+            size_t offset = static_cast<size_t>(piece.data - piece.mapping->data());
+            length = offset < readable ? std::min(length, readable - offset) : 0;
+        }
+        text.append(piece.data, length);
+        if (!piece.terminated)
+        {
+            text += '\n';
+        }
+    };
+    visitPieces(root, copyPiece);
+
+    assign(std::move(text));
+    return true;
+}
+
+MexTextBuffer MexTextBuffer::snapshot() const
+{
+    MexTextBuffer copy(*this);
+    copy.listeners.clear();
+    return copy;
+}
+
+size_t MexTextBuffer::lineCount() const
+{
+    ensureLines(std::numeric_limits<size_t>::max());
+    return linesOf(root);
+}
+
+size_t MexTextBuffer::byteCount() const
+{
+    size_t bytes = 0;
+    forEachSpan([&bytes](std::string_view span) { bytes += span.size(); });
+    return bytes;
+}
+
+bool MexTextBuffer::hasLine(size_t index) const
+{
+    ensureLines(index + 1);
+    return index < linesOf(root);
+}
+
+bool MexTextBuffer::isLoading() const
+{
+    return loading != nullptr;
+}
+
+std::string_view MexTextBuffer::line(size_t index) const
+{
+    ensureLines(index + 1);
+    const Node* node = root.get();
+    while (node)
+    {
+        size_t leftLines = linesOf(node->left);
+        if (index < leftLines)
+        {
+            node = node->left.get();
+            continue;
+        }
+
+        index -= leftLines;
+        if (index < node->piece.lines)
+        {
+            return pieceLine(node->piece, index);
+        }
+
+        index -= node->piece.lines;
+        node = node->right.get();
+    }
+
+    throw std::out_of_range("MexTextBuffer::line: index out of range");
+}
+
+size_t MexTextBuffer::lineLength(size_t index) const
+{
+    return line(index).size();
+}
+
+bool MexTextBuffer::isEmpty() const
+{
+    return !hasLine(1) and lineLength(0) == 0;
+}
+
+void MexTextBuffer::insert(size_t line, size_t column, std::string_view text)
+{
+    replace(line, column, line, column, text);
+}
+
+void MexTextBuffer::erase(size_t line, size_t column, size_t endLine, size_t endColumn)
+{
+    replace(line, column, endLine, endColumn, {});
+}
+
+void MexTextBuffer::replace(size_t line, size_t column, size_t endLine, size_t endColumn, std::string_view text)
+{
+    std::string_view first = this->line(line);
+    std::string_view last = this->line(endLine);
+    column = std::min(column, first.size());
+    endColumn = std::min(endColumn, last.size());
+
+    std::string removed;
+    if (!listeners.empty())
+    {
+        removed = this->text(line, column, endLine, endColumn);
+    }
+
+    std::string updated;
+    updated.reserve(column + text.size() + last.size() - endColumn);
+    updated.append(first.substr(0, column));
+    updated.append(text);
+    updated.append(last.substr(endColumn));
+    replaceLines(line, endLine - line + 1, std::move(updated));
+
+    for (Listener* listener : listeners)
+    {
+        listener->onReplace(line, column, removed, text);
+    }
+}
+
+std::string MexTextBuffer::text(size_t line, size_t column, size_t endLine, size_t endColumn) const
+{
+    std::string result;
+    forEachLine(line, endLine + 1, [&](size_t index, std::string_view content)
+    {
+        size_t begin = index == line ? std::min(column, content.size()) : 0;
+        size_t end = index == endLine ? std::min(endColumn, content.size()) : content.size();
+        if (index != line)
+        {
+            result.push_back('\n');
+        }
+        result.append(content.substr(begin, end > begin ? end - begin : 0));
+    });
+    return result;
+}
+
+void MexTextBuffer::insertLine(size_t index, std::string_view text)
+{
+    ensureLines(index);
+    if (!listeners.empty())
+    {
+        if (index < linesOf(root))
+        {
+            replace(index, 0, index, 0, std::string(text) + '\n');
+        }
+        else
+        {
+            size_t column = lineLength(index - 1);
+            replace(index - 1, column, index - 1, column, '\n' + std::string(text));
+        }
+        return;
+    }
+
+    auto [head, tail] = split(root, index);
+    auto storage = std::make_shared<const std::string>(text);
+
+    Piece piece;
+    piece.storage = storage;
+    piece.data = storage->data();
+    piece.length = storage->size();
+
+    root = merge(merge(head, makeNode(std::move(piece), nullptr, nullptr, nextPriority())), tail);
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::eraseLine(size_t index)
+{
+    if (!hasLine(1))
+    {
+        replace(0, 0, 0, lineLength(0), {});
+        return;
+    }
+
+    if (!listeners.empty())
+    {
+        if (hasLine(index + 1))
+        {
+            replace(index, 0, index + 1, 0, {});
+        }
+        else
+        {
+            replace(index - 1, lineLength(index - 1), index, lineLength(index), {});
+        }
+        return;
+    }
+
+    ensureLines(index + 1);
+
+    auto [head, rest] = split(root, index);
+    root = merge(head, split(rest, 1).second);
+    editVersion = nextVersion();
+}
+
+void MexTextBuffer::replaceLine(size_t index, std::string_view text)
+{
+    replace(index, 0, index, lineLength(index), text);
+}
+
+void MexTextBuffer::addListener(Listener* listener)
+{
+    listeners.push_back(listener);
+}
+
+void MexTextBuffer::removeListener(Listener* listener)
+{
+    std::erase(listeners, listener);
+}
@@ -0,0 +1,516 @@
+#include "../include/mexTrigramIndex.h"
+#include "../include/mexProjectSearch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char indexMagic[8] = {'M', 'E', 'X', 'T', 'R', 'I', '0', '1'};
+    constexpr uint32_t noFile = UINT32_MAX;
+
+    /// @brief The start of an index file. The sections follow in this order: the file table, the posting offsets,
+    /// the trigrams (padded to 8 bytes), the root, the paths and the postings. \struct Header
+    struct Header
+    {
+        char magic[8];
+        uint64_t fileCount;
+        uint64_t trigramCount;
+        uint64_t rootBytes;
+        uint64_t pathBytes;
+        uint64_t postingBytes;
+    };
+
+    unsigned char fold(char c)
+    {
+        return c >= 'A' and c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : static_cast<unsigned char>(c);
+    }
+
+    // Calls fn with every trigram of text, folded to lower case, as a 24-bit number.
+    template<typename Fn>
+    void forEachTrigram(std::string_view text, Fn&& fn)
+    {
+        if (text.size() < 3)
+        {
+            return;
+        }
+
+        uint32_t trigram = fold(text[0]) << 8 | fold(text[1]);
+        for (size_t i = 2; i < text.size(); ++i)
+        {
+            trigram = (trigram << 8 | fold(text[i])) & 0xFFFFFF;
+            fn(trigram);
+        }
+    }
+
+    size_t padTo8(size_t bytes)
+    {
+        return (bytes + 7) & ~static_cast<size_t>(7);
+    }
+
+    void appendVarint(std::string& out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    int64_t modifiedTime(const struct stat& info)
+    {
+#ifdef __APPLE__
+        const timespec& time = info.st_mtimespec;
+#else
+        const timespec& time = info.st_mtim;
+#endif
+        return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+}
+
+fs::path MexTrigramIndex::cachePath(const fs::path& root)
+{
+    fs::path directory;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache and *cache)
+    {
+        directory = cache;
+    }
+    else if (const char* home = std::getenv("HOME"); home and *home)
+    {
+        directory = fs::path(home) / ".cache";
+    }
+    else
+    {
+        std::error_code ec;
+        directory = fs::temp_directory_path(ec);
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "index-%016zx", std::hash<std::string>{}(root.native()));
+    return directory / "mexEdit" / name;
+}
+
+std::shared_ptr<const MexTrigramIndex> MexTrigramIndex::load(const fs::path& root)
+{
+    auto index = std::make_shared<MexTrigramIndex>();
+    if (!index->open(cachePath(root), root.native()))
+    {
+        return nullptr;
+    }
+    return index;
+}
+
+bool MexTrigramIndex::open(const fs::path& path, const std::string& root)
+{
+    if (!mapping.open(path) or mapping.size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, mapping.data(), sizeof(Header));
+    if (std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 or header.fileCount > UINT32_MAX or
+        header.trigramCount > (1 << 24))
+    {
+        return false;
+    }
+
+    size_t offsetsStart = sizeof(Header) + header.fileCount * sizeof(File);
+    size_t trigramsStart = offsetsStart + (header.trigramCount + 1) * sizeof(uint64_t);
+    size_t rootStart = padTo8(trigramsStart + header.trigramCount * sizeof(uint32_t));
+    size_t pathsStart = rootStart + header.rootBytes;
+    size_t postingsStart = pathsStart + header.pathBytes;
+    if (header.rootBytes > mapping.size() or header.pathBytes > mapping.size() or postingsStart > mapping.size() or
+        header.postingBytes != mapping.size() - postingsStart)
+    {
+        return false;
+    }
+
+    const char* data = mapping.data();
+    if (std::string_view(data + rootStart, header.rootBytes) != root)
+    {
+        return false;
+    }
+
+    this->root = root;
+    files = {reinterpret_cast<const File*>(data + sizeof(Header)), header.fileCount};
+    postingOffsets = {reinterpret_cast<const uint64_t*>(data + offsetsStart), header.trigramCount + 1};
+    trigrams = {reinterpret_cast<const uint32_t*>(data + trigramsStart), header.trigramCount};
+    paths = {data + pathsStart, header.pathBytes};
+    postings = {data + postingsStart, header.postingBytes};
+
+    // The offsets come from disk, so they are checked once here instead of on every query.
+    for (const File& file : files)
+    {
+        if (file.pathOffset + static_cast<uint64_t>(file.pathLength) > paths.size())
+        {
+            return false;
+        }
+    }
+    return postingOffsets.front() == 0 and postingOffsets.back() == postings.size() and
+           std::is_sorted(postingOffsets.begin(), postingOffsets.end());
+}
+
+std::shared_ptr<const MexTrigramIndex> MexTrigramIndex::build(const fs::path& root, const MexTrigramIndex* previous,
+                                                              size_t threads, const std::stop_token& stop)
+{
+    const std::string& rootText = root.native();
+    std::string prefix = rootText.ends_with('/') ? rootText : rootText + "/";
+
+    // The files a project search would read, in a stable order.
+    std::vector<std::string> paths;
+    std::vector<MexProjectSearch::Entry> directories{{rootText, MexIgnoreRules::forParentsOf(root), true}};
+    std::vector<MexProjectSearch::Entry> entries;
+    while (!directories.empty())
+    {
+        if (stop.stop_requested())
+        {
+            return nullptr;
+        }
+
+        MexProjectSearch::Entry directory = std::move(directories.back());
+        directories.pop_back();
+        entries.clear();
+        MexProjectSearch::listDirectory(directory, entries);
+        for (auto& entry : entries)
+        {
+            if (entry.directory)
+            {
+                directories.push_back(std::move(entry));
+            }
+            else
+            {
+                paths.push_back(std::move(entry.path));
+            }
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::unordered_map<std::string_view, uint32_t> previousFiles;
+    if (previous)
+    {
+        for (size_t i = 0; i < previous->files.size(); ++i)
+        {
+            previousFiles.emplace(previous->path(previous->files[i]), static_cast<uint32_t>(i));
+        }
+    }
+
+    // Files that did not change keep the trigrams of the previous index; the others are read.
+    std::vector<File> files(paths.size());
+    std::vector<char> indexed(paths.size(), 0);
+    std::vector<std::vector<uint32_t>> fileTrigrams(paths.size());
+    std::vector<uint32_t> reused(previous ? previous->files.size() : 0, noFile);
+    std::atomic<size_t> next{0};
+    auto readFiles = [&]()
+    {
+        std::string buffer;
+        std::vector<uint64_t> seen(1 << 18);
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < paths.size() and !stop.stop_requested();)
+        {
+            struct stat info{};
+            if (stat(paths[i].c_str(), &info) != 0 or !S_ISREG(info.st_mode))
+            {
+                continue;
+            }
+
+            File& file = files[i];
+            file.modified = modifiedTime(info);
+            file.size = static_cast<uint64_t>(info.st_size);
+            if (auto it = previousFiles.find(std::string_view(paths[i]).substr(prefix.size())); it != previousFiles.end())
+            {
+                const File& old = previous->files[it->second];
+                if (old.modified == file.modified and old.size == file.size)
+                {
+                    reused[it->second] = static_cast<uint32_t>(i);
+                    indexed[i] = 1;
+                    continue;
+                }
+            }
+
+            MexMappedFile mapping;
+            std::string_view text = MexProjectSearch::readFile(paths[i], buffer, mapping);
+            if (text.empty() or MexProjectSearch::isBinary(text))
+            {
+                continue;
+            }
+
+            // A bit per trigram finds the distinct ones; only the bits that were set are cleared again.
+            std::vector<uint32_t>& list = fileTrigrams[i];
+            forEachTrigram(text, [&](uint32_t trigram)
+            {
+                uint64_t bit = uint64_t{1} << (trigram & 63);
+                if (!(seen[trigram >> 6] & bit))
+                {
+                    seen[trigram >> 6] |= bit;
+                    list.push_back(trigram);
+                }
+            });
+            for (uint32_t trigram : list)
+            {
+                seen[trigram >> 6] = 0;
+            }
+            list.shrink_to_fit();
+            indexed[i] = 1;
+        }
+    };
+
+    {
+        size_t count = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::jthread> workers;
+        for (size_t i = 1; i < count; ++i)
+        {
+            workers.emplace_back(readFiles);
+        }
+        readFiles();
+    }
+    if (stop.stop_requested())
+    {
+        return nullptr;
+    }
+
+    // Number the indexed files and lay out their paths. Both indexes number files in path order, so the
+    // numbers of the files taken over keep their order.
+    std::vector<File> kept;
+    std::vector<uint32_t> keptPaths;
+    std::vector<uint32_t> renumbered(reused.size(), noFile);
+    std::string pathTable;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (indexed[i])
+        {
+            std::string_view relative = std::string_view(paths[i]).substr(prefix.size());
+            File file = files[i];
+            file.pathOffset = static_cast<uint32_t>(pathTable.size());
+            file.pathLength = static_cast<uint32_t>(relative.size());
+            pathTable.append(relative);
+            kept.push_back(file);
+            keptPaths.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    for (size_t id = 0; id < reused.size(); ++id)
+    {
+        if (reused[id] != noFile)
+        {
+            renumbered[id] = static_cast<uint32_t>(std::lower_bound(keptPaths.begin(), keptPaths.end(), reused[id]) - keptPaths.begin());
+        }
+    }
+
+    // Sort the (trigram, file) pairs of the files that were read by trigram with a counting sort. Going through
+    // the files in order leaves every posting list sorted.
+    std::vector<uint32_t> slots(1 << 24, 0);
+    for (uint32_t i : keptPaths)
+    {
+        for (uint32_t trigram : fileTrigrams[i])
+        {
+            slots[trigram]++;
+        }
+    }
+
+    std::vector<uint32_t> freshTrigrams;
+    std::vector<size_t> starts;
+    size_t pairs = 0;
+    for (uint32_t trigram = 0; trigram < slots.size(); ++trigram)
+    {
+        if (slots[trigram] > 0)
+        {
+            starts.push_back(pairs);
+            pairs += slots[trigram];
+            slots[trigram] = static_cast<uint32_t>(freshTrigrams.size());
+            freshTrigrams.push_back(trigram);
+        }
+    }
+    starts.push_back(pairs);
+
+    std::vector<uint32_t> freshIds(pairs);
+    std::vector<size_t> cursors(starts.begin(), starts.end() - 1);
+    for (uint32_t id = 0; id < keptPaths.size(); ++id)
+    {
+        std::vector<uint32_t>& list = fileTrigrams[keptPaths[id]];
+        for (uint32_t trigram : list)
+        {
+            freshIds[cursors[slots[trigram]]++] = id;
+        }
+        std::vector<uint32_t>().swap(list);
+    }
+
+    // Merge them with the renumbered posting lists of the previous index, trigram by trigram.
+    std::vector<uint32_t> trigramTable;
+    std::string postingBytes;
+    std::vector<uint64_t> offsets{0};
+    std::vector<uint32_t> old;
+    std::vector<uint32_t> merged;
+    size_t previousCount = previous ? previous->trigrams.size() : 0;
+    for (size_t a = 0, b = 0; a < previousCount or b < freshTrigrams.size();)
+    {
+        uint32_t trigram = b == freshTrigrams.size() or (a < previousCount and previous->trigrams[a] < freshTrigrams[b])
+                           ? previous->trigrams[a] : freshTrigrams[b];
+
+        old.clear();
+        if (a < previousCount and previous->trigrams[a] == trigram)
+        {
+            previous->decode(a++, old);
+            size_t count = 0;
+            for (uint32_t id : old)
+            {
+                if (renumbered[id] != noFile)
+                {
+                    old[count++] = renumbered[id];
+                }
+            }
+            old.resize(count);
+        }
+        std::span<const uint32_t> fresh;
+        if (b < freshTrigrams.size() and freshTrigrams[b] == trigram)
+        {
+            fresh = std::span(freshIds).subspan(starts[b], starts[b + 1] - starts[b]);
+            b++;
+        }
+
+        merged.clear();
+        std::merge(old.begin(), old.end(), fresh.begin(), fresh.end(), std::back_inserter(merged));
+        if (merged.empty())
+        {
+            continue;
+        }
+
+        uint32_t last = 0;
+        for (uint32_t id : merged)
+        {
+            appendVarint(postingBytes, id - last);
+            last = id;
+        }
+        trigramTable.push_back(trigram);
+        offsets.push_back(postingBytes.size());
+    }
+
+    // Written next to the cache file and renamed over it, so readers never see half an index.
+    fs::path path = cachePath(root);
+    fs::path temporary = path;
+    temporary += "." + std::to_string(getpid());
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            return nullptr;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+        header.fileCount = kept.size();
+        header.trigramCount = trigramTable.size();
+        header.rootBytes = rootText.size();
+        header.pathBytes = pathTable.size();
+        header.postingBytes = postingBytes.size();
+
+        static const char padding[8] = {};
+        size_t trigramBytes = trigramTable.size() * sizeof(uint32_t);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(kept.data()), static_cast<std::streamsize>(kept.size() * sizeof(File)));
+        out.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(trigramTable.data()), static_cast<std::streamsize>(trigramBytes));
+        out.write(padding, static_cast<std::streamsize>(padTo8(trigramBytes) - trigramBytes));
+        out.write(rootText.data(), static_cast<std::streamsize>(rootText.size()));
+        out.write(pathTable.data(), static_cast<std::streamsize>(pathTable.size()));
+        out.write(postingBytes.data(), static_cast<std::streamsize>(postingBytes.size()));
+        if (!out.good())
+        {
+            out.close();
+            fs::remove(temporary, ec);
+            return nullptr;
+        }
+    }
+
+    fs::rename(temporary, path, ec);
+    if (ec)
+    {
+        fs::remove(temporary, ec);
+        return nullptr;
+    }
+    return load(root);
+}
+
+void MexTrigramIndex::decode(size_t index, std::vector<uint32_t>& out) const
+{
+    std::string_view bytes = postings.substr(postingOffsets[index], postingOffsets[index + 1] - postingOffsets[index]);
+    uint32_t id = 0;
+    for (size_t i = 0; i < bytes.size();)
+    {
+        uint32_t delta = 0;
+        for (int shift = 0; i < bytes.size(); shift += 7)
+        {
+            unsigned char byte = static_cast<unsigned char>(bytes[i++]);
+            delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                break;
+            }
+        }
+        id += delta;
+        if (id < files.size())
+        {
+            out.push_back(id);
+        }
+    }
+}
+
+std::optional<std::vector<std::string>> MexTrigramIndex::candidates(std::string_view literal) const
+{
+    if (literal.size() < 3)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<uint32_t> wanted;
+    forEachTrigram(literal, [&](uint32_t trigram) { wanted.push_back(trigram); });
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+    // Intersect the shortest posting lists first, so the candidates shrink as early as possible.
+    std::vector<size_t> positions;
+    for (uint32_t trigram : wanted)
+    {
+        auto it = std::lower_bound(trigrams.begin(), trigrams.end(), trigram);
+        if (it == trigrams.end() or *it != trigram)
+        {
+            return std::vector<std::string>{};
+        }
+        positions.push_back(static_cast<size_t>(it - trigrams.begin()));
+    }
+    std::sort(positions.begin(), positions.end(), [this](size_t a, size_t b)
+    {
+        return postingOffsets[a + 1] - postingOffsets[a] < postingOffsets[b + 1] - postingOffsets[b];
+    });
+
+    std::vector<uint32_t> ids;
+    std::vector<uint32_t> list;
+    std::vector<uint32_t> intersection;
+    decode(positions.front(), ids);
+    for (size_t i = 1; i < positions.size() and !ids.empty(); ++i)
+    {
+        list.clear();
+        decode(positions[i], list);
+        intersection.clear();
+        std::set_intersection(ids.begin(), ids.end(), list.begin(), list.end(), std::back_inserter(intersection));
+        ids.swap(intersection);
+    }
+
+    std::string prefix = root.ends_with('/') ? root : root + "/";
+    std::vector<std::string> result;
+    result.reserve(ids.size());
+    for (uint32_t id : ids)
+    {
+        result.push_back(prefix + std::string(path(files[id])));
+    }
+    return result;
+}
@@ -0,0 +1,130 @@
+#include "../include/mexWatcher.h"
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+#ifdef __linux__
+    constexpr uint32_t directoryMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    // IN_MODIFY is left out: a program appending to the file would report every write.
+    constexpr uint32_t fileMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+#endif
+}
+
+MexWatcher::MexWatcher()
+{
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+MexWatcher::~MexWatcher()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void MexWatcher::watchDirectory(const fs::path& directory)
+{
+    this->directory = directory.native();
+    updateWatches();
+}
+
+void MexWatcher::watchFile(const fs::path& file)
+{
+    std::error_code ec;
+    fs::path absolute = file.empty() ? fs::path() : fs::absolute(file, ec).lexically_normal();
+    fileDirectory = absolute.parent_path().native();
+    fileName = absolute.filename().native();
+    updateWatches();
+}
+
+void MexWatcher::updateWatches()
+{
+#ifdef __linux__
+    if (fd < 0)
+    {
+        return;
+    }
+
+    // Adding a watch for a directory that already has one replaces its mask, so both are removed first and the
+    // shared directory gets one watch with both masks.
+    if (directoryWatch >= 0)
+    {
+        inotify_rm_watch(fd, directoryWatch);
+    }
+    if (fileWatch >= 0 and fileWatch != directoryWatch)
+    {
+        inotify_rm_watch(fd, fileWatch);
+    }
+    directoryWatch = -1;
+    fileWatch = -1;
+
+    bool shared = !fileName.empty() and fileDirectory == directory;
+    if (!directory.empty())
+    {
+        directoryWatch = inotify_add_watch(fd, directory.c_str(), directoryMask | (shared ? fileMask : 0) | IN_ONLYDIR | IN_EXCL_UNLINK);
+    }
+    if (shared)
+    {
+        fileWatch = directoryWatch;
+    }
+    else if (!fileName.empty())
+    {
+        fileWatch = inotify_add_watch(fd, fileDirectory.c_str(), fileMask | IN_ONLYDIR | IN_EXCL_UNLINK);
+    }
+#endif
+}
+
+std::vector<MexWatcher::Event> MexWatcher::readEvents()
+{
+    std::vector<Event> events;
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16384];
+    while (fd >= 0)
+    {
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < count;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                events.push_back({Change::Overflow, {}});
+                continue;
+            }
+            if (event->wd < 0 or event->len == 0)
+            {
+                continue;
+            }
+
+            // Events of watches removed since they were queued have a stale descriptor and are dropped here.
+            std::string name = event->name;
+            bool added = event->mask & (IN_CREATE | IN_MOVED_TO);
+            bool removed = event->mask & (IN_DELETE | IN_MOVED_FROM);
+            if (event->wd == directoryWatch and (added or removed))
+            {
+                events.push_back({added ? Change::EntryAdded : Change::EntryRemoved, name});
+            }
+            if (event->wd == fileWatch and name == fileName and (event->mask & fileMask))
+            {
+                events.push_back({removed ? Change::FileRemoved : Change::FileChanged, name});
+            }
+        }
+    }
+#endif
+    return events;
+}